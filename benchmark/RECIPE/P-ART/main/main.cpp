@@ -89,43 +89,48 @@ void run_op(char **op, Tree* tree, ThreadInfo t, FILE *output_file) {
   }
 }
 
+// Run the ops of a thread of witcher_mt_run on the tree, with a ThreadInfo
+// of its own
+void *run_op_thread(void *arg) {
+  struct witcher_mt_thread *thread = (struct witcher_mt_thread *)arg;
+  Tree *tree = (Tree *)thread->arg;
+  ThreadInfo t = tree->getThreadInfo();
+  char **op;
+  while ((op = witcher_mt_next(thread)) != NULL) {
+    run_op(op, tree, t, thread->output_file);
+  }
+  return NULL;
+}
+
 void read_op_and_run(char *op_file_path,
                      int start_index,
                      int skip_index,
                      char *output_file_path,
                      Tree* tree,
                      ThreadInfo t) {
-  FILE *output_file = fopen(output_file_path, "w");
-  FILE *op_file = fopen(op_file_path, "r");
-  char line[256];
-  int count = 0;
-  while (fgets(line, sizeof line, op_file) != NULL) {
-    if (count < start_index || count == skip_index) {
-      count++;
-      continue;
-    }
-
-    char *op[3];
-    char *p = strtok(line, ";");
-    int i = 0;
-    while (p != NULL && i < 3) {
-      op[i++] = p;
-      p = strtok (NULL, ";");
-    }
+  if (witcher_mt_threads() > 1) {
+    witcher_mt_run(op_file_path, start_index, skip_index, output_file_path,
+                   run_op_thread, tree);
+    return;
+  }
 
+  FILE *output_file = witcher_open_output_file(output_file_path);
+  struct witcher_op_iter it;
+  witcher_op_iter_open(&it, op_file_path, start_index, skip_index);
+  char **op;
+  while ((op = witcher_op_iter_next(&it)) != NULL) {
     run_op(op, tree, t, output_file);
-
-    count++;
+    witcher_check_output(output_file);
   }
-  fclose(op_file);
-  fclose(output_file);
+  witcher_op_iter_close(&it);
+  witcher_close_output_file(output_file);
 }
 
 void loadKey(TID tid, Key &key) {
     return ;
 }
 
-int main(int argc, char *argv[]) {
+int witcher_main(int argc, char *argv[]) {
   assert(argc== 8 || argc == 9);
 
   char *pmem_path = argv[1];
@@ -137,18 +142,22 @@ int main(int argc, char *argv[]) {
   int skip_index = atoi(argv[6]);
 
   char *output_file_path = argv[7];
+  witcher_phase_begin(WITCHER_PHASE_POOL_OPEN);
   Tree *tree = init_P_ART(pmem_path,
                           pmem_size_in_mib,
                           layout_name);
   Tree tt(loadKey); // Dummy tree to get the threadinfo.. Need to talk with Xinwei
   ThreadInfo t = tt.getThreadInfo();
+  witcher_phase_end(WITCHER_PHASE_POOL_OPEN);
 
+  witcher_phase_begin(WITCHER_PHASE_SUFFIX);
   read_op_and_run(op_file_path,
                   start_index,
                   skip_index,
                   output_file_path,
                   tree,
                   t);
+  witcher_phase_end(WITCHER_PHASE_SUFFIX);
 
   if (argc == 9) {
     char *memory_layout_path = argv[8];
@@ -157,3 +166,10 @@ int main(int argc, char *argv[]) {
 
   exit(0);
 }
+
+int main(int argc, char *argv[]) {
+  if (witcher_is_fork_server(argc, argv)) {
+    return witcher_fork_server(argc, argv, witcher_main);
+  }
+  return witcher_main(argc, argv);
+}
@@ -15,7 +15,7 @@ void run_op(char **op, art_tree* tree, FILE *output_file) {
   switch (op[0][0]) {
     case 'i':
       key = atol(op[1]);
-      value = (char*) nvm_alloc(VALUE_LEN);
+      value = (char*) nvm_alloc_value(VALUE_LEN);
       memcpy(value, op[2], strlen(op[2])+1);
 			asm volatile ("clflush %0\n" : "+m" (*(char *)(value)));
       asm volatile("mfence" ::: "memory");
@@ -47,33 +47,19 @@ void read_op_and_run(char *op_file_path,
                      int skip_index,
                      char *output_file_path,
                      art_tree* tree) {
-  FILE *output_file = fopen(output_file_path, "w");
-  FILE *op_file = fopen(op_file_path, "r");
-  char line[256];
-  int count = 0;
-  while (fgets(line, sizeof line, op_file) != NULL) {
-    if (count < start_index || count == skip_index) {
-      count++;
-      continue;
-    }
-
-    char *op[3];
-    char *p = strtok(line, ";");
-    int i = 0;
-    while (p != NULL && i < 3) {
-      op[i++] = p;
-      p = strtok (NULL, ";");
-    }
-
+  FILE *output_file = witcher_open_output_file(output_file_path);
+  struct witcher_op_iter it;
+  witcher_op_iter_open(&it, op_file_path, start_index, skip_index);
+  char **op;
+  while ((op = witcher_op_iter_next(&it)) != NULL) {
     run_op(op, tree, output_file);
-
-    count++;
+    witcher_check_output(output_file);
   }
-  fclose(op_file);
-  fclose(output_file);
+  witcher_op_iter_close(&it);
+  witcher_close_output_file(output_file);
 }
 
-int main(int argc, char *argv[]) {
+int witcher_main(int argc, char *argv[]) {
   assert(argc== 8 || argc == 9);
 
   char *pmem_path = argv[1];
@@ -86,13 +72,17 @@ int main(int argc, char *argv[]) {
 
   char *output_file_path = argv[7];
 
+  witcher_phase_begin(WITCHER_PHASE_POOL_OPEN);
   art_tree *tree =init_woart(pmem_path, pmem_size_in_mib, layout_name);
+  witcher_phase_end(WITCHER_PHASE_POOL_OPEN);
 
+  witcher_phase_begin(WITCHER_PHASE_SUFFIX);
   read_op_and_run(op_file_path,
                   start_index,
                   skip_index,
                   output_file_path,
                   tree);
+  witcher_phase_end(WITCHER_PHASE_SUFFIX);
 
   if (argc == 9) {
     char *memory_layout_path = argv[8];
@@ -101,3 +91,10 @@ int main(int argc, char *argv[]) {
 
   return 0;
 }
+
+int main(int argc, char *argv[]) {
+  if (witcher_is_fork_server(argc, argv)) {
+    return witcher_fork_server(argc, argv, witcher_main);
+  }
+  return witcher_main(argc, argv);
+}
@@ -0,0 +1,276 @@
+#include "pmdk.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+static PMEMobjpool *g_pop;
+static root_obj *g_root_obj;
+static struct nvm_value_slab *g_value_slab;
+static pthread_mutex_t g_value_slab_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Timing counters, written at exit with WITCHER_PMDK_STATS
+static struct {
+  const char *path;
+  uint64_t open_ns;
+  uint64_t create_ns;
+  uint64_t root_ns;
+  uint64_t alloc_ns;
+  uint64_t num_allocs;
+  uint64_t free_ns;
+  uint64_t num_frees;
+  uint64_t num_value_slabs;
+} g_stats;
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void write_stats() {
+  FILE *file = fopen(g_stats.path, "w");
+  if (file == NULL) {
+    perror("failed to open the pmdk stats file\n");
+    return;
+  }
+  fprintf(file, "open: %lu ns\n", (unsigned long)g_stats.open_ns);
+  fprintf(file, "create: %lu ns\n", (unsigned long)g_stats.create_ns);
+  fprintf(file, "root: %lu ns\n", (unsigned long)g_stats.root_ns);
+  fprintf(file, "allocs: %lu\n", (unsigned long)g_stats.num_allocs);
+  fprintf(file, "alloc: %lu ns\n", (unsigned long)g_stats.alloc_ns);
+  fprintf(file, "frees: %lu\n", (unsigned long)g_stats.num_frees);
+  fprintf(file, "free: %lu ns\n", (unsigned long)g_stats.free_ns);
+  fprintf(file, "value slabs: %lu\n", (unsigned long)g_stats.num_value_slabs);
+  fclose(file);
+}
+
+root_obj *init_nvmm_pool(char *path,
+                         size_t size,
+                         char *layout_name,
+                         int *is_created) {
+  /* You should not init twice. */
+  assert(g_pop == NULL);
+
+  g_stats.path = getenv("WITCHER_PMDK_STATS");
+  if (g_stats.path != NULL) {
+    atexit(write_stats);
+  }
+  char *fast_open = getenv("WITCHER_PMDK_FAST_OPEN");
+  if (fast_open != NULL && atoi(fast_open) != 0) {
+    int prefault = 1;
+    pmemobj_ctl_set(NULL, "prefault.at_open", &prefault);
+  }
+
+  /* check if the path exsists already, else create one
+  * or open the exsisting file*/
+  uint64_t start = g_stats.path != NULL ? now_ns() : 0;
+  if (access(path, F_OK) != 0) {
+    if ((g_pop = pmemobj_create(path, layout_name, size*MIB_SIZE, 0666)) == NULL) {
+      perror("failed to create pool\n");
+      return NULL;
+    }
+    *is_created = 1;
+  } else {
+    if ((g_pop = pmemobj_open(path, layout_name)) == NULL) {
+      perror("failed to open th exsisting pool\n");
+      return NULL;
+    }
+    *is_created = 0;
+  }
+  if (g_stats.path != NULL) {
+    uint64_t end = now_ns();
+    if (*is_created) {
+      g_stats.create_ns += end - start;
+    } else {
+      g_stats.open_ns += end - start;
+    }
+    start = end;
+  }
+
+  /* allocate a root in the nvmem pool, here on root_obj*/
+  PMEMoid g_root = pmemobj_root(g_pop, sizeof(root_obj));
+  if (g_stats.path != NULL) {
+    g_stats.root_ns += now_ns() - start;
+  }
+  g_root_obj = (root_obj*)pmemobj_direct(g_root);
+  g_value_slab = (struct nvm_value_slab*)pmemobj_direct(g_root_obj->value_slab);
+  return g_root_obj;
+}
+
+int destroy_nvmm_pool() {
+  pmemobj_close(g_pop);
+  g_pop = NULL;
+  g_root_obj = NULL;
+  g_value_slab = NULL;
+  return 0;
+}
+
+void *nvm_alloc(size_t size) {
+  int ret;
+  PMEMoid _addr;
+
+  uint64_t start = g_stats.path != NULL ? now_ns() : 0;
+  ret = pmemobj_alloc(g_pop, &_addr, size, 0, NULL, NULL);
+  if (ret) {
+    perror("nvmm memory allocation failed\n");
+  }
+  if (g_stats.path != NULL) {
+    g_stats.alloc_ns += now_ns() - start;
+    g_stats.num_allocs++;
+  }
+  return pmemobj_direct(_addr);
+}
+
+#ifdef NVM_VALUE_SLAB
+// The slots start at the first cache line after the header, pmemobj_alloc
+// does not align the slab to a cache line
+static char *value_slot(struct nvm_value_slab *slab, uint64_t slot) {
+  uintptr_t slots = ((uintptr_t)(slab + 1) + NVM_VALUE_SLOT_SIZE - 1) &
+                    ~(NVM_VALUE_SLOT_SIZE - 1);
+  return (char*)slots + NVM_VALUE_SLOT_SIZE * slot;
+}
+
+// Replace the full slab with a new one, unless another thread did already
+static void new_value_slab(struct nvm_value_slab *full) {
+  pthread_mutex_lock(&g_value_slab_lock);
+  if (g_value_slab == full) {
+    uint64_t start = g_stats.path != NULL ? now_ns() : 0;
+    size_t size = sizeof(struct nvm_value_slab) + NVM_VALUE_SLOT_SIZE - 1 +
+                  NVM_VALUE_SLOT_SIZE * NVM_VALUE_SLAB_SLOTS;
+    // allocated into the root, so a crash leaves the slab either allocated
+    // and linked or neither. The full slab is only dropped, its values stay
+    // where they are.
+    if (pmemobj_zalloc(g_pop, &g_root_obj->value_slab, size, 0)) {
+      perror("nvmm value slab allocation failed\n");
+      pthread_mutex_unlock(&g_value_slab_lock);
+      return;
+    }
+    struct nvm_value_slab *slab =
+        (struct nvm_value_slab*)pmemobj_direct(g_root_obj->value_slab);
+    // a slab linked without its slots after a crash is full, and is replaced
+    // by the next value allocated
+    slab->num_slots = NVM_VALUE_SLAB_SLOTS;
+    pmemobj_persist(g_pop, &slab->num_slots, sizeof(slab->num_slots));
+    __atomic_store_n(&g_value_slab, slab, __ATOMIC_RELEASE);
+    if (g_stats.path != NULL) {
+      g_stats.alloc_ns += now_ns() - start;
+      g_stats.num_allocs++;
+      g_stats.num_value_slabs++;
+    }
+  }
+  pthread_mutex_unlock(&g_value_slab_lock);
+}
+#endif
+
+void *nvm_alloc_value(size_t size) {
+#ifdef NVM_VALUE_SLAB
+  if (size > NVM_VALUE_SLOT_SIZE) {
+    return nvm_alloc(size);
+  }
+  for (;;) {
+    struct nvm_value_slab *slab = __atomic_load_n(&g_value_slab, __ATOMIC_ACQUIRE);
+    if (slab != NULL) {
+      uint64_t slot = __atomic_fetch_add(&slab->next, 1, __ATOMIC_RELAXED);
+      if (slot < slab->num_slots) {
+        // persisted before the value is written, so the slot of a value is
+        // not handed out again after a crash
+        pmemobj_persist(g_pop, &slab->next, sizeof(slab->next));
+        return value_slot(slab, slot);
+      }
+    }
+    new_value_slab(slab);
+    if (__atomic_load_n(&g_value_slab, __ATOMIC_ACQUIRE) == slab) {
+      return NULL;
+    }
+  }
+#else
+  return nvm_alloc(size);
+#endif
+}
+
+// NVM_ALIGNED_ALLOC_IS_ALLOC: the allocation is not aligned further than
+// pmemobj_alloc aligns it (P-CLHT)
+int nvm_aligned_alloc(void **res, size_t align, size_t len){
+#ifdef NVM_ALIGNED_ALLOC_IS_ALLOC
+	*res = nvm_alloc(len);
+	return 0;
+#else
+	int ret;
+	PMEMoid _addr;
+	unsigned char *mem, *_new, *end;
+	size_t header, footer;
+	PMEMobjpool *pop;
+
+	pop = g_pop;
+
+	if ((align & -align) != align) return EINVAL;
+	if (len > SIZE_MAX - align) return ENOMEM;
+
+	if (align <= 4*sizeof(size_t)) {
+
+		ret = pmemobj_alloc(pop, &_addr, len, 0, NULL, NULL);
+		if (ret) {
+			perror("[0] nvmm memory allocation failed\n");
+			return -1;
+		}
+
+		*res = pmemobj_direct(_addr);
+		if (!*res){
+			perror("[1] nvmm memory allocation failed\n");
+			return -1;
+		}
+
+		return 0;
+	}
+
+	ret = pmemobj_alloc(pop, &_addr, (len + align-1), 0, NULL, NULL);
+	if (ret) {
+		perror("[00] nvmm memory allocation failed\n");
+		return -1;
+	}
+
+	mem = (unsigned char*)(pmemobj_direct(_addr));
+	if (!mem){
+		perror("[11] nvmm memory allocation failed\n");
+		return -1;
+	}
+
+
+	header = ((size_t *)mem)[-1];
+	end = mem + (header & -8);
+	footer = ((size_t *)end)[-2];
+	_new = (unsigned char*)((uintptr_t)mem + align-1 & -align);
+
+	if (!(header & 7)) {
+		((size_t *)_new)[-2] = ((size_t *)mem)[-2] + (_new-mem);
+		((size_t *)_new)[-1] = ((size_t *)mem)[-1] - (_new-mem);
+		*res = _new;
+		return 0;
+	}
+
+	((size_t *)mem)[-1] = header&7 | _new-mem;
+	((size_t *)_new)[-2] = footer&7 | _new-mem;
+	((size_t *)_new)[-1] = header&7 | end-_new;
+	((size_t *)end)[-2] = footer&7 | end-_new;
+
+	if (_new != mem) nvm_free(mem);
+	*res = _new;
+	return 0;
+#endif
+}
+
+void nvm_free(void *addr) {
+  PMEMoid _addr;
+
+  uint64_t start = g_stats.path != NULL ? now_ns() : 0;
+  _addr = pmemobj_oid(addr);
+  pmemobj_free(&_addr);
+  if (g_stats.path != NULL) {
+    g_stats.free_ns += now_ns() - start;
+    g_stats.num_frees++;
+  }
+  return;
+}
@@ -0,0 +1,74 @@
+#ifndef _PMDK_H
+#define _PMDK_H
+
+// PM pool helpers of the benchmarks, shared by all of them: the lib and
+// include Makefiles of a benchmark copy this pmdk.c (as pmdk.cpp for the C++
+// ones) and pmdk.h next to its sources instead of its own copy.
+//
+// WITCHER_PMDK_FAST_OPEN=1 prefaults the pool when it is opened (the
+// prefault.at_open ctl of libpmemobj, a MAP_POPULATE of the pool), so the
+// validation of a crash image does not take a page fault per page it
+// touches. WITCHER_PMDK_STATS=<file> writes the time spent opening or
+// creating the pool, and in the allocations, to the file at exit.
+//
+// nvm_alloc_value allocates the values of the ops. Built with
+// NVM_VALUE_SLAB (make VALUE_SLAB=1), the values are carved from slabs of
+// NVM_VALUE_SLAB_SLOTS cache-line slots, each a single pmemobj allocation
+// with a persistent bump index, instead of a pmemobj_alloc per value.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include <libpmemobj.h>
+
+// 1 MiB
+#define MIB_SIZE ((size_t)(1024 * 1024))
+
+// A value slot is a cache line, so a value is flushed alone as it was when it
+// had its own allocation
+#define NVM_VALUE_SLOT_SIZE ((size_t)64)
+#ifndef NVM_VALUE_SLAB_SLOTS
+#define NVM_VALUE_SLAB_SLOTS 1024
+#endif
+
+// Header of a slab, followed by its slots. The slots before next are handed
+// out, next is persisted before a slot is returned.
+struct nvm_value_slab
+{
+  uint64_t num_slots;
+  uint64_t next;
+};
+
+// One pointer to the index, named as each benchmark names it
+typedef struct pmdk_root_obj
+{
+  union {
+    void *ptr;
+    void *cceh_ptr;
+    void *clht_ptr;
+    void *fnf_ptr;
+    void *hash_ptr;
+    void *p_art_ptr;
+    void *p_bwtree_ptr;
+    void *p_mt_ptr;
+    void *woart_ptr;
+    void *wort_ptr;
+  };
+  // the slab values are allocated from, a struct nvm_value_slab
+  PMEMoid value_slab;
+} root_obj;
+
+root_obj *init_nvmm_pool(char *path,
+                         size_t size,
+                         char *layout_name,
+                         int *is_created);
+int destroy_nvmm_pool();
+void *nvm_alloc(size_t size);
+void *nvm_alloc_value(size_t size);
+int nvm_aligned_alloc(void **res, size_t align, size_t len);
+void nvm_free(void *addr);
+
+#endif /* pmdk.h*/
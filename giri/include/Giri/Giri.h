@@ -16,6 +16,7 @@
 
 #include "Giri/TraceFile.h"
 #include "Utility/BasicBlockNumbering.h"
+#include "Utility/ExecForcers.h"
 #include "Utility/LoadStoreNumbering.h"
 #include "Utility/PostDominanceFrontier.h"
 
@@ -104,8 +105,9 @@ public:
   bool visitSpecialCall(CallInst &CI);
   bool visitPmemCall(CallInst &CI, std::string name);
 
-  /// \param CI - The inline asm instruction which may call flush or fence.
-  /// \return true if this call does flush or fence, otherwise false.
+  /// \param CI - The inline asm instruction which may flush, fence or store
+  /// non-temporally.
+  /// \return true if this call does flush, fence or store, otherwise false.
   bool visitInlineAsm(CallInst &CI);
 
 private:
@@ -149,6 +151,7 @@ private:
   FunctionCallee RecordFlush;
   FunctionCallee RecordFlushWrapper;
   FunctionCallee RecordFence;
+  FunctionCallee RecordPmemFlags;
   FunctionCallee RecordReturn;
   FunctionCallee RecordExtCall;
   FunctionCallee RecordExtFun;
@@ -220,8 +223,7 @@ public:
     AU.addRequiredTransitive<QueryBasicBlockNumbers>();
     AU.addRequiredTransitive<QueryLoadStoreNumbers>();
 
-    AU.addRequired<PostDominatorTreeWrapperPass>();
-    AU.addRequired<PostDominanceFrontier>();
+    AU.addRequired<QueryExecForcers>();
 
     // This pass is an analysis pass, so it does not modify anything
     AU.setPreservesAll();
@@ -283,16 +285,16 @@ private:
   ///
   /// \param[in] BB - The basic block for which the caller wants to know which
   ///                 basic blocks can force its execution.
-  /// \param[out] bbNums - A set of basic block identifiers that can force
-  ///                      execution of the specified basic block. Note that
-  ///                      identifiers are *added* to the set.
+  /// \param[out] bbNums - The sorted basic block identifiers that can force
+  ///                      execution of the specified basic block, as stored
+  ///                      in the module-wide exec forcer tables.
   /// \return true  - The specified basic block will be executed at least once
   ///                 every time the function is called.
   /// \return false - The specified basic block may not be executed when the
   ///                 function is called (i.e., the specified basic block is
   ///                 control-dependent on the entry block if the entry block
   ///                 is in bbNums).
-  bool findExecForcers(BasicBlock *BB, std::set<unsigned> &bbNums);
+  bool findExecForcers(BasicBlock *BB, ArrayRef<unsigned> &bbNums);
 
   void initDataFlowFitler(void);
 
@@ -301,13 +303,10 @@ private:
   /// Trace file object (used for querying the trace)
   TraceFile *Trace;
 
-  /// Cache of basic blocks that force execution of other basic blocks
-  std::map<BasicBlock *, std::vector<BasicBlock *> > ForceExecCache;
-  std::map<BasicBlock *, bool> ForceAtLeastOnceCache;
-
   /// Passes used by this pass
   const QueryBasicBlockNumbers *bbNumPass;
   const QueryLoadStoreNumbers *lsNumPass;
+  const QueryExecForcers *execForcerPass;
 };
 
 } // END namespace giri
@@ -18,6 +18,7 @@
 #include "Utility/BasicBlockNumbering.h"
 #include "Utility/LoadStoreNumbering.h"
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/IR/Value.h"
@@ -29,6 +30,8 @@
 #include <string>
 #include <unordered_set>
 #include <list>
+#include <map>
+#include <vector>
 
 using namespace llvm;
 using namespace dg;
@@ -209,6 +212,29 @@ private:
 typedef Range IndexRange;
 typedef Range AddrRange;
 
+/// A view of one TX inside the full trace: the entries [offset, offset +
+/// length) of the trace file that belong to thread tid (0 means all threads).
+/// Views are written by the trace splitters in place of per-TX trace copies.
+/// The entries of the other threads are dropped when the view is opened, so
+/// a TraceFile of a view has the entries of the split trace it replaces.
+class TraceView {
+public:
+  TraceView() : offset(0), length(0), tid(0) { }
+  TraceView(unsigned long offset, unsigned long length, pthread_t tid) :
+    offset(offset), length(length), tid(tid) { }
+
+  bool isWholeTrace() const { return length == 0; }
+
+  unsigned long getOffset() const { return offset; }
+  unsigned long getLength() const { return length; }
+  pthread_t getTid() const { return tid; }
+
+private:
+  unsigned long offset;
+  unsigned long length;
+  pthread_t tid;
+};
+
 /// This class abstracts away searches through the trace file.
 class TraceFile {
 protected:
@@ -225,10 +251,13 @@ public:
   /// \param[in] Filename - The name of the trace file.
   /// \param[in] bbNums   - A pointer to the analysis pass that numbers basic blocks.
   /// \param[in] lsNums   - A pointer to the analysis pass that numbers loads and stores.
+  /// \param[in] view     - The TX view to open. Only the pages of the view are
+  ///                       mapped, and index 0 is the first entry of the view.
   TraceFile(std::string Filename,
             const QueryBasicBlockNumbers *bbNumPass,
             const QueryLoadStoreNumbers *lsNumPass,
-            bool init_tx = true);
+            bool init_tx = true,
+            TraceView view = TraceView());
 
   /// Given an LLVM instruction, return a DynValue object that describes
   /// the last dynamic execution of the instruction within the trace.
@@ -282,8 +311,11 @@ public:
   /// identifiers that can force its execution, search back in the trace for a
   /// dynamic basic block execution that forced the specified dynamic basic
   /// block to execute.
+  ///
+  /// The search does not scan the trace: the most recent execution of each
+  /// forcer before the basic block is looked up in the BB occurrence index.
   DynBasicBlock getExecForcer(DynBasicBlock,
-                              const std::set<unsigned> &bbnums);
+                              ArrayRef<unsigned> bbnums);
 
   /// Normalize a dynamic basic block. This means that we search for its entry
   /// within the dynamic trace and update its index.
@@ -321,6 +353,8 @@ private:
 
   void buildTraceFunAddrMap();
 
+  void buildOccurrenceIndex();
+
   void initTXSegment();
 
   //===--------------------------------------------------------------------===//
@@ -348,6 +382,17 @@ private:
                                      const unsigned id,
                                      const unsigned nestedID);
 
+  /// Same as findPreviousID() for BB records, but answered from the BB
+  /// occurrence index instead of scanning the trace.
+  unsigned long findPreviousOccurrence(Function *fun,
+                                       unsigned long start_index,
+                                       pthread_t tid,
+                                       ArrayRef<unsigned> ids);
+
+  /// Call nesting depth of the function at funAddr in thread tid right after
+  /// the trace entry at index.
+  long getCallDepth(uintptr_t funAddr, pthread_t tid, unsigned long index);
+
   unsigned long findNextNestedID(unsigned long start_index,
                                  RecordType type,
                                  const unsigned id,
@@ -390,6 +435,14 @@ private:
   /// Map from functions to their runtime address in trace
   std::map<Function *,  uintptr_t> traceFunAddrMap;
 
+  /// Trace indices of the BB records of each BB id, in trace order
+  std::vector<std::vector<unsigned long> > bbOccurrences;
+
+  /// Call and return records of each (function address, thread), in trace
+  /// order, paired with the call nesting depth right after the record
+  std::map<std::pair<uintptr_t, pthread_t>,
+           std::vector<std::pair<unsigned long, long> > > callDepths;
+
   /// Array of entries in the trace
   Entry *trace;
 
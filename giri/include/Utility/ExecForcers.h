@@ -0,0 +1,110 @@
+//===- ExecForcers.h - Precomputed execution forcers of BBs -----*- C++ -*-===//
+//
+//                     Giri: Dynamic Slicing in LLVM
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file provides an analysis pass that computes, once for the whole
+// module, which basic blocks can force the execution of every basic block.
+// The result is kept in flat tables indexed by basic block ID and can be
+// serialized next to the bitcode so that later runs over the same module skip
+// the post-dominance analyses entirely.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef DG_EXECFORCERS_H
+#define DG_EXECFORCERS_H
+
+#include "Utility/BasicBlockNumbering.h"
+#include "Utility/PostDominanceFrontier.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace dg {
+
+/// \class This pass is an analysis pass that finds the basic blocks that can
+/// force execution of each basic block of the module.
+///
+/// Note that this is slightly different from control-dependence.  A basic
+/// block can be forced to execute by a basic block on which it is
+/// control-dependent.  However, it can also be forced to execute simply
+/// because its containing function is executed (i.e., it post-dominates the
+/// entry block).
+///
+/// The forcers are stored in CSR form: the forcer IDs of basic block id are
+/// forcers[offsets[id] .. offsets[id + 1]).
+class QueryExecForcers : public ModulePass {
+public:
+  static char ID;
+
+  QueryExecForcers () : ModulePass (ID) {}
+
+  /// Load the tables from the exec forcer file if it matches the module.
+  /// Otherwise, compute them from the post-dominance frontiers and write
+  /// them to the exec forcer file (if one is given).
+  /// @return false since the this is an analysis pass.
+  virtual bool runOnModule (Module & M);
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+    AU.addRequiredTransitive<QueryBasicBlockNumbers>();
+    AU.addRequired<PostDominatorTreeWrapperPass>();
+    AU.addRequired<PostDominanceFrontier>();
+    AU.setPreservesAll();
+  };
+
+  /// Return the IDs of the basic blocks that can force execution of the basic
+  /// block with the specified ID. The IDs are sorted in ascending order.
+  ArrayRef<unsigned> getForcers (unsigned bbID) const {
+    if (bbID + 1 >= offsets.size())
+      return ArrayRef<unsigned>();
+    return ArrayRef<unsigned>(forcers.data() + offsets[bbID],
+                              offsets[bbID + 1] - offsets[bbID]);
+  }
+
+  /// \return true  - The basic block with the specified ID will be executed
+  ///                 at least once every time its function is called.
+  /// \return false - The basic block may not be executed when its function is
+  ///                 called.
+  bool isForcedAtLeastOnce (unsigned bbID) const {
+    return bbID < atLeastOnce.size() && atLeastOnce[bbID];
+  }
+
+private:
+  /// Compute the tables of all the functions in the module.
+  void computeTables(Module &M, unsigned numBBs);
+
+  /// Read the tables from a file written by writeTables().
+  /// \return false if the file does not exist or does not match the module.
+  bool readTables(const std::string &Filename, unsigned numBBs,
+                  uint64_t moduleHash);
+
+  /// Write the tables of the module with the given hash to a file.
+  void writeTables(const std::string &Filename, uint64_t moduleHash);
+
+private:
+  /// Index into forcers for each basic block ID (numBBs + 2 elements)
+  std::vector<unsigned> offsets;
+
+  /// Basic block IDs of the forcers of all basic blocks
+  std::vector<unsigned> forcers;
+
+  /// One bit per basic block ID, set if the block post-dominates the entry
+  /// block of its function
+  BitVector atLeastOnce;
+};
+
+} // END namespace dg
+
+#endif
@@ -0,0 +1,96 @@
+//===- SourceLocations.h - Interned source locations of insts ---*- C++ -*-===//
+//
+//                     Giri: Dynamic Slicing in LLVM
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file provides an analysis pass that formats the source location of
+// every numbered load/store/call instruction once and interns the results, so
+// trace processors can look up the source location of a trace entry by its
+// load/store ID instead of formatting it for every dynamic entry.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef DG_SOURCELOCATIONS_H
+#define DG_SOURCELOCATIONS_H
+
+#include "Utility/LoadStoreNumbering.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace dg {
+
+/// \class This pass is an analysis pass that maps each load/store ID to the ID
+/// of its interned source location string.
+///
+/// Source location 0 is always the empty string, which is also the location
+/// of the IDs that have no instruction.
+class QuerySourceLocations : public ModulePass {
+public:
+  static char ID;
+
+  QuerySourceLocations () : ModulePass (ID) {}
+
+  /// Load the tables from the source location file if it matches the module.
+  /// Otherwise, compute them with SourceLineMappingPass::locateSrcInfo() and
+  /// write them to the source location file (if one is given).
+  /// @return false since the this is an analysis pass.
+  virtual bool runOnModule (Module & M);
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+    AU.addRequiredTransitive<QueryLoadStoreNumbers>();
+    AU.setPreservesAll();
+  };
+
+  /// Return the source location ID of the instruction with the specified
+  /// load/store ID.
+  unsigned getSrcID (unsigned lsID) const {
+    return lsID < srcIDs.size() ? srcIDs[lsID] : 0;
+  }
+
+  /// Return the source location with the specified source location ID.
+  const std::string &getSrc (unsigned srcID) const {
+    return srcs[srcID];
+  }
+
+  /// Return the source location of the instruction with the specified
+  /// load/store ID.
+  const std::string &getSrcByLSID (unsigned lsID) const {
+    return srcs[getSrcID(lsID)];
+  }
+
+  /// Return the number of distinct source locations.
+  unsigned getNumSrcs () const { return srcs.size(); }
+
+private:
+  /// Compute the tables of all the numbered instructions of the module.
+  void computeTables(unsigned numLSIDs);
+
+  /// Read the tables from a file written by writeTables().
+  /// \return false if the file does not exist or does not match the module.
+  bool readTables(const std::string &Filename, unsigned numLSIDs,
+                  uint64_t moduleHash);
+
+  /// Write the tables of the module with the given hash to a file.
+  void writeTables(const std::string &Filename, uint64_t moduleHash);
+
+private:
+  /// Source location ID of each load/store ID (numLSIDs + 1 elements)
+  std::vector<unsigned> srcIDs;
+
+  /// Interned source locations
+  std::vector<std::string> srcs;
+};
+
+} // END namespace dg
+
+#endif
@@ -13,6 +13,9 @@ public:
   /// get the next value (len bytes) and store it into dest
   void getNextValue(unsigned char *dest, uintptr_t len);
 
+  /// get the next value (len bytes) in place, without copying it out
+  const unsigned char *getNextValuePtr(uintptr_t len);
+
   /// skip this value and move forward the currOffset
   void moveCurrOffset(uintptr_t len);
 
@@ -81,6 +84,14 @@ void StoreValueReader::getNextValue(unsigned char *dest, uintptr_t len) {
   currOffset += len;
 }
 
+const unsigned char *StoreValueReader::getNextValuePtr(uintptr_t len) {
+  checkCacheBoundaryAndUpdateCurrOffset(len);
+
+  unsigned char* currAddr = values + currOffset;
+  currOffset += len;
+  return currAddr;
+}
+
 void StoreValueReader::moveCurrOffset(uintptr_t len) {
   checkCacheBoundaryAndUpdateCurrOffset(len);
   currOffset += len;
@@ -21,6 +21,8 @@
 #include "llvm/IR/Module.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/IR/Type.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
 
 #include <string>
 #include <sstream>
@@ -71,6 +73,47 @@ static inline Instruction *skipAllocas (BasicBlock &BB) {
   return BB.getTerminator();
 }
 
+//===----------------------------------------------------------------------===//
+//          Module fingerprint for the precomputed tables
+//===----------------------------------------------------------------------===//
+
+/// FNV-1a hash of the bytes written to the stream, which are not kept.
+class HashingOstream : public raw_ostream {
+  uint64_t Hash = 0xcbf29ce484222325ULL;
+  uint64_t Pos = 0;
+
+  void write_impl(const char *Ptr, size_t Size) override {
+    for (size_t i = 0; i < Size; ++i) {
+      Hash ^= (unsigned char)Ptr[i];
+      Hash *= 0x100000001b3ULL;
+    }
+    Pos += Size;
+  }
+
+  uint64_t current_pos() const override { return Pos; }
+
+public:
+  uint64_t getHash() {
+    flush();
+    return Hash;
+  }
+};
+
+/// Hash of the module, stored in the tables precomputed for it so that the
+/// tables of another module are never reused.  This is the hash of the
+/// bitcode file the module was read from, or of the printed module when it
+/// was not read from a file (e.g. from stdin).
+static inline uint64_t getModuleHash(const Module &M) {
+  HashingOstream OS;
+  ErrorOr<std::unique_ptr<MemoryBuffer> > Buf =
+    MemoryBuffer::getFile(M.getModuleIdentifier());
+  if (Buf)
+    OS << (*Buf)->getBuffer();
+  else
+    M.print(OS, nullptr);
+  return OS.getHash();
+}
+
 //===----------------------------------------------------------------------===//
 //          Simple factory for string constants
 //===----------------------------------------------------------------------===//
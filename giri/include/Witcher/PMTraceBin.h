@@ -0,0 +1,83 @@
+//===- PMTraceBin.h - Binary PM trace format --------------------*- C++ -*-===//
+//
+//                          Witcher
+//
+//===----------------------------------------------------------------------===//
+//
+// This file describes the binary PM trace written by WitcherPMTrace. It holds
+// the same operations as the text PM trace, but the PM addresses are already
+// rebased to the original PM mapping and every store is already split into
+// ATOMIC_WRITE_BYTES chunks, so the replay engines only decode fixed-size
+// records. The replay engines read it with replay/mem/witchertracebin.py and
+// the native tools with Witcher/PMTraceBinReader.h.
+//
+// Layout:
+//   PMTraceBinHeader
+//   PMTraceBinRecord * num_records, each Store record is followed by its
+//                      value bytes (padded to 8 bytes) and then by its
+//                      AtomicStore records
+//   String table at strtab_offset: num_strs * (uint32_t len, char[len])
+//
+// The string table starts with the interned source locations of the module
+// (see QuerySourceLocations), so a record's src is its source location ID.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PMTRACEBIN_H
+#define PMTRACEBIN_H
+
+#include <cstdint>
+
+namespace witcher {
+
+static const uint32_t PMTraceBinMagic = 0x544d5057; // "WPMT"
+static const uint32_t PMTraceBinVersion = 2;
+
+// Keep in sync with ATOMIC_WRITE_BYTES in replay/mem/cachenumbers.py
+static const unsigned AtomicWriteBytes = 8;
+
+/// Type of a binary PM trace record
+enum class PMTraceBinType : uint8_t {
+  Store = 'S',       ///< whole store, address and size of the store
+  AtomicStore = 'W', ///< ATOMIC_WRITE_BYTES chunk of the preceding store
+  Flush = 'H',
+  Fence = 'F',
+  TXStart = 'B',
+  TXEnd = 'E',
+  TXAdd = 'T',
+  TXAlloc = 'A',
+  PMDKCallStart = 'C',
+  PMDKCallEnd = 'R'
+};
+
+struct PMTraceBinHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t atomic_write_bytes;
+  uint32_t num_strs;
+  uint64_t num_records;
+  uint64_t strtab_offset;
+};
+
+/// A fixed-size record. tid is the full pthread_t of the traced thread. The
+/// meaning of aux depends on the type, and it fits 32 bits as size does:
+///   Store         - number of AtomicStore records following the value
+///   AtomicStore   - offset of the chunk in the value of its store
+///   PMDKCall*     - string id of the PMDK function name
+///   others        - 0
+struct PMTraceBinRecord {
+  PMTraceBinType type;
+  uint8_t pad[3];
+  uint32_t src;   ///< string id of the source location
+  uint64_t tid;
+  uint64_t address;
+  uint32_t size;
+  uint32_t aux;
+};
+
+static_assert(sizeof(PMTraceBinHeader) == 32, "Unexpected header size");
+static_assert(sizeof(PMTraceBinRecord) == 32, "Unexpected record size");
+
+}
+
+#endif
@@ -0,0 +1,182 @@
+//===- PMTraceBinReader.h - Binary PM trace reader --------------*- C++ -*-===//
+//
+//                          Witcher
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the reader of the binary PM trace (see
+// Witcher/PMTraceBin.h) shared by the native tools. It maps the trace, checks
+// its header, reads its string table and iterates over its records. The
+// Store records are skipped: each AtomicStore is given its chunk of the value
+// of its store.
+//
+// The records are checked while they are read: a source location or a PMDK
+// function name outside the string table, or an AtomicStore outside its
+// store, stops the iteration as a truncated trace does.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PMTRACEBINREADER_H
+#define PMTRACEBINREADER_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "Witcher/PMTraceBin.h"
+
+namespace witcher {
+
+class PMTraceBinReader {
+  // prefix of the error messages, the tool name for a library
+  std::string Prefix;
+  std::string Path;
+  const char *Buf = nullptr;
+  size_t Size = 0;
+  PMTraceBinHeader Header;
+  std::vector<std::string> Strs;
+
+public:
+  explicit PMTraceBinReader(const char *prefix = "") : Prefix(prefix) {}
+  ~PMTraceBinReader() { close(); }
+
+  PMTraceBinReader(const PMTraceBinReader &) = delete;
+  PMTraceBinReader &operator=(const PMTraceBinReader &) = delete;
+
+  /// Map the binary PM trace at path, check its header and read its string
+  /// table.
+  /// \return false, after printing why, if it is not a binary PM trace.
+  bool open(const char *path) {
+    close();
+    Path = path;
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      fprintf(stderr, "%scannot open the binary trace %s: %s\n",
+              Prefix.c_str(), path, strerror(errno));
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(PMTraceBinHeader)) {
+      fprintf(stderr, "%s%s is not a binary trace\n", Prefix.c_str(), path);
+      ::close(fd);
+      return false;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+      fprintf(stderr, "%scannot map the binary trace %s: %s\n",
+              Prefix.c_str(), path, strerror(errno));
+      return false;
+    }
+    Buf = (const char *)map;
+    Size = st.st_size;
+    madvise(map, Size, MADV_SEQUENTIAL);
+
+    memcpy(&Header, Buf, sizeof(Header));
+    if (Header.magic != PMTraceBinMagic ||
+        Header.version != PMTraceBinVersion ||
+        Header.atomic_write_bytes != AtomicWriteBytes) {
+      fprintf(stderr, "%sunsupported binary trace %s\n", Prefix.c_str(), path);
+      close();
+      return false;
+    }
+
+    size_t offset = Header.strtab_offset;
+    for (uint32_t i = 0; i < Header.num_strs; i++) {
+      uint32_t len;
+      if (offset + sizeof(len) > Size) {
+        break;
+      }
+      memcpy(&len, Buf + offset, sizeof(len));
+      offset += sizeof(len);
+      if (offset + len > Size) {
+        break;
+      }
+      Strs.emplace_back(Buf + offset, len);
+      offset += len;
+    }
+    if (Strs.size() != Header.num_strs) {
+      fprintf(stderr, "%struncated string table in %s\n", Prefix.c_str(),
+              path);
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (Buf != nullptr) {
+      munmap((void *)Buf, Size);
+    }
+    Buf = nullptr;
+    Size = 0;
+    Strs.clear();
+  }
+
+  const PMTraceBinHeader &header() const { return Header; }
+
+  /// The string table, indexed by string id
+  const std::vector<std::string> &strs() const { return Strs; }
+
+  /// Call f(record, value) on each record but the Store ones, in order. value
+  /// is the chunk of an AtomicStore, nullptr for the other records.
+  /// \return false, after printing why, if the trace is truncated or a record
+  /// is bad.
+  template <class F> bool forEach(F f) const {
+    size_t offset = sizeof(Header);
+    const char *storeValue = nullptr;
+    uint32_t storeSize = 0;
+    for (uint64_t i = 0; i < Header.num_records; i++) {
+      if (offset + sizeof(PMTraceBinRecord) > Size) {
+        return error("truncated binary trace");
+      }
+      PMTraceBinRecord r;
+      memcpy(&r, Buf + offset, sizeof(r));
+      offset += sizeof(r);
+
+      if (r.type == PMTraceBinType::Store) {
+        storeValue = Buf + offset;
+        storeSize = r.size;
+        offset += (r.size + 7) & ~7UL;
+        if (offset > Size) {
+          return error("truncated binary trace");
+        }
+        continue;
+      }
+      if (r.src >= Strs.size()) {
+        return error("bad source location in the binary trace");
+      }
+      const char *value = nullptr;
+      if (r.type == PMTraceBinType::AtomicStore) {
+        if (storeValue == nullptr || r.size > AtomicWriteBytes ||
+            (uint64_t)r.aux + r.size > storeSize) {
+          return error("bad atomic write in the binary trace");
+        }
+        value = storeValue + r.aux;
+      } else if ((r.type == PMTraceBinType::PMDKCallStart ||
+                  r.type == PMTraceBinType::PMDKCallEnd) &&
+                 r.aux >= Strs.size()) {
+        return error("bad PMDK function in the binary trace");
+      }
+      f(r, value);
+    }
+    return true;
+  }
+
+private:
+  bool error(const char *what) const {
+    fprintf(stderr, "%s%s %s\n", Prefix.c_str(), what, Path.c_str());
+    return false;
+  }
+};
+
+}
+
+#endif
@@ -4,8 +4,10 @@
 #include "Witcher/ProgramDependenceGraph.h"
 #include "Giri/TraceFile.h"
 #include "Utility/BasicBlockNumbering.h"
+#include "Utility/ExecForcers.h"
 #include "Utility/LoadStoreNumbering.h"
 #include "Utility/PostDominanceFrontier.h"
+#include "Utility/SourceLocations.h"
 
 #include "llvm/Pass.h"
 #include "llvm/IR/Dominators.h"
@@ -29,9 +31,7 @@ public:
     AU.addRequiredTransitive<QueryBasicBlockNumbers>();
     AU.addRequiredTransitive<QueryLoadStoreNumbers>();
 
-    // AU.addRequired<PostDominatorTree>();
-    AU.addRequired<PostDominatorTreeWrapperPass>();
-    AU.addRequired<PostDominanceFrontier>();
+    AU.addRequired<QueryExecForcers>();
 
     // This pass is an analysis pass, so it does not modify anything
     AU.setPreservesAll();
@@ -91,16 +91,16 @@ private:
   ///
   /// \param[in] BB - The basic block for which the caller wants to know which
   ///                 basic blocks can force its execution.
-  /// \param[out] bbNums - A set of basic block identifiers that can force
-  ///                      execution of the specified basic block. Note that
-  ///                      identifiers are *added* to the set.
+  /// \param[out] bbNums - The sorted basic block identifiers that can force
+  ///                      execution of the specified basic block, as stored
+  ///                      in the module-wide exec forcer tables.
   /// \return true  - The specified basic block will be executed at least once
   ///                 every time the function is called.
   /// \return false - The specified basic block may not be executed when the
   ///                 function is called (i.e., the specified basic block is
   ///                 control-dependent on the entry block if the entry block
   ///                 is in bbNums).
-  bool findExecForcers(BasicBlock *BB, std::set<unsigned> &bbNums);
+  bool findExecForcers(BasicBlock *BB, ArrayRef<unsigned> &bbNums);
 
 private:
   /// Graph for each TX
@@ -109,13 +109,10 @@ private:
   /// Trace file object (used for querying the trace)
   TraceFile *Trace;
 
-  /// Cache of basic blocks that force execution of other basic blocks
-  std::map<BasicBlock *, std::vector<BasicBlock *> > ForceExecCache;
-  std::map<BasicBlock *, bool> ForceAtLeastOnceCache;
-
   /// Passes used by this pass
   const QueryBasicBlockNumbers *bbNumPass;
   const QueryLoadStoreNumbers *lsNumPass;
+  const QueryExecForcers *execForcerPass;
 };
 
 class WitcherPPDG : public ModulePass {
@@ -130,6 +127,7 @@ public:
   virtual void getAnalysisUsage(AnalysisUsage &AU) const {
     AU.addRequiredTransitive<QueryLoadStoreNumbers>();
     AU.addRequiredTransitive<WitcherPDG>();
+    AU.addRequired<QuerySourceLocations>();
 
     // This pass is an analysis pass, so it does not modify anything
     AU.setPreservesAll();
@@ -184,6 +182,7 @@ private:
 
   /// Passes used by this pass
   const QueryLoadStoreNumbers *lsNumPass;
+  const QuerySourceLocations *srcLocPass;
 };
 
 }
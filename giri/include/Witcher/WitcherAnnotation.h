@@ -1,10 +1,18 @@
 #include <unistd.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
 
+#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include "WitcherOpFile.h"
+
 void witcher_tx_begin() {
   // do nothing
 }
@@ -38,3 +46,779 @@ void witcher_get_memory_layout(char* dest) {
     _exit(1);
   }
 }
+
+// Validation phases timed in the fork server children. The pool open phase
+// includes the recovery phase, which only covers the recovery done
+// explicitly by a main (other recovery happens while opening the pool).
+enum witcher_phase {
+  WITCHER_PHASE_POOL_OPEN,
+  WITCHER_PHASE_RECOVERY,
+  WITCHER_PHASE_SUFFIX,
+  WITCHER_NUM_PHASES
+};
+
+// Phase times in ns, in memory shared by the fork server and its children,
+// NULL if the phases are not timed
+uint64_t *witcher_phase_ns = NULL;
+uint64_t witcher_phase_start_ns[WITCHER_NUM_PHASES];
+
+uint64_t witcher_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void witcher_phase_begin(int phase) {
+  if (witcher_phase_ns != NULL) {
+    witcher_phase_start_ns[phase] = witcher_now_ns();
+  }
+}
+
+void witcher_phase_end(int phase) {
+  if (witcher_phase_ns != NULL) {
+    witcher_phase_ns[phase] += witcher_now_ns() - witcher_phase_start_ns[phase];
+  }
+}
+
+// Index the lines of buf, *offsets is set to a malloc'd array of the offset of
+// each line. A last line without a newline is a line.
+// Return the number of lines.
+int witcher_index_lines(const char *buf, size_t size, size_t **offsets) {
+  int capacity = 1024;
+  int num_lines = 0;
+  *offsets = (size_t *)malloc(capacity * sizeof(size_t));
+  size_t off = 0;
+  while (off < size) {
+    if (num_lines == capacity) {
+      capacity *= 2;
+      *offsets = (size_t *)realloc(*offsets, capacity * sizeof(size_t));
+    }
+    (*offsets)[num_lines++] = off;
+    const char *eol = (const char *)memchr(buf + off, '\n', size - off);
+    off = eol == NULL ? size : eol - buf + 1;
+  }
+  return num_lines;
+}
+
+// Benchmark of the ops run by a main: with WITCHER_BENCH=<report file>, the
+// latency of each op (from the op to the next one) goes to a log-linear
+// histogram, and the throughput and latency percentiles are written to the
+// report file when the ops end. The first WITCHER_BENCH_SKIP ops (the load
+// phase) are not timed. The ops run on threads (see witcher_mt_run) have a
+// histogram per thread.
+#define WITCHER_BENCH_SUB_BITS 6
+#define WITCHER_BENCH_BUCKETS ((64 - WITCHER_BENCH_SUB_BITS + 1) << \
+                               WITCHER_BENCH_SUB_BITS)
+
+struct witcher_bench {
+  char *report_path;
+  uint64_t skip;
+  uint64_t num_ops;
+  uint64_t start_ns;
+  uint64_t last_ns;
+  uint64_t max_ns;
+  uint64_t hist[WITCHER_BENCH_BUCKETS];
+};
+
+// NULL when the ops are not benchmarked
+struct witcher_bench *witcher_bench = NULL;
+
+// Buckets below 2^WITCHER_BENCH_SUB_BITS ns are exact, the others split each
+// power of two in 2^WITCHER_BENCH_SUB_BITS buckets (1.6% wide at most)
+int witcher_bench_bucket(uint64_t ns) {
+  if (ns < (1 << WITCHER_BENCH_SUB_BITS)) {
+    return (int)ns;
+  }
+  int shift = 63 - __builtin_clzll(ns) - WITCHER_BENCH_SUB_BITS;
+  return ((shift + 1) << WITCHER_BENCH_SUB_BITS) +
+         (int)((ns >> shift) - (1 << WITCHER_BENCH_SUB_BITS));
+}
+
+// the largest latency of a bucket
+uint64_t witcher_bench_bucket_ns(int bucket) {
+  if (bucket < (1 << WITCHER_BENCH_SUB_BITS)) {
+    return bucket;
+  }
+  int shift = (bucket >> WITCHER_BENCH_SUB_BITS) - 1;
+  uint64_t sub = (bucket & ((1 << WITCHER_BENCH_SUB_BITS) - 1)) +
+                 (1 << WITCHER_BENCH_SUB_BITS);
+  return ((sub + 1) << shift) - 1;
+}
+
+// NULL without WITCHER_BENCH
+struct witcher_bench *witcher_bench_new() {
+  char *report_path = getenv("WITCHER_BENCH");
+  if (report_path == NULL) {
+    return NULL;
+  }
+  struct witcher_bench *bench =
+      (struct witcher_bench *)calloc(1, sizeof *bench);
+  bench->report_path = report_path;
+  char *skip = getenv("WITCHER_BENCH_SKIP");
+  bench->skip = skip == NULL ? 0 : strtoull(skip, NULL, 10);
+  return bench;
+}
+
+void witcher_bench_begin() {
+  if (witcher_bench == NULL) {
+    witcher_bench = witcher_bench_new();
+  }
+}
+
+// called before the op index runs, and with the number of ops after the last
+void witcher_bench_op(struct witcher_bench *bench, uint64_t index) {
+  uint64_t now = witcher_now_ns();
+  if (index == bench->skip) {
+    bench->start_ns = now;
+  } else if (index > bench->skip) {
+    uint64_t ns = now - bench->last_ns;
+    bench->hist[witcher_bench_bucket(ns)]++;
+    bench->num_ops++;
+    if (ns > bench->max_ns) {
+      bench->max_ns = ns;
+    }
+  }
+  bench->last_ns = now;
+}
+
+uint64_t witcher_bench_percentile(struct witcher_bench *bench,
+                                  double percentile) {
+  uint64_t rank = (uint64_t)(percentile / 100 * bench->num_ops);
+  uint64_t count = 0;
+  for (int i = 0; i < WITCHER_BENCH_BUCKETS; i++) {
+    count += bench->hist[i];
+    if (count > rank) {
+      return witcher_bench_bucket_ns(i);
+    }
+  }
+  return bench->max_ns;
+}
+
+void witcher_bench_print(FILE *report, struct witcher_bench *bench) {
+  double seconds = bench->num_ops == 0 ? 0 :
+                   (bench->last_ns - bench->start_ns) / 1e9;
+  fprintf(report, "ops: %lu\n", (unsigned long)bench->num_ops);
+  fprintf(report, "time: %.6f s\n", seconds);
+  fprintf(report, "throughput: %.1f ops/s\n",
+          seconds > 0 ? bench->num_ops / seconds : 0.0);
+  if (bench->num_ops > 0) {
+    fprintf(report, "latency p50: %lu ns\n",
+            (unsigned long)witcher_bench_percentile(bench, 50));
+    fprintf(report, "latency p99: %lu ns\n",
+            (unsigned long)witcher_bench_percentile(bench, 99));
+    fprintf(report, "latency p999: %lu ns\n",
+            (unsigned long)witcher_bench_percentile(bench, 99.9));
+    fprintf(report, "latency max: %lu ns\n", (unsigned long)bench->max_ns);
+  }
+}
+
+void witcher_bench_end() {
+  struct witcher_bench *bench = witcher_bench;
+  FILE *report = fopen(bench->report_path, "w");
+  if (report == NULL) {
+    perror("fopen bench report failed");
+  } else {
+    witcher_bench_print(report, bench);
+    fclose(report);
+  }
+  free(bench);
+  witcher_bench = NULL;
+}
+
+// Iterator over the ops of an op file from the op start_index, skipping the
+// op skip_index. In a fork server child, the ops loaded by the server are
+// read instead of opening the op file again.
+struct witcher_op_iter {
+  struct witcher_ops own_ops;
+  struct witcher_ops *ops;
+  uint64_t index;
+  int skip_index;
+  uint64_t num_ops; // ops returned
+  char *fields[WITCHER_OP_MAX_FIELDS];
+};
+
+void witcher_op_iter_open(struct witcher_op_iter *it, char *op_file_path,
+                          int start_index, int skip_index) {
+  memset(it, 0, sizeof *it);
+  it->ops = witcher_ops_find(op_file_path, &it->own_ops);
+  it->index = start_index > 0 ? start_index : 0;
+  it->skip_index = skip_index;
+  witcher_bench_begin();
+}
+
+// Return the fields of the next op, as strtok(line, ";") splits its line,
+// NULL after the last op
+char **witcher_op_iter_next(struct witcher_op_iter *it) {
+  if (it->ops != NULL && it->index == (uint64_t)it->skip_index) {
+    it->index++;
+  }
+  if (it->ops == NULL || it->index >= it->ops->header->num_ops) {
+    return NULL;
+  }
+  if (witcher_bench != NULL) {
+    witcher_bench_op(witcher_bench, it->num_ops);
+  }
+  it->num_ops++;
+  return witcher_ops_get(it->ops, it->index++, it->fields);
+}
+
+void witcher_op_iter_close(struct witcher_op_iter *it) {
+  if (witcher_bench != NULL) {
+    witcher_bench_op(witcher_bench, it->num_ops);
+    witcher_bench_end();
+  }
+  if (it->ops == &it->own_ops) {
+    witcher_ops_close(&it->own_ops);
+  }
+  it->ops = NULL;
+}
+
+// Oracles loaded by the fork server. The output of a child is compared with
+// them while it is written (see witcher_check_output), and the suffix stops
+// as soon as it matches neither, as the crash state is inconsistent whatever
+// the rest of the output is.
+enum witcher_oracle_kind {
+  WITCHER_ORACLE_FULL,
+  WITCHER_ORACLE_SKIP,
+  WITCHER_NUM_ORACLES
+};
+
+// Result of comparing the output with an oracle: the index of the first
+// oracle line it does not match, or one of these
+#define WITCHER_ORACLE_MATCH -1
+#define WITCHER_ORACLE_LENGTH -2
+#define WITCHER_ORACLE_NONE -3
+
+struct witcher_oracle {
+  char *buf;
+  size_t size;
+  size_t *line_offsets;
+  int num_lines;
+  // oracle line compared with the first output line
+  int start;
+};
+
+struct witcher_oracle witcher_oracles[WITCHER_NUM_ORACLES];
+int witcher_oracles_loaded = 0;
+
+// Comparison results, in memory shared by the fork server and its children
+int64_t *witcher_oracle_res = NULL;
+
+// The output file of a child compared with the oracles, the bytes of it
+// compared so far, the complete lines among them, and, for each oracle, the
+// offset of the next oracle byte and the first mismatching line
+FILE *witcher_output_file = NULL;
+off_t witcher_output_checked = 0;
+int64_t witcher_output_lines = 0;
+int witcher_output_partial = 0;
+size_t witcher_output_oracle_pos[WITCHER_NUM_ORACLES];
+int64_t witcher_output_mismatch[WITCHER_NUM_ORACLES];
+
+// Map an oracle file and index its lines, an empty oracle has no lines
+int witcher_load_oracle(struct witcher_oracle *oracle, char *path, int start) {
+  if (oracle->buf != NULL) {
+    munmap(oracle->buf, oracle->size);
+  }
+  free(oracle->line_offsets);
+  memset(oracle, 0, sizeof(*oracle));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("open oracle failed");
+    return -1;
+  }
+  off_t size = lseek(fd, 0, SEEK_END);
+  if (size > 0) {
+    void *buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buf == MAP_FAILED) {
+      perror("mmap oracle failed");
+      close(fd);
+      return -1;
+    }
+    oracle->buf = (char *)buf;
+    oracle->size = size;
+  }
+  close(fd);
+  oracle->num_lines = witcher_index_lines(oracle->buf, oracle->size,
+                                          &oracle->line_offsets);
+  oracle->start = start;
+  return oracle->num_lines;
+}
+
+// Open the output file of a run. In a fork server child with oracles, the
+// output is also compared with them.
+FILE *witcher_open_output_file(char *output_file_path) {
+  if (!witcher_oracles_loaded || witcher_oracle_res == NULL) {
+    return fopen(output_file_path, "w");
+  }
+
+  // read back by witcher_check_output
+  witcher_output_file = fopen(output_file_path, "w+");
+  witcher_output_checked = 0;
+  witcher_output_lines = 0;
+  witcher_output_partial = 0;
+  for (int i = 0; i < WITCHER_NUM_ORACLES; i++) {
+    struct witcher_oracle *oracle = &witcher_oracles[i];
+    witcher_output_oracle_pos[i] = oracle->start < oracle->num_lines ?
+                                   oracle->line_offsets[oracle->start] :
+                                   oracle->size;
+    witcher_output_mismatch[i] = WITCHER_ORACLE_MATCH;
+  }
+  return witcher_output_file;
+}
+
+void witcher_compare_output(const char *data, size_t size) {
+  for (size_t k = 0; k < size; k++) {
+    for (int i = 0; i < WITCHER_NUM_ORACLES; i++) {
+      struct witcher_oracle *oracle = &witcher_oracles[i];
+      size_t *pos = &witcher_output_oracle_pos[i];
+      if (witcher_output_mismatch[i] != WITCHER_ORACLE_MATCH) {
+        continue;
+      }
+      if (*pos >= oracle->size || oracle->buf[*pos] != data[k]) {
+        witcher_output_mismatch[i] = oracle->start + witcher_output_lines;
+      } else {
+        (*pos)++;
+      }
+    }
+    if (data[k] == '\n') {
+      witcher_output_lines++;
+    }
+  }
+  if (size > 0) {
+    witcher_output_partial = data[size - 1] != '\n';
+  }
+}
+
+// Compare the output written since the last comparison with the oracles
+void witcher_compare_new_output(FILE *output_file) {
+  fflush(output_file);
+  char chunk[4096];
+  ssize_t n;
+  while ((n = pread(fileno(output_file), chunk, sizeof chunk,
+                    witcher_output_checked)) > 0) {
+    witcher_compare_output(chunk, n);
+    witcher_output_checked += n;
+  }
+}
+
+// Compare the output written since the last check with the oracles, called
+// after each op. If the output already matches neither oracle, the run stops
+// here with the mismatching lines as results.
+void witcher_check_output(FILE *output_file) {
+  if (output_file != witcher_output_file || output_file == NULL) {
+    return;
+  }
+
+  witcher_compare_new_output(output_file);
+  for (int i = 0; i < WITCHER_NUM_ORACLES; i++) {
+    if (witcher_output_mismatch[i] == WITCHER_ORACLE_MATCH) {
+      return;
+    }
+  }
+  for (int i = 0; i < WITCHER_NUM_ORACLES; i++) {
+    witcher_oracle_res[i] = witcher_output_mismatch[i];
+  }
+  fclose(output_file);
+  witcher_phase_end(WITCHER_PHASE_SUFFIX);
+  exit(0);
+}
+
+// Close the output file of a run. The results of a complete output are the
+// ones of compare_to_oracle_from_index in witchercrashvalidator.py: outputs
+// with a different number of lines than the oracle do not match as a whole.
+void witcher_close_output_file(FILE *output_file) {
+  if (output_file == witcher_output_file && output_file != NULL) {
+    witcher_compare_new_output(output_file);
+    int64_t output_lines = witcher_output_lines + witcher_output_partial;
+    for (int i = 0; i < WITCHER_NUM_ORACLES; i++) {
+      struct witcher_oracle *oracle = &witcher_oracles[i];
+      int64_t oracle_lines = oracle->num_lines - oracle->start;
+      if (oracle_lines < 0) {
+        oracle_lines = 0;
+      }
+      if (output_lines != oracle_lines) {
+        witcher_oracle_res[i] = WITCHER_ORACLE_LENGTH;
+      } else if (witcher_output_mismatch[i] != WITCHER_ORACLE_MATCH) {
+        witcher_oracle_res[i] = witcher_output_mismatch[i];
+      } else if (witcher_output_oracle_pos[i] != oracle->size) {
+        // the last output line is a prefix of the last oracle line
+        witcher_oracle_res[i] = oracle->start + witcher_output_lines;
+      } else {
+        witcher_oracle_res[i] = WITCHER_ORACLE_MATCH;
+      }
+    }
+    witcher_output_file = NULL;
+  }
+  fclose(output_file);
+}
+
+// Multi-threaded driver of the ops. With WITCHER_THREADS=<n> (n > 1), a main
+// runs its ops with witcher_mt_run on n threads instead of one: the ops
+// before the op WITCHER_THREAD_START run on the first thread alone, then the
+// k-th op after it runs on the thread k % n, so each thread gets the same op
+// stream on every run. Each op is run by its thread, the witcher_tx_begin/end
+// markers of an op are in the trace of that thread.
+//
+// The threads run their ops concurrently, unless WITCHER_THREAD_SEED is set:
+// the ops then run one at a time, in an interleaving of the threads drawn from
+// the seed, the same on every run. The output of a seeded run is the output of
+// the ops run in that order by one thread, and its traced run is reproducible.
+struct witcher_mt;
+
+struct witcher_mt_thread {
+  struct witcher_mt *mt;
+  int id;
+  void *arg; // the arg of witcher_mt_run
+  FILE *output_file;
+  uint64_t next; // the next op of the thread in witcher_mt.indexes
+  int has_turn; // the other threads wait for the op returned to the thread
+  int concurrent; // the thread runs its ops without waiting for the others
+  uint64_t num_ops; // ops returned
+  char *fields[WITCHER_OP_MAX_FIELDS];
+  struct witcher_bench *bench; // NULL when the ops are not benchmarked
+  pthread_t pthread;
+};
+
+struct witcher_mt {
+  struct witcher_ops own_ops;
+  struct witcher_ops *ops;
+  uint64_t *indexes; // op file indexes of the ops to run
+  uint64_t num_ops;
+  uint64_t num_serial; // ops run by the first thread alone
+  int num_threads;
+  struct witcher_mt_thread *threads;
+  // the thread running each op after the serial ones in a seeded run, NULL
+  // in a concurrent one
+  int *order;
+  uint64_t turn; // ops run, the next op to run in a seeded run
+  int serial_done;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+// WITCHER_THREADS, 1 without it
+int witcher_mt_threads() {
+  char *threads = getenv("WITCHER_THREADS");
+  int num_threads = threads == NULL ? 1 : atoi(threads);
+  return num_threads > 1 ? num_threads : 1;
+}
+
+uint64_t witcher_mt_rand(uint64_t *state) {
+  // splitmix64
+  uint64_t x = (*state += 0x9e3779b97f4a7c15ULL);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Draw the interleaving of the ops after the serial ones: each op goes to a
+// thread picked with a probability proportional to the ops it has left, so
+// all the interleavings are equally likely
+void witcher_mt_draw_order(struct witcher_mt *mt, uint64_t seed) {
+  uint64_t num_parallel = mt->num_ops - mt->num_serial;
+  uint64_t *left = (uint64_t *)calloc(mt->num_threads, sizeof(uint64_t));
+  for (int t = 0; t < mt->num_threads; t++) {
+    left[t] = (num_parallel + mt->num_threads - 1 - t) / mt->num_threads;
+  }
+  mt->order = (int *)malloc((num_parallel + 1) * sizeof(int));
+  for (uint64_t k = 0; k < num_parallel; k++) {
+    uint64_t r = witcher_mt_rand(&seed) % (num_parallel - k);
+    int t = 0;
+    while (r >= left[t]) {
+      r -= left[t++];
+    }
+    left[t]--;
+    mt->order[k] = t;
+  }
+  free(left);
+}
+
+// the op index of witcher_mt.indexes, as the next op of the thread
+char **witcher_mt_op(struct witcher_mt_thread *thread, uint64_t index) {
+  if (thread->bench != NULL) {
+    witcher_bench_op(thread->bench, thread->num_ops);
+  }
+  thread->num_ops++;
+  return witcher_ops_get(thread->mt->ops, thread->mt->indexes[index],
+                         thread->fields);
+}
+
+// Return the fields of the next op of the thread, NULL after its last op
+char **witcher_mt_next(struct witcher_mt_thread *thread) {
+  struct witcher_mt *mt = thread->mt;
+  int locked = !thread->concurrent;
+
+  if (locked) {
+    pthread_mutex_lock(&mt->lock);
+    if (thread->has_turn) {
+      // the previous op of the thread is done, its output too
+      witcher_check_output(thread->output_file);
+      thread->has_turn = 0;
+      if (mt->serial_done) {
+        mt->turn++;
+      }
+      pthread_cond_broadcast(&mt->cond);
+    }
+    if (thread->id == 0 && !mt->serial_done) {
+      if (thread->num_ops < mt->num_serial) {
+        thread->has_turn = 1;
+        pthread_mutex_unlock(&mt->lock);
+        return witcher_mt_op(thread, thread->num_ops);
+      }
+      mt->serial_done = 1;
+      pthread_cond_broadcast(&mt->cond);
+    }
+    while (!mt->serial_done) {
+      pthread_cond_wait(&mt->cond, &mt->lock);
+    }
+    // a concurrent run takes the lock no more
+    thread->concurrent = mt->order == NULL;
+  }
+
+  if (thread->next >= mt->num_ops) {
+    if (locked) {
+      pthread_mutex_unlock(&mt->lock);
+    }
+    if (thread->bench != NULL) {
+      witcher_bench_op(thread->bench, thread->num_ops);
+    }
+    return NULL;
+  }
+  uint64_t index = thread->next;
+  thread->next += mt->num_threads;
+  if (locked) {
+    // wait for the turn of the thread in a seeded run
+    while (mt->order != NULL && mt->order[mt->turn] != thread->id) {
+      pthread_cond_wait(&mt->cond, &mt->lock);
+    }
+    thread->has_turn = mt->order != NULL;
+    pthread_mutex_unlock(&mt->lock);
+  }
+  return witcher_mt_op(thread, index);
+}
+
+// The bench report of the threads: the ops of all the threads, the time from
+// the first timed op to the end of the last thread, the latencies of all the
+// ops, then the same for each thread
+void witcher_mt_bench_end(struct witcher_mt *mt) {
+  struct witcher_bench *total =
+      (struct witcher_bench *)calloc(1, sizeof *total);
+  for (int t = 0; t < mt->num_threads; t++) {
+    struct witcher_bench *bench = mt->threads[t].bench;
+    if (bench->num_ops == 0) {
+      continue;
+    }
+    if (total->num_ops == 0 || bench->start_ns < total->start_ns) {
+      total->start_ns = bench->start_ns;
+    }
+    if (bench->last_ns > total->last_ns) {
+      total->last_ns = bench->last_ns;
+    }
+    if (bench->max_ns > total->max_ns) {
+      total->max_ns = bench->max_ns;
+    }
+    total->num_ops += bench->num_ops;
+    for (int i = 0; i < WITCHER_BENCH_BUCKETS; i++) {
+      total->hist[i] += bench->hist[i];
+    }
+  }
+
+  FILE *report = fopen(mt->threads[0].bench->report_path, "w");
+  if (report == NULL) {
+    perror("fopen bench report failed");
+  } else {
+    fprintf(report, "threads: %d\n", mt->num_threads);
+    witcher_bench_print(report, total);
+    for (int t = 0; t < mt->num_threads; t++) {
+      fprintf(report, "thread %d\n", t);
+      witcher_bench_print(report, mt->threads[t].bench);
+    }
+    fclose(report);
+  }
+  free(total);
+  for (int t = 0; t < mt->num_threads; t++) {
+    free(mt->threads[t].bench);
+  }
+}
+
+// Run the ops of op_file_path from the op start_index, skipping the op
+// skip_index, on witcher_mt_threads() threads running run_thread. A thread
+// gets its struct witcher_mt_thread, and takes its ops with witcher_mt_next
+// until it returns NULL.
+void witcher_mt_run(char *op_file_path, int start_index, int skip_index,
+                    char *output_file_path, void *(*run_thread)(void *),
+                    void *arg) {
+  struct witcher_mt mt;
+  memset(&mt, 0, sizeof mt);
+  mt.ops = witcher_ops_find(op_file_path, &mt.own_ops);
+  if (mt.ops != NULL) {
+    char *thread_start = getenv("WITCHER_THREAD_START");
+    uint64_t serial_end = thread_start == NULL ? 0 :
+                          strtoull(thread_start, NULL, 10);
+    mt.num_ops = witcher_ops_select(mt.ops, start_index, skip_index,
+                                    serial_end, &mt.indexes, &mt.num_serial);
+  }
+  mt.serial_done = mt.num_serial == 0;
+  mt.num_threads = witcher_mt_threads();
+  pthread_mutex_init(&mt.lock, NULL);
+  pthread_cond_init(&mt.cond, NULL);
+  char *seed = getenv("WITCHER_THREAD_SEED");
+  if (seed != NULL) {
+    witcher_mt_draw_order(&mt, strtoull(seed, NULL, 10));
+  }
+
+  FILE *output_file = witcher_open_output_file(output_file_path);
+  mt.threads = (struct witcher_mt_thread *)calloc(mt.num_threads,
+                                                  sizeof *mt.threads);
+  for (int t = 0; t < mt.num_threads; t++) {
+    struct witcher_mt_thread *thread = &mt.threads[t];
+    thread->mt = &mt;
+    thread->id = t;
+    thread->arg = arg;
+    thread->output_file = output_file;
+    thread->next = mt.num_serial + t;
+    thread->bench = witcher_bench_new();
+    if (thread->bench != NULL) {
+      // only the first thread runs the serial ops
+      thread->bench->skip = t == 0 ? mt.num_serial : 0;
+    }
+  }
+  for (int t = 0; t < mt.num_threads; t++) {
+    pthread_create(&mt.threads[t].pthread, NULL, run_thread, &mt.threads[t]);
+  }
+  for (int t = 0; t < mt.num_threads; t++) {
+    pthread_join(mt.threads[t].pthread, NULL);
+  }
+
+  if (mt.threads[0].bench != NULL) {
+    witcher_mt_bench_end(&mt);
+  }
+  witcher_close_output_file(output_file);
+  free(mt.threads);
+  free(mt.order);
+  free(mt.indexes);
+  pthread_cond_destroy(&mt.cond);
+  pthread_mutex_destroy(&mt.lock);
+  if (mt.ops == &mt.own_ops) {
+    witcher_ops_close(&mt.own_ops);
+  }
+}
+
+#define WITCHER_FORK_SERVER_FLAG "--fork-server"
+#define WITCHER_FORK_SERVER_ORACLES "--oracles"
+#define WITCHER_FORK_SERVER_MAX_ARGS 16
+
+int witcher_is_fork_server(int argc, char *argv[]) {
+  return argc >= 2 && strcmp(argv[1], WITCHER_FORK_SERVER_FLAG) == 0;
+}
+
+// Fork server for validating crash states: main.exe --fork-server [op_file]
+//
+// The server loads the op file once and then reads one request per line from
+// stdin. A request has the same arguments as a normal run:
+//   pm_file pm_size layout op_file start_index skip_index output [mem_layout]
+// For each request, it forks a child that runs witcher_main with the request
+// and writes "<child pid>\n" when the child is forked and
+// "<wait status> <pool open ns> <recovery ns> <suffix ns> <full oracle res>
+// <skip oracle res>\n" when it exits to stdout (see WITCHER_ORACLE_* for the
+// oracle results). The output of the children is discarded. The server exits
+// at the end of stdin.
+//
+// A request "--oracles full full_start skip skip_start" loads the oracles the
+// outputs of the next children are compared with, and writes
+// "<full lines> <skip lines>\n", -1 for an oracle that can't be loaded.
+int witcher_fork_server(int argc, char *argv[],
+                        int (*witcher_main)(int, char *[])) {
+  if (argc >= 3) {
+    witcher_load_op_file(argv[2]);
+  }
+
+  witcher_phase_ns = (uint64_t *)mmap(NULL,
+                                      WITCHER_NUM_PHASES * sizeof(uint64_t),
+                                      PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (witcher_phase_ns == MAP_FAILED) {
+    perror("mmap phase times failed");
+    return 1;
+  }
+  witcher_oracle_res = (int64_t *)mmap(NULL,
+                                       WITCHER_NUM_ORACLES * sizeof(int64_t),
+                                       PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (witcher_oracle_res == MAP_FAILED) {
+    perror("mmap oracle results failed");
+    return 1;
+  }
+
+  // keep stdout for the responses only
+  FILE *response = fdopen(dup(STDOUT_FILENO), "w");
+  int dev_null = open("/dev/null", O_WRONLY);
+  dup2(dev_null, STDOUT_FILENO);
+  close(dev_null);
+
+  char line[4096];
+  while (fgets(line, sizeof line, stdin) != NULL) {
+    char *args[WITCHER_FORK_SERVER_MAX_ARGS + 1];
+    int nargs = 0;
+    args[nargs++] = argv[0];
+    char *p = strtok(line, " \n");
+    while (p != NULL && nargs < WITCHER_FORK_SERVER_MAX_ARGS) {
+      args[nargs++] = p;
+      p = strtok(NULL, " \n");
+    }
+    args[nargs] = NULL;
+    if (nargs == 1) {
+      continue;
+    }
+
+    if (strcmp(args[1], WITCHER_FORK_SERVER_ORACLES) == 0) {
+      int full_lines = -1;
+      int skip_lines = -1;
+      if (nargs == 6) {
+        full_lines = witcher_load_oracle(&witcher_oracles[WITCHER_ORACLE_FULL],
+                                         args[2], atoi(args[3]));
+        skip_lines = witcher_load_oracle(&witcher_oracles[WITCHER_ORACLE_SKIP],
+                                         args[4], atoi(args[5]));
+      }
+      witcher_oracles_loaded = full_lines >= 0 && skip_lines >= 0;
+      fprintf(response, "%d %d\n", full_lines, skip_lines);
+      fflush(response);
+      continue;
+    }
+
+    memset(witcher_phase_ns, 0, WITCHER_NUM_PHASES * sizeof(uint64_t));
+    for (int i = 0; i < WITCHER_NUM_ORACLES; i++) {
+      witcher_oracle_res[i] = WITCHER_ORACLE_NONE;
+    }
+    pid_t c_pid = fork();
+    if (c_pid == 0) {
+      /* CHILD */
+      fclose(response);
+      exit(witcher_main(nargs, args));
+    } else if (c_pid < 0) {
+      perror("fork failed");
+      return 1;
+    }
+
+    /* PARENT */
+    fprintf(response, "%d\n", c_pid);
+    fflush(response);
+
+    int status;
+    if (waitpid(c_pid, &status, 0) < 0) {
+      perror("waitpid");
+      return 1;
+    }
+    fprintf(response, "%d %lu %lu %lu %ld %ld\n", status,
+            (unsigned long)witcher_phase_ns[WITCHER_PHASE_POOL_OPEN],
+            (unsigned long)witcher_phase_ns[WITCHER_PHASE_RECOVERY],
+            (unsigned long)witcher_phase_ns[WITCHER_PHASE_SUFFIX],
+            (long)witcher_oracle_res[WITCHER_ORACLE_FULL],
+            (long)witcher_oracle_res[WITCHER_ORACLE_SKIP]);
+    fflush(response);
+  }
+
+  fclose(response);
+  return 0;
+}
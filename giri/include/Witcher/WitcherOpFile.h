@@ -0,0 +1,113 @@
+// Binary op file, read by the benchmark mains instead of the text op file.
+//
+// A text op file has one op per line, its fields separated by ';', and every
+// main used to split each line with fgets and strtok, in the traced run and
+// in every validation run. The binary op file holds the ops already split:
+//
+//   struct witcher_op_file_header
+//   struct witcher_op_record * num_ops, a fixed-width record per op
+//   the NUL-terminated fields of all the ops, at strs_offset
+//
+// so the op start_index is a direct seek and a main gets the fields of an op
+// without decoding it. The fields are the ones strtok(line, ";") returns on
+// the line read by fgets, the newline included, so the mains see the same
+// fields as before.
+//
+// The binary op file of op_file.txt is op_file.txt.bin, written by
+// giri/build-llvm9/opconv. Without it, the text op file is converted in
+// memory when it is opened.
+
+#ifndef WITCHER_OP_FILE_H
+#define WITCHER_OP_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WITCHER_OP_FILE_MAGIC 0x504f5057 // "WPOP"
+#define WITCHER_OP_FILE_VERSION 1
+#define WITCHER_OP_FILE_SUFFIX ".bin"
+#define WITCHER_OP_MAX_FIELDS 4
+
+struct witcher_op_file_header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t num_ops;
+  uint64_t strs_offset;
+  uint64_t size;
+};
+
+struct witcher_op_record {
+  char opcode; // first char of the first field, 0 for an op without fields
+  uint8_t num_fields;
+  uint16_t pad;
+  uint32_t fields[WITCHER_OP_MAX_FIELDS]; // offsets from strs_offset
+};
+
+// An opened op file. The image is either mapped from the binary op file or
+// converted in memory from the text one.
+struct witcher_ops {
+  char *path;
+  char *image;
+  size_t image_size;
+  int mapped;
+  struct witcher_op_file_header *header;
+  struct witcher_op_record *records;
+  char *strs;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The functions below are in giri/runtime/Witcher/WitcherOpFile.cpp, built
+// without the tracing instrumentation: a traced main does not trace the
+// decoding of its op file.
+
+// Convert the text op file in buf to a binary op file image, *image is set to
+// a malloc'd buffer. Return the size of the image.
+size_t witcher_ops_convert(const char *buf, size_t size, char **image);
+
+// Map the binary op file of op_file_path if it is there and not older than
+// the text one. Return 0 on success.
+int witcher_ops_map(struct witcher_ops *ops, const char *op_file_path);
+
+// Open the ops of op_file_path. Return 0 on success.
+int witcher_ops_open(struct witcher_ops *ops, const char *op_file_path);
+
+void witcher_ops_close(struct witcher_ops *ops);
+
+// Write the binary op file image of ops to bin_path. Return 0 on success.
+int witcher_ops_write(struct witcher_ops *ops, const char *bin_path);
+
+// Open the ops of op_file_path in the fork server, for witcher_ops_find in
+// its children
+void witcher_load_op_file(const char *op_file_path);
+
+// The ops loaded by the fork server if they are the ones of op_file_path,
+// else own_ops opened. NULL if the op file cannot be opened.
+struct witcher_ops *witcher_ops_find(const char *op_file_path,
+                                     struct witcher_ops *own_ops);
+
+// Set *indexes to a malloc'd array of the indexes of the ops from the op
+// start_index, skipping the op skip_index, and *num_serial to the number of
+// them before the op serial_end. Return the number of indexes.
+uint64_t witcher_ops_select(struct witcher_ops *ops, int start_index,
+                            int skip_index, uint64_t serial_end,
+                            uint64_t **indexes, uint64_t *num_serial);
+
+#ifdef __cplusplus
+}
+#endif
+
+// Set fields to the fields of the op index, NULL after the last one, and
+// return fields
+static inline char **witcher_ops_get(struct witcher_ops *ops, uint64_t index,
+                                     char *fields[WITCHER_OP_MAX_FIELDS]) {
+  struct witcher_op_record *record = &ops->records[index];
+  for (int i = 0; i < WITCHER_OP_MAX_FIELDS; i++) {
+    fields[i] = i < record->num_fields ? ops->strs + record->fields[i] : NULL;
+  }
+  return fields;
+}
+
+#endif
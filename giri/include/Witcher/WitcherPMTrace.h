@@ -2,9 +2,14 @@
 #define WITCHERPMTRACE_H
 
 #include "Giri/TraceFile.h"
+#include "Utility/SourceLocations.h"
 #include "Utility/StoreValueReader.h"
+#include "Witcher/PMTraceBin.h"
 
 #include <fstream>
+#include <map>
+#include <utility>
+#include <vector>
 
 namespace witcher {
 
@@ -18,6 +23,7 @@ public:
 
   virtual void getAnalysisUsage(AnalysisUsage &AU) const {
     AU.addRequiredTransitive<QueryLoadStoreNumbers>();
+    AU.addRequired<QuerySourceLocations>();
 
     // This pass is an analysis pass, so it does not modify anything
     AU.setPreservesAll();
@@ -29,6 +35,8 @@ private:
   void cleanup();
 
   void parseExtTracingFunc();
+  void writeSplitTraces();
+  void writeSplitTrace(unsigned tx_index);
   void processCallEntry(Entry entry);
   void processRetEntry(Entry entry);
   void processStoreEntry(Entry entry);
@@ -39,13 +47,40 @@ private:
   void processMmapEntry(Entry entry);
   bool is_pm_addr(uintptr_t addr);
 
+  uint32_t getBinStrId(const std::string &str);
+  void writeBinRecord(PMTraceBinType type, uint64_t tid, uint32_t src,
+                      uint32_t size = 0, uint64_t address = 0,
+                      uint32_t aux = 0);
+  void writeBinStore(uint64_t tid, uintptr_t addr, uintptr_t len,
+                     const unsigned char *val, uint32_t src);
+  void writeBinTail();
+
 private:
   // A file descriptor for trace file
   int fd_trace = 0;
+  // The whole trace, mmaped or read in trace_buf
+  Entry* trace = nullptr;
+  bool trace_mapped = false;
+  std::vector<Entry> trace_buf;
+  // Number of entries in the trace
+  unsigned long trace_entries = 0;
+  // Index of the entry being processed
+  unsigned long curr_index = 0;
+  // Index of the first entry of the current TX
+  unsigned long tx_begin_index = 0;
+  // Entry ranges [begin, end) of the TXs, in program order
+  std::vector<std::pair<unsigned long, unsigned long>> tx_ranges;
   // A file descriptor for store value file
   int fd_store = 0;
   // pmtrace output file stream
   std::ofstream pmtrace_of;
+  // binary pmtrace output file stream
+  std::ofstream pmtrace_bin_of;
+  // Number of records in the binary pmtrace
+  uint64_t bin_num_records = 0;
+  // Strings of the binary pmtrace other than the source locations
+  std::map<std::string, uint32_t> bin_str_ids;
+  std::vector<const std::string *> bin_strs;
   // PM start address
   uintptr_t pm_addr_start = 0;
   uintptr_t pm_addr_start_dup = 0;
@@ -59,6 +94,7 @@ private:
 
   /// Passes used by this pass
   const QueryLoadStoreNumbers *lsNumPass;
+  const QuerySourceLocations *srcLocPass;
 };
 
 }
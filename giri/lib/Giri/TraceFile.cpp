@@ -24,7 +24,9 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/ErrorHandling.h"
 
+#include <algorithm>
 #include <cassert>
+#include <climits>
 #include <vector>
 #include <iostream>
 #include <fcntl.h>
@@ -49,7 +51,8 @@ STATISTIC(NumDynBuggyVal, "Number of possible missing matched dynamic values");
 TraceFile::TraceFile(string Filename,
                      const QueryBasicBlockNumbers *bbNums,
                      const QueryLoadStoreNumbers *lsNums,
-                     bool init_tx) :
+                     bool init_tx,
+                     TraceView view) :
   bbNumPass(bbNums), lsNumPass(lsNums),
   trace(0), totalLoadsTraced(0), lostLoadsTraced(0) {
   // Open the trace file for read-only access.
@@ -60,26 +63,70 @@ TraceFile::TraceFile(string Filename,
   struct stat finfo;
   int ret = fstat(fd, &finfo);
   assert((ret == 0) && "Cannot fstat() file!\n");
-  // Calculate the index of the last record in the trace.
-  maxIndex = finfo.st_size / sizeof(Entry) - 1;
+
+  if (view.isWholeTrace()) {
+    // Calculate the index of the last record in the trace.
+    maxIndex = finfo.st_size / sizeof(Entry) - 1;
+
+    // Note that we map the whole file in the private memory space. If we don't
+    // have enough VM at this time, this will definitely fail.
+    trace = (Entry *)mmap(0,
+                          finfo.st_size,
+                          PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE,
+                          fd,
+                          0);
+    assert((trace != MAP_FAILED) && "Trace mmap() failed!\n");
+  } else {
+    // Map the view plus the entry right after it (the TX end call), which is
+    // overwritten by an END entry like the one closing a split trace. The
+    // mapping is private, so only that page is copied and every other page
+    // stays shared in the page cache with the other jobs of the same trace.
+    off_t start = view.getOffset() * sizeof(Entry);
+    off_t end = (view.getOffset() + view.getLength() + 1) * sizeof(Entry);
+    assert(end <= finfo.st_size && "Trace view is out of the trace!\n");
+    off_t page_size = sysconf(_SC_PAGE_SIZE);
+    off_t map_start = start - start % page_size;
+
+    char *base = (char *)mmap(0,
+                              end - map_start,
+                              PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE,
+                              fd,
+                              map_start);
+    assert((base != MAP_FAILED) && "Trace mmap() failed!\n");
+
+    trace = (Entry *)(base + (start - map_start));
+    maxIndex = view.getLength();
+    if (view.getTid() != 0) {
+      // Keep only the entries of the view thread, in order, as its split
+      // trace did, so that every search sees that thread alone. Only the
+      // pages from the first entry of another thread on are copied.
+      unsigned long kept = 0;
+      for (unsigned long index = 0; index < maxIndex; ++index) {
+        if (trace[index].tid != view.getTid()) {
+          continue;
+        }
+        if (kept != index) {
+          trace[kept] = trace[index];
+        }
+        ++kept;
+      }
+      maxIndex = kept;
+    }
+    trace[maxIndex] = Entry(RecordType::ENType, 0);
+  }
+  close(fd);
+
   // Initialize currIndex using maxindex
   currIndex = maxIndex;
 
-  // Note that we map the whole file in the private memory space. If we don't
-  // have enough VM at this time, this will definitely fail.
-  trace = (Entry *)mmap(0,
-                        finfo.st_size,
-                        PROT_READ | PROT_WRITE,
-                        MAP_PRIVATE,
-                        fd,
-                        0);
-  assert((trace != MAP_FAILED) && "Trace mmap() failed!\n");
-
   // TODO: this may override loads we are interested in, so for now we comment
   // it out.
   // Fixup lost loads.
   // fixupLostLoads();
   buildTraceFunAddrMap();
+  buildOccurrenceIndex();
 
   // we don't need to init the tx for pdg parallel
   if (init_tx) {
@@ -261,18 +308,17 @@ void TraceFile::getSourcesFor(DynValue &DInst, Worklist_t &Worklist) {
 }
 
 DynBasicBlock TraceFile::getExecForcer(DynBasicBlock DBB,
-                                       const set<unsigned> &bbnums) {
+                                       ArrayRef<unsigned> bbnums) {
   // Normalize the dynamic basic block.
   if (!normalize(DBB))
     return DynBasicBlock(nullptr, maxIndex);
 
   // Find the execution of the basic block that forced execution of the
   // specified basic block.
-  unsigned long index = findPreviousID(DBB.BB->getParent(),
-                                       DBB.index - 1,
-                                       RecordType::BBType,
-                                       trace[DBB.index].tid,
-                                       bbnums);
+  unsigned long index = findPreviousOccurrence(DBB.BB->getParent(),
+                                               DBB.index - 1,
+                                               trace[DBB.index].tid,
+                                               bbnums);
 
   if (index == maxIndex) // We did not find the record
     return DynBasicBlock(nullptr, maxIndex);
@@ -475,6 +521,35 @@ void TraceFile::buildTraceFunAddrMap(void) {
   DEBUG(dbgs() << "traceFunAddrMap.size(): " << traceFunAddrMap.size() << "\n");
 }
 
+/// \brief Scan forward through the entire trace once and index the BB records
+/// by BB id, and the call/return records by called function, so that
+/// control-dependence queries do not need to scan the trace backwards.
+void TraceFile::buildOccurrenceIndex(void) {
+  for (unsigned long index = 0; index <= maxIndex; ++index) {
+    const Entry &entry = trace[index];
+    switch (entry.type) {
+      case RecordType::BBType:
+        if (entry.id >= bbOccurrences.size())
+          bbOccurrences.resize(entry.id + 1);
+        bbOccurrences[entry.id].push_back(index);
+        break;
+      case RecordType::CLType:
+      case RecordType::RTType: {
+        std::vector<std::pair<unsigned long, long> > &depths =
+          callDepths[std::make_pair(entry.address, entry.tid)];
+        long depth = depths.empty() ? 0 : depths.back().second;
+        depth += (entry.type == RecordType::CLType) ? 1 : -1;
+        depths.push_back(std::make_pair(index, depth));
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  DEBUG(dbgs() << "bbOccurrences.size(): " << bbOccurrences.size() << "\n");
+}
+
 /// Scan from the beginning to the end of the trace
 /// Mark ranges for TXs
 void TraceFile::initTXSegment(void) {
@@ -649,6 +724,70 @@ unsigned long TraceFile::findPreviousID(Function *fun,
   return findPreviousID(fun, start_index, type, tid, ids);
 }
 
+/// Call nesting depth of the function at funAddr in thread tid right after
+/// the trace entry at index, looked up in the call/return records indexed by
+/// buildOccurrenceIndex().
+long TraceFile::getCallDepth(uintptr_t funAddr,
+                             pthread_t tid,
+                             unsigned long index) {
+  auto it = callDepths.find(std::make_pair(funAddr, tid));
+  if (it == callDepths.end())
+    return 0;
+
+  // Find the last call/return record at or before index.
+  const std::vector<std::pair<unsigned long, long> > &depths = it->second;
+  auto pos = std::upper_bound(depths.begin(), depths.end(),
+                              std::make_pair(index, LONG_MAX));
+  if (pos == depths.begin())
+    return 0;
+  return (--pos)->second;
+}
+
+/// findPreviousID() for BB records skips the executions that belong to a
+/// nested (recursive) invocation of fun: scanning back from start_index, the
+/// nesting level at index is the number of returns minus the number of calls
+/// of fun in (index, start_index], which is zero iff the call depth of fun is
+/// the same at index and at start_index.
+unsigned long TraceFile::findPreviousOccurrence(Function *fun,
+                                                unsigned long start_index,
+                                                pthread_t tid,
+                                                ArrayRef<unsigned> ids) {
+  uintptr_t funAddr;
+  if (traceFunAddrMap.find(fun) != traceFunAddrMap.end())
+     funAddr = traceFunAddrMap[fun];
+  else
+     funAddr = ~0; // Make sure nothing matches in this case.
+
+  long startDepth = getCallDepth(funAddr, tid, start_index);
+
+  bool found = false;
+  unsigned long result = 0;
+  for (unsigned id : ids) {
+    if (id >= bbOccurrences.size())
+      continue;
+
+    // Walk back from the last execution of id at or before start_index until
+    // one is found in the same thread and invocation.  Like findPreviousID(),
+    // the first entry of the trace is never matched.
+    const std::vector<unsigned long> &occurrences = bbOccurrences[id];
+    auto it = std::upper_bound(occurrences.begin(), occurrences.end(),
+                               start_index);
+    while (it != occurrences.begin()) {
+      unsigned long index = *--it;
+      if (index == 0 || (found && index <= result))
+        break;
+      if (trace[index].tid != tid ||
+          getCallDepth(funAddr, tid, index) != startDepth)
+        continue;
+      found = true;
+      result = index;
+      break;
+    }
+  }
+
+  return found ? result : maxIndex;
+}
+
 /// This method is like findPreviousID() but takes recursion into account.
 /// \param start_index - The index before which we should start the search
 ///                      (i.e., we first examine the entry in the log file
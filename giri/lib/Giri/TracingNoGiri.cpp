@@ -25,12 +25,15 @@
 #include "llvm/ADT/Statistic.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/InlineAsm.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
 
 #include <cxxabi.h>
+#include <ctype.h>
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <iostream>
@@ -205,6 +208,13 @@ bool TracingNoGiri::doInitialization(Module & M) {
                                       VoidType,
                                       Int32Type);
 
+  RecordPmemFlags = M.getOrInsertFunction("recordPmemFlags",
+                                          VoidType,
+                                          Int32Type,
+                                          VoidPtrType,
+                                          Int64Type,
+                                          Int32Type);
+
   RecordMmap = M.getOrInsertFunction("recordMmap",
                                      VoidType,
                                      Int32Type,
@@ -393,6 +403,13 @@ void TracingNoGiri::visitStoreInst(StoreInst &SI) {
   std::vector<Value *> args=make_vector<Value *>(StoreID, Pointer, StoreSize, 0);
   CallInst *recStore = CallInst::Create(RecordStore, args, "", &SI);
 
+  // A non-temporal store (e.g. _mm_stream_si64) bypasses the cache: it is
+  // flushed as it is stored, and durable at the next fence
+  if (SI.getMetadata(LLVMContext::MD_nontemporal)) {
+    CallInst::Create(RecordFlushWrapper, args, "", &SI);
+    ++NumFlushes;
+  }
+
   instrumentUnlock(&SI);
   // Insert RecordStore after the instruction so that we can get the value
   SI.moveBefore(recStore);
@@ -463,7 +480,28 @@ bool TracingNoGiri::visitPmemCall(CallInst &CI, std::string name) {
     return true;
   }
 
-  if (name == "pmem_drain") {
+  if (name == "pmem_deep_flush") {
+    // Instrument the code and add RecordFLush
+    instrumentLock(&CI);
+    // Cast the pointer into a void pointer type.
+    Value * Pointer = CI.getArgOperand(0);
+    Pointer = castTo(Pointer, VoidPtrType, Pointer->getName(), &CI);
+    // Get the number of bytes that will be flushed.
+    Value *NumElts = CI.getOperand(1);
+    // Get the ID of the call instruction.
+    Value *CallID = ConstantInt::get(Int32Type, lsNumPass->getID(&CI));
+    // Create the call to the run-time to record the call instruction.
+    std::vector<Value *> args=make_vector<Value *>(CallID, Pointer, NumElts, 0);
+    CallInst *recFlush = CallInst::Create(RecordFlushWrapper, args, "", &CI);
+    instrumentUnlock(&CI);
+
+    CI.moveBefore(recFlush);
+
+    ++NumFlushes;
+    return true;
+  }
+
+  if (name == "pmem_drain" || name == "pmem_deep_drain") {
     // Instrument the code and add RecordFence
     instrumentLock(&CI);
     // Get the ID of the call instruction.
@@ -479,7 +517,8 @@ bool TracingNoGiri::visitPmemCall(CallInst &CI, std::string name) {
     return true;
   }
 
-  if (name == "pmem_persist" || name == "pmem_msync" ) {
+  if (name == "pmem_persist" || name == "pmem_msync" ||
+      name == "pmem_deep_persist") {
     // Instrument the code and add RecordFLush
     instrumentLock(&CI);
     // Cast the pointer into a void pointer type.
@@ -603,6 +642,13 @@ bool TracingNoGiri::visitPmemCall(CallInst &CI, std::string name) {
     args = make_vector(CallID, dstPointer, NumElts, 0);
     CallInst *recStore = CallInst::Create(RecordStore, args, "", &CI);
 
+    // record the flush and the fence asked for by the flags
+    if (CI.getNumArgOperands() == 4) {
+      args = make_vector(CallID, dstPointer, NumElts, CI.getOperand(3), 0);
+      CallInst::Create(RecordPmemFlags, args, "", &CI);
+      ++NumFlushes;
+    }
+
     instrumentUnlock(&CI);
 
     // Insert RecordStore after the instruction so that we can get the value
@@ -691,6 +737,13 @@ bool TracingNoGiri::visitPmemCall(CallInst &CI, std::string name) {
     std::vector<Value *> args = make_vector(CallID, dstPointer, NumElts, 0);
     CallInst *recStore = CallInst::Create(RecordStore, args, "", &CI);
 
+    // record the flush and the fence asked for by the flags
+    if (CI.getNumArgOperands() == 4) {
+      args = make_vector(CallID, dstPointer, NumElts, CI.getOperand(3), 0);
+      CallInst::Create(RecordPmemFlags, args, "", &CI);
+      ++NumFlushes;
+    }
+
     instrumentUnlock(&CI);
 
     // Insert RecordStore after the instruction so that we can get the value
@@ -718,6 +771,72 @@ bool TracingNoGiri::visitSpecialCall(CallInst &CI) {
 
   // Check the name of the function against a list of known special functions.
   std::string name = CalledFunc->getName().str();
+
+  // x86 persistence intrinsics: _mm_clflush, _mm_clflushopt and _mm_clwb
+  if (name == "llvm.x86.sse2.clflush" || name == "llvm.x86.clflushopt" ||
+      name == "llvm.x86.clwb") {
+    instrumentLock(&CI);
+    // Cast the pointer into a void pointer type.
+    Value * Pointer = CI.getArgOperand(0);
+    Pointer = castTo(Pointer, VoidPtrType, Pointer->getName(), &CI);
+    // Get the ID of the call instruction.
+    Value *CallID = ConstantInt::get(Int32Type, lsNumPass->getID(&CI));
+    // Create the call to the run-time to record the call instruction.
+    std::vector<Value *> args=make_vector<Value *>(CallID, Pointer, 0);
+    CallInst *recFlush = CallInst::Create(RecordFlush, args, "", &CI);
+    instrumentUnlock(recFlush);
+
+    CI.moveBefore(recFlush);
+
+    ++NumFlushes;
+    return true;
+  }
+
+  // _mm_mfence and _mm_sfence
+  if (name == "llvm.x86.sse2.mfence" || name == "llvm.x86.sse.sfence") {
+    instrumentLock(&CI);
+    // Get the ID of the call instruction.
+    Value *CallID = ConstantInt::get(Int32Type, lsNumPass->getID(&CI));
+    // Create the call to the run-time to record the call instruction.
+    std::vector<Value *> args = make_vector<Value *>(CallID, 0);
+    CallInst* recFence = CallInst::Create(RecordFence, args, "", &CI);
+    instrumentUnlock(recFence);
+
+    CI.moveBefore(recFence);
+
+    ++NumFences;
+    return true;
+  }
+
+  // The non-temporal stores not lowered to a !nontemporal store:
+  // _mm_stream_pi, _mm_stream_ss and _mm_stream_sd
+  if (name == "llvm.x86.mmx.movnt.dq" || name == "llvm.x86.sse4a.movnt.ss" ||
+      name == "llvm.x86.sse4a.movnt.sd") {
+    instrumentLock(&CI);
+    // Cast the pointer into a void pointer type.
+    Value * Pointer = CI.getArgOperand(0);
+    Pointer = castTo(Pointer, VoidPtrType, Pointer->getName(), &CI);
+    // Get the size of the stored data.
+    uint64_t size = name == "llvm.x86.sse4a.movnt.ss" ? 4 : 8;
+    Value *StoreSize = ConstantInt::get(Int64Type, size);
+    // Get the ID of the call instruction.
+    Value *CallID = ConstantInt::get(Int32Type, lsNumPass->getID(&CI));
+    // record store, and the flush of the cache line it bypasses
+    std::vector<Value *> args =
+                          make_vector<Value *>(CallID, Pointer, StoreSize, 0);
+    CallInst *recStore = CallInst::Create(RecordStore, args, "", &CI);
+    CallInst::Create(RecordFlushWrapper, args, "", &CI);
+
+    instrumentUnlock(&CI);
+
+    // Insert RecordStore after the instruction so that we can get the value
+    CI.moveBefore(recStore);
+
+    ++NumStores;
+    ++NumFlushes;
+    return true;
+  }
+
   if (name.substr(0,12) == "llvm.memset.") {
     instrumentLock(&CI);
 
@@ -997,72 +1116,198 @@ bool TracingNoGiri::visitSpecialCall(CallInst &CI) {
   return false;
 }
 
+// The persistence instructions recognized in inline asm
+enum AsmPersistKind { AsmFlush, AsmFence, AsmNTStore };
+
+struct AsmPersistInst {
+  AsmPersistKind Kind;
+  std::string Mnemonic;
+  // the asm operands ($N) of the instruction, in order
+  std::vector<unsigned> Operands;
+};
+
+// Split an inline asm string into its instructions and keep the ones which
+// flush, fence or store non-temporally.  ".byte 0x66; clflush" is the
+// encoding of clflushopt and ".byte 0x66; xsaveopt" the one of clwb used
+// before the assemblers knew them, both are flushes.
+static std::vector<AsmPersistInst> parseAsmPersistInsts(const std::string &Asm) {
+  std::vector<AsmPersistInst> Insts;
+  size_t Begin = 0;
+  while (Begin < Asm.size()) {
+    size_t End = Asm.find_first_of("\n;", Begin);
+    if (End == std::string::npos)
+      End = Asm.size();
+    std::string Inst = Asm.substr(Begin, End - Begin);
+    Begin = End + 1;
+
+    size_t MBegin = Inst.find_first_not_of(" \t");
+    if (MBegin == std::string::npos)
+      continue;
+    size_t MEnd = Inst.find_first_of(" \t", MBegin);
+    if (MEnd == std::string::npos)
+      MEnd = Inst.size();
+    std::string Mnemonic = Inst.substr(MBegin, MEnd - MBegin);
+    std::transform(Mnemonic.begin(), Mnemonic.end(), Mnemonic.begin(), ::tolower);
+
+    AsmPersistKind Kind;
+    if (Mnemonic == "clflush" || Mnemonic == "clflushopt" ||
+        Mnemonic == "clwb" || Mnemonic == "xsaveopt")
+      Kind = AsmFlush;
+    else if (Mnemonic == "mfence" || Mnemonic == "sfence")
+      Kind = AsmFence;
+    else if ((Mnemonic.compare(0, 5, "movnt") == 0 ||
+              Mnemonic.compare(0, 6, "vmovnt") == 0) &&
+             Mnemonic.find("movntdqa") == std::string::npos)
+      // movntdqa is a non-temporal load
+      Kind = AsmNTStore;
+    else
+      continue;
+
+    AsmPersistInst PI;
+    PI.Kind = Kind;
+    PI.Mnemonic = Mnemonic;
+    // $N or ${N:modifier}; $$ is a literal $
+    for (size_t I = MEnd; I + 1 < Inst.size(); ++I) {
+      if (Inst[I] != '$')
+        continue;
+      if (Inst[I + 1] == '$') {
+        ++I;
+        continue;
+      }
+      size_t D = Inst[I + 1] == '{' ? I + 2 : I + 1;
+      if (D < Inst.size() && isdigit(Inst[D]))
+        PI.Operands.push_back(atoi(Inst.c_str() + D));
+    }
+    Insts.push_back(PI);
+  }
+  return Insts;
+}
+
+// The call argument of the asm operand $N: the outputs which are not
+// indirect are returned by the call instead of passed to it.
+static Value *getAsmOperandArg(CallInst &CI, const InlineAsm *IA, unsigned N) {
+  unsigned Operand = 0, Arg = 0;
+  for (const InlineAsm::ConstraintInfo &C : IA->ParseConstraints()) {
+    if (C.Type == InlineAsm::isClobber)
+      continue;
+    bool HasArg = C.Type == InlineAsm::isInput || C.isIndirect;
+    if (Operand == N)
+      return HasArg && Arg < CI.getNumArgOperands() ? CI.getArgOperand(Arg)
+                                                    : nullptr;
+    ++Operand;
+    if (HasArg)
+      ++Arg;
+  }
+  return nullptr;
+}
+
+// The number of bytes stored by a non-temporal store to the asm operand Dst
+// from the operand Src (either can be null).
+static uint64_t getAsmNTStoreSize(const DataLayout *TD,
+                                  const AsmPersistInst &PI,
+                                  Value *Dst, Value *Src) {
+  const std::string &M = PI.Mnemonic;
+  if (M.compare(0, 6, "movnti") == 0) {
+    if (M == "movntiq")
+      return 8;
+    if (M == "movntil")
+      return 4;
+    if (Src && Src->getType()->isSized())
+      return TD->getTypeStoreSize(Src->getType());
+    return 8;
+  }
+  if (M == "movntq" || M == "movntsd")
+    return 8;
+  if (M == "movntss")
+    return 4;
+  // movntdq, movntps, movntpd and their VEX/EVEX forms: the register decides
+  if (Src && Src->getType()->isSized() && Src->getType()->isVectorTy())
+    return TD->getTypeStoreSize(Src->getType());
+  if (Dst)
+    if (PointerType *PT = dyn_cast<PointerType>(Dst->getType()))
+      if (PT->getElementType()->isSized() &&
+          PT->getElementType()->isVectorTy())
+        return TD->getTypeStoreSize(PT->getElementType());
+  return 16;
+}
+
 bool TracingNoGiri::visitInlineAsm(CallInst &CI) {
   // InlineAsm conversion
   const InlineAsm *IA = cast<InlineAsm>(CI.getCalledValue());
   // Get ASM string
   const std::string& asm_str = IA->getAsmString();
 
-  // These strings are inferred from: RECIPE, FAIR-FAST, CCEH, Level-Hashing
-  // CLFLUSH and CLFLUSHOPT
-  const std::string CLFLUSH ("clflush $0");
-  // CLWB
-  const std::string CLWB ("xsaveopt $0");
-  // MFENCE
-  const std::string MFENCE ("mfence");
   // XCHGQ
   const std::string XCHGQ ("xchgq $0,$1");
 
-  // TODO: we only use a naive substring matching for both flush and fence.
-  // If it is a flush
-  if (asm_str.find(CLFLUSH) != std::string::npos ||
-        asm_str.find(CLWB) != std::string::npos) {
-    DEBUG(dbgs() << "FLUSH: " << asm_str);
+  std::vector<AsmPersistInst> Insts = parseAsmPersistInsts(asm_str);
+  if (!Insts.empty()) {
+    DEBUG(dbgs() << "PERSIST ASM: " << asm_str);
     DEBUG(dbgs() << "; with #Args: " << CI.getNumArgOperands() << "\n");
-    assert(CI.getNumArgOperands() == 1 || CI.getNumArgOperands() == 2
-            && "FLUSH ASM's # of args is not 1 or 2!");
-
-    // TODO: operand format (only use op 0) is only inferred from (see above);
 
-    // Instrument the code and add RecordFLush
+    // Instrument the code and add a record per flush, fence and store, in
+    // the order of the asm
     instrumentLock(&CI);
-    // Cast the pointer into a void pointer type.
-    Value * Pointer = CI.getArgOperand(0);
-    Pointer = castTo(Pointer, VoidPtrType, Pointer->getName(), &CI);
     // Get the ID of the call instruction.
     Value *CallID = ConstantInt::get(Int32Type, lsNumPass->getID(&CI));
-    // Create the call to the run-time to record the call instruction.
-    std::vector<Value *> args=make_vector<Value *>(CallID, Pointer, 0);
-    CallInst *recFlush = CallInst::Create(RecordFlush, args, "", &CI);
-    instrumentUnlock(recFlush);
-
-    CI.moveBefore(recFlush);
-
-    // STATISTIC
-    ++NumFlushes;
-    return true;
-  }
-
-  // TODO: we only handle mfence here
-  // If it is a mfence
-  if (asm_str.find(MFENCE) != std::string::npos) {
-    DEBUG(dbgs() << "MFENCE: " << asm_str);
-    DEBUG(dbgs() << "; with #Args: " << CI.getNumArgOperands() << "\n");
-    assert(CI.getNumArgOperands() == 0 && "FENCE ASM's # of args is not 0!");
-
-    // Instrument the code and add RecordFence
-    instrumentLock(&CI);
-    // Get the ID of the call instruction.
-    Value *CallID = ConstantInt::get(Int32Type, lsNumPass->getID(&CI));
-    // Create the call to the run-time to record the call instruction.
-    std::vector<Value *> args = make_vector<Value *>(CallID, 0);
-    CallInst* recFence = CallInst::Create(RecordFence, args, "", &CI);
-    instrumentUnlock(recFence);
-
-    CI.moveBefore(recFence);
-
-    ++NumFences;
-    return true;
+    Instruction *First = nullptr, *Last = nullptr;
+    for (const AsmPersistInst &PI : Insts) {
+      CallInst *Rec;
+      if (PI.Kind == AsmFence) {
+        std::vector<Value *> args = make_vector<Value *>(CallID, 0);
+        Rec = CallInst::Create(RecordFence, args, "", &CI);
+        ++NumFences;
+      } else {
+        // The flushed line is the first operand; the destination of a store
+        // is the last one (AT&T syntax)
+        Value *Pointer = nullptr, *Src = nullptr;
+        if (!PI.Operands.empty()) {
+          unsigned Dst = PI.Kind == AsmFlush ? PI.Operands.front()
+                                             : PI.Operands.back();
+          Pointer = getAsmOperandArg(CI, IA, Dst);
+          if (PI.Operands.size() > 1)
+            Src = getAsmOperandArg(CI, IA, PI.Operands.front());
+        }
+        if (!Pointer || !Pointer->getType()->isPointerTy()) {
+          if (CI.getNumArgOperands() == 0 ||
+              !CI.getArgOperand(0)->getType()->isPointerTy()) {
+            DEBUG(dbgs() << "PERSIST ASM without an address: "
+                         << PI.Mnemonic << "\n");
+            continue;
+          }
+          Pointer = CI.getArgOperand(0);
+        }
+        Value *Dst = Pointer;
+        Pointer = castTo(Pointer, VoidPtrType, Pointer->getName(), &CI);
+        if (PI.Kind == AsmFlush) {
+          std::vector<Value *> args=make_vector<Value *>(CallID, Pointer, 0);
+          Rec = CallInst::Create(RecordFlush, args, "", &CI);
+          ++NumFlushes;
+        } else {
+          // A non-temporal store bypasses the cache: a store and a flush
+          uint64_t size = getAsmNTStoreSize(TD, PI, Dst, Src);
+          Value *StoreSize = ConstantInt::get(Int64Type, size);
+          std::vector<Value *> args =
+                          make_vector<Value *>(CallID, Pointer, StoreSize, 0);
+          Rec = CallInst::Create(RecordStore, args, "", &CI);
+          if (!First)
+            First = Rec;
+          Rec = CallInst::Create(RecordFlushWrapper, args, "", &CI);
+          ++NumStores;
+          ++NumFlushes;
+        }
+      }
+      if (!First)
+        First = Rec;
+      Last = Rec;
+    }
+    if (Last) {
+      instrumentUnlock(Last);
+      CI.moveBefore(First);
+      return true;
+    }
+    instrumentUnlock(&CI);
+    return false;
   }
 
   // TODO: hard-coded for now
@@ -0,0 +1,209 @@
+//===- ExecForcers.cpp - Precomputed execution forcers of BBs ---*- C++ -*-===//
+//
+//                    Giri: Dynamic Slicing in LLVM
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that finds the execution forcers of every basic
+// block in the module and stores them in flat tables.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "giriutil"
+
+#include "Utility/ExecForcers.h"
+#include "Utility/Debug.h"
+#include "Utility/Utils.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <fstream>
+
+using namespace dg;
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+//                        Command Line Arguments
+//===----------------------------------------------------------------------===//
+static cl::opt<std::string>
+ExecForcerFilename("exec-forcer-file",
+                   cl::desc("Precomputed exec forcer tables of the module"),
+                   cl::init(""));
+
+//===----------------------------------------------------------------------===//
+//                          Pass Statistics
+//===----------------------------------------------------------------------===//
+STATISTIC(NumForcerFuncs, "Number of functions analyzed for exec forcers");
+STATISTIC(NumForcers, "Number of exec forcers in the tables");
+
+//===----------------------------------------------------------------------===//
+//                        Exec Forcer Passes
+//===----------------------------------------------------------------------===//
+char QueryExecForcers::ID = 0;
+
+static RegisterPass<dg::QueryExecForcers>
+X("query-execforcers", "Query Execution Forcers of Basic Blocks", true, true);
+
+// Header of the exec forcer file. It is followed by offsets, forcers and one
+// byte per basic block for the at-least-once flag. The tables are reused
+// only for the module they were computed for (see getModuleHash).
+static const uint32_t ExecForcerMagic = 0x46584557; // "WEXF"
+struct ExecForcerHeader {
+  uint32_t magic;
+  uint32_t numBBs;
+  uint32_t numForcers;
+  uint32_t pad;
+  uint64_t moduleHash;
+};
+
+void QueryExecForcers::computeTables(Module &M, unsigned numBBs) {
+  const QueryBasicBlockNumbers *bbNumPass = &getAnalysis<QueryBasicBlockNumbers>();
+
+  // Collect the forcers of each basic block first; they are flattened below.
+  std::vector<std::vector<unsigned> > ForceExec(numBBs + 1);
+  atLeastOnce.resize(numBBs + 1);
+
+  for (Module::iterator MI = M.begin(), ME = M.end(); MI != ME; ++MI) {
+    Function &F = *MI;
+    if (F.isDeclaration())
+      continue;
+    ++NumForcerFuncs;
+
+    // The post-dominance analyses are requested exactly once per function.
+    PostDominanceFrontier &PDF = getAnalysis<PostDominanceFrontier>(F);
+    PostDominatorTree &PDT =
+      getAnalysis<PostDominatorTreeWrapperPass>(F).getPostDomTree();
+    BasicBlock &entryBlock = F.getEntryBlock();
+    unsigned entryID = bbNumPass->getID(&entryBlock);
+
+    for (Function::iterator bb = F.begin(); bb != F.end(); ++bb) {
+      unsigned id = bbNumPass->getID(&*bb);
+      if (id == 0)
+        continue;
+
+      // Find all of the basic blocks on which this basic block is
+      // control-dependent.  Record these blocks as they can force execution.
+      std::vector<unsigned> &ForceExecSet = ForceExec[id];
+      PostDominanceFrontier::iterator i = PDF.find(&*bb);
+      if (i != PDF.end())
+        for (BasicBlock *CD : i->second)
+          ForceExecSet.push_back(bbNumPass->getID(CD));
+
+      // If the basic block post-dominates the entry block, then we know it
+      // will be executed at least once every time the function is called.
+      // Therefore, execution of the entry block forces execution of the basic
+      // block.
+      if (PDT.properlyDominates(&*bb, &entryBlock)) {
+        ForceExecSet.push_back(entryID);
+        atLeastOnce.set(id);
+      }
+
+      std::sort(ForceExecSet.begin(), ForceExecSet.end());
+      ForceExecSet.erase(std::unique(ForceExecSet.begin(), ForceExecSet.end()),
+                         ForceExecSet.end());
+    }
+  }
+
+  // Flatten the per-block vectors.
+  offsets.assign(numBBs + 2, 0);
+  forcers.clear();
+  for (unsigned id = 0; id <= numBBs; ++id) {
+    offsets[id] = forcers.size();
+    forcers.insert(forcers.end(), ForceExec[id].begin(), ForceExec[id].end());
+  }
+  offsets[numBBs + 1] = forcers.size();
+}
+
+bool QueryExecForcers::readTables(const std::string &Filename,
+                                  unsigned numBBs, uint64_t moduleHash) {
+  std::ifstream in(Filename, std::ios::binary);
+  if (!in.is_open())
+    return false;
+
+  ExecForcerHeader header;
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!in || header.magic != ExecForcerMagic || header.numBBs != numBBs ||
+      header.moduleHash != moduleHash) {
+    errs() << "Stale exec forcer file " << Filename << ", recomputing\n";
+    return false;
+  }
+
+  offsets.resize(numBBs + 2);
+  forcers.resize(header.numForcers);
+  std::vector<char> flags(numBBs + 1);
+  in.read(reinterpret_cast<char *>(offsets.data()),
+          offsets.size() * sizeof(unsigned));
+  in.read(reinterpret_cast<char *>(forcers.data()),
+          forcers.size() * sizeof(unsigned));
+  in.read(flags.data(), flags.size());
+  if (!in || offsets.back() != forcers.size()) {
+    errs() << "Truncated exec forcer file " << Filename << ", recomputing\n";
+    return false;
+  }
+
+  atLeastOnce.resize(numBBs + 1);
+  for (unsigned id = 0; id <= numBBs; ++id)
+    if (flags[id])
+      atLeastOnce.set(id);
+
+  return true;
+}
+
+void QueryExecForcers::writeTables(const std::string &Filename,
+                                   uint64_t moduleHash) {
+  std::ofstream out(Filename, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    errs() << "Error opening the exec forcer file: " << Filename << "\n";
+    return;
+  }
+
+  ExecForcerHeader header;
+  header.magic = ExecForcerMagic;
+  header.numBBs = offsets.size() - 2;
+  header.numForcers = forcers.size();
+  header.pad = 0;
+  header.moduleHash = moduleHash;
+
+  std::vector<char> flags(atLeastOnce.size());
+  for (unsigned id = 0; id < atLeastOnce.size(); ++id)
+    flags[id] = atLeastOnce[id];
+
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(offsets.data()),
+            offsets.size() * sizeof(unsigned));
+  out.write(reinterpret_cast<const char *>(forcers.data()),
+            forcers.size() * sizeof(unsigned));
+  out.write(flags.data(), flags.size());
+}
+
+bool QueryExecForcers::runOnModule(Module &M) {
+  const QueryBasicBlockNumbers *bbNumPass = &getAnalysis<QueryBasicBlockNumbers>();
+
+  // Basic block IDs are dense and start at 1, so the largest ID is the
+  // number of basic blocks.
+  unsigned numBBs = 0;
+  for (Module::iterator MI = M.begin(), ME = M.end(); MI != ME; ++MI)
+    for (Function::iterator BB = MI->begin(), BE = MI->end(); BB != BE; ++BB)
+      numBBs = std::max(numBBs, bbNumPass->getID(&*BB));
+
+  uint64_t moduleHash = ExecForcerFilename.empty() ? 0 : getModuleHash(M);
+  if (ExecForcerFilename.empty() ||
+      !readTables(ExecForcerFilename, numBBs, moduleHash)) {
+    computeTables(M, numBBs);
+    if (!ExecForcerFilename.empty())
+      writeTables(ExecForcerFilename, moduleHash);
+  }
+
+  NumForcers = forcers.size();
+  DEBUG(dbgs() << "Exec forcer tables: " << numBBs << " basic blocks, "
+               << forcers.size() << " forcers\n");
+
+  return false;
+}
@@ -79,12 +79,12 @@ std::string SourceLineMappingPass::locateSrcInfo(Instruction *I) {
   //  DILocation Loc(N);
   if (DILocation *Loc = I->getDebugLoc().get()) {
     ++NumFoundSrc;
-    std::stringstream ss;
     // TODO to make it short, we ignore the path for now
     //ss << Loc.getDirectory().str() << "/"
-    ss << Loc->getFilename().str() << ":"
-       << Loc->getLine();
-    return ss.str();
+    std::string src = Loc->getFilename().str();
+    src += ':';
+    src += std::to_string(Loc->getLine());
+    return src;
   } else {
     if (isa<PHINode>(I) || isa<AllocaInst>(I) || isa<BranchInst>(I))
       return "";
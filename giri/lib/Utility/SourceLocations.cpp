@@ -0,0 +1,176 @@
+//===- SourceLocations.cpp - Interned source locations of insts -*- C++ -*-===//
+//
+//                    Giri: Dynamic Slicing in LLVM
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that interns the source locations of all the
+// numbered load/store/call instructions of the module.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "giriutil"
+
+#include "Utility/SourceLocations.h"
+#include "Utility/SourceLineMapping.h"
+#include "Utility/Debug.h"
+#include "Utility/Utils.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+
+using namespace dg;
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+//                        Command Line Arguments
+//===----------------------------------------------------------------------===//
+static cl::opt<std::string>
+SrcLocFilename("src-loc-file",
+               cl::desc("Interned source locations of the load/store IDs"),
+               cl::init(""));
+
+//===----------------------------------------------------------------------===//
+//                          Pass Statistics
+//===----------------------------------------------------------------------===//
+STATISTIC(NumSrcLocs, "Number of distinct source locations");
+
+//===----------------------------------------------------------------------===//
+//                        Source Location Passes
+//===----------------------------------------------------------------------===//
+char QuerySourceLocations::ID = 0;
+
+static RegisterPass<dg::QuerySourceLocations>
+X("query-srclocs", "Query Interned Source Locations of Instructions",
+  true, true);
+
+// Header of the source location file. It is followed by the source location
+// ID of each load/store ID and then by the strings as (length, characters).
+// The tables are reused only for the module they were computed for (see
+// getModuleHash).
+static const uint32_t SrcLocMagic = 0x43525357; // "WSRC"
+struct SrcLocHeader {
+  uint32_t magic;
+  uint32_t numLSIDs;
+  uint32_t numSrcs;
+  uint32_t pad;
+  uint64_t moduleHash;
+};
+
+void QuerySourceLocations::computeTables(unsigned numLSIDs) {
+  const QueryLoadStoreNumbers *lsNumPass = &getAnalysis<QueryLoadStoreNumbers>();
+
+  std::unordered_map<std::string, unsigned> srcMap;
+  srcs.assign(1, "");
+  srcMap[""] = 0;
+  srcIDs.assign(numLSIDs + 1, 0);
+
+  for (unsigned lsID = 1; lsID <= numLSIDs; ++lsID) {
+    Instruction *I = lsNumPass->getInstByID(lsID);
+    if (!I)
+      continue;
+
+    std::string src = SourceLineMappingPass::locateSrcInfo(I);
+    auto it = srcMap.find(src);
+    if (it == srcMap.end()) {
+      it = srcMap.insert(std::make_pair(src, srcs.size())).first;
+      srcs.push_back(src);
+    }
+    srcIDs[lsID] = it->second;
+  }
+}
+
+bool QuerySourceLocations::readTables(const std::string &Filename,
+                                      unsigned numLSIDs, uint64_t moduleHash) {
+  std::ifstream in(Filename, std::ios::binary);
+  if (!in.is_open())
+    return false;
+
+  SrcLocHeader header;
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!in || header.magic != SrcLocMagic || header.numLSIDs != numLSIDs ||
+      header.numSrcs == 0 || header.moduleHash != moduleHash) {
+    errs() << "Stale source location file " << Filename << ", recomputing\n";
+    return false;
+  }
+
+  srcIDs.resize(numLSIDs + 1);
+  in.read(reinterpret_cast<char *>(srcIDs.data()),
+          srcIDs.size() * sizeof(unsigned));
+
+  srcs.resize(header.numSrcs);
+  for (std::string &src : srcs) {
+    uint32_t len = 0;
+    in.read(reinterpret_cast<char *>(&len), sizeof(len));
+    src.resize(len);
+    in.read(&src[0], len);
+  }
+
+  if (!in || std::any_of(srcIDs.begin(), srcIDs.end(),
+                         [&](unsigned id) { return id >= srcs.size(); })) {
+    errs() << "Truncated source location file " << Filename
+           << ", recomputing\n";
+    return false;
+  }
+
+  return true;
+}
+
+void QuerySourceLocations::writeTables(const std::string &Filename,
+                                       uint64_t moduleHash) {
+  std::ofstream out(Filename, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    errs() << "Error opening the source location file: " << Filename << "\n";
+    return;
+  }
+
+  SrcLocHeader header = {};
+  header.magic = SrcLocMagic;
+  header.numLSIDs = srcIDs.size() - 1;
+  header.numSrcs = srcs.size();
+  header.moduleHash = moduleHash;
+
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(srcIDs.data()),
+            srcIDs.size() * sizeof(unsigned));
+  for (const std::string &src : srcs) {
+    uint32_t len = src.size();
+    out.write(reinterpret_cast<const char *>(&len), sizeof(len));
+    out.write(src.data(), len);
+  }
+}
+
+bool QuerySourceLocations::runOnModule(Module &M) {
+  const QueryLoadStoreNumbers *lsNumPass = &getAnalysis<QueryLoadStoreNumbers>();
+
+  // Load/store IDs are dense and start at 1, so the largest ID is the number
+  // of numbered instructions.
+  unsigned numLSIDs = 0;
+  for (Module::iterator F = M.begin(), FE = M.end(); F != FE; ++F)
+    for (inst_iterator I = inst_begin(&*F), IE = inst_end(&*F); I != IE; ++I)
+      numLSIDs = std::max(numLSIDs, lsNumPass->getID(&*I));
+
+  uint64_t moduleHash = SrcLocFilename.empty() ? 0 : getModuleHash(M);
+  if (SrcLocFilename.empty() ||
+      !readTables(SrcLocFilename, numLSIDs, moduleHash)) {
+    computeTables(numLSIDs);
+    if (!SrcLocFilename.empty())
+      writeTables(SrcLocFilename, moduleHash);
+  }
+
+  NumSrcLocs = srcs.size();
+  DEBUG(dbgs() << "Source locations: " << numLSIDs << " load/store IDs, "
+               << srcs.size() << " source locations\n");
+
+  return false;
+}
@@ -1,12 +1,19 @@
 #define DEBUG_TYPE "witcherpmtrace"
 
 #include "Witcher/WitcherPMTrace.h"
-#include "Utility/SourceLineMapping.h"
 
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
 
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
 #include <fcntl.h>
 #include <iomanip>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
 
 using namespace witcher;
 
@@ -28,6 +35,38 @@ extern cl::opt<std::string> ExtTracingFuncFilename;
 static cl::opt<std::string>
 PMTraceFilename("pmtrace-file", cl::desc("Output PM Trace File"), cl::init("-"));
 
+// The binary PM trace (see PMTraceBin.h) has the stores already split into
+// atomic writes, so the replay engines don't need to parse and split the text
+// PM trace.
+static cl::opt<std::string>
+PMTraceBinFilename("pmtrace-bin-file",
+                   cl::desc("Output binary PM Trace File"),
+                   cl::init(""));
+
+// The split traces and BB lists of each TX are produced in the same pass over
+// the trace as the PM trace, replacing the tracesplit and tracesplitbb tools.
+static cl::opt<std::string>
+SplitPath("trace-split-dir",
+          cl::desc("Output directory of the per-TX split traces"),
+          cl::init(""));
+
+static cl::opt<std::string>
+SplitBBPath("trace-split-bb-dir",
+            cl::desc("Output directory of the per-TX BB id lists"),
+            cl::init(""));
+
+// The TX view index (see TraceView) lets the PDG jobs open their TX inside
+// the trace itself instead of a split trace.
+static cl::opt<std::string>
+SplitIndexFilename("trace-split-index",
+                   cl::desc("Output index of the TX views of the trace"),
+                   cl::init(""));
+
+static cl::opt<unsigned>
+SplitThreads("trace-split-threads",
+             cl::desc("Threads writing split traces (0: one per core)"),
+             cl::init(0));
+
 
 //===----------------------------------------------------------------------===//
 //                        WitcherPMTrace Implementations
@@ -41,10 +80,106 @@ static RegisterPass<WitcherPMTrace> X("dwitcherpmtrace",
 
 // clean up stuff
 void WitcherPMTrace::cleanup() {
+  if (trace_mapped) {
+    munmap(trace, trace_entries * sizeof(Entry));
+  }
   close(fd_trace);
   storeValueReader.close();
   close(fd_store);
   pmtrace_of.close();
+  if (pmtrace_bin_of.is_open()) {
+    writeBinTail();
+    pmtrace_bin_of.close();
+  }
+}
+
+// The string table of the binary pmtrace starts with the interned source
+// locations of the module, so the records use their source location IDs as is.
+// Other strings (PMDK function names) follow them.
+uint32_t WitcherPMTrace::getBinStrId(const std::string &str) {
+  auto it = bin_str_ids.find(str);
+  if (it != bin_str_ids.end()) {
+    return it->second;
+  }
+
+  uint32_t id = srcLocPass->getNumSrcs() + bin_strs.size();
+  it = bin_str_ids.insert(std::make_pair(str, id)).first;
+  bin_strs.push_back(&it->first);
+  return id;
+}
+
+void WitcherPMTrace::writeBinRecord(PMTraceBinType type, uint64_t tid,
+                                    uint32_t src, uint32_t size,
+                                    uint64_t address, uint32_t aux) {
+  if (!pmtrace_bin_of.is_open()) {
+    return;
+  }
+
+  PMTraceBinRecord record = {};
+  record.type = type;
+  record.tid = tid;
+  record.src = src;
+  record.size = size;
+  record.address = address;
+  record.aux = aux;
+  pmtrace_bin_of.write(reinterpret_cast<const char *>(&record), sizeof(record));
+  ++bin_num_records;
+}
+
+// Write a store, its value and its ATOMIC_WRITE_BYTES chunks. A chunk never
+// crosses an AtomicWriteBytes aligned boundary, which matches the split done
+// by the text trace reader.
+void WitcherPMTrace::writeBinStore(uint64_t tid, uintptr_t addr, uintptr_t len,
+                                   const unsigned char *val, uint32_t src) {
+  if (!pmtrace_bin_of.is_open()) {
+    return;
+  }
+
+  uintptr_t end = addr + len;
+  uint32_t num_chunks = (end - 1) / AtomicWriteBytes - addr / AtomicWriteBytes
+                        + 1;
+
+  writeBinRecord(PMTraceBinType::Store, tid, src, len, addr, num_chunks);
+
+  static const char zeros[8] = {0};
+  pmtrace_bin_of.write(reinterpret_cast<const char *>(val), len);
+  pmtrace_bin_of.write(zeros, (8 - len % 8) % 8);
+
+  uintptr_t chunk_addr = addr;
+  while (chunk_addr < end) {
+    uintptr_t chunk_end = (chunk_addr / AtomicWriteBytes + 1)
+                          * AtomicWriteBytes;
+    chunk_end = std::min(chunk_end, end);
+    writeBinRecord(PMTraceBinType::AtomicStore, tid, src,
+                   chunk_end - chunk_addr, chunk_addr, chunk_addr - addr);
+    chunk_addr = chunk_end;
+  }
+}
+
+// Write the string table and fill in the header reserved in init()
+void WitcherPMTrace::writeBinTail() {
+  PMTraceBinHeader header = {};
+  header.magic = PMTraceBinMagic;
+  header.version = PMTraceBinVersion;
+  header.atomic_write_bytes = AtomicWriteBytes;
+  header.num_strs = srcLocPass->getNumSrcs() + bin_strs.size();
+  header.num_records = bin_num_records;
+  header.strtab_offset = pmtrace_bin_of.tellp();
+
+  for (unsigned src = 0; src < srcLocPass->getNumSrcs(); ++src) {
+    const std::string &str = srcLocPass->getSrc(src);
+    uint32_t len = str.size();
+    pmtrace_bin_of.write(reinterpret_cast<const char *>(&len), sizeof(len));
+    pmtrace_bin_of.write(str.data(), len);
+  }
+  for (const std::string *str : bin_strs) {
+    uint32_t len = str->size();
+    pmtrace_bin_of.write(reinterpret_cast<const char *>(&len), sizeof(len));
+    pmtrace_bin_of.write(str->data(), len);
+  }
+
+  pmtrace_bin_of.seekp(0);
+  pmtrace_bin_of.write(reinterpret_cast<const char *>(&header), sizeof(header));
 }
 
 bool WitcherPMTrace::is_pm_addr(uintptr_t addr) {
@@ -83,9 +218,11 @@ void WitcherPMTrace::processTXAllocEntry(Entry entry) {
                            << std::dec << entry.length;
 
   // print src info
-  Instruction* I = lsNumPass->getInstByID(entry.id);
-  std::string srcInfo = SourceLineMappingPass::locateSrcInfo(I);
-  pmtrace_of << "," << srcInfo << std::endl;
+  unsigned srcID = srcLocPass->getSrcID(entry.id);
+  const std::string &srcInfo = srcLocPass->getSrc(srcID);
+  pmtrace_of << "," << srcInfo << "\n";
+  writeBinRecord(PMTraceBinType::TXAlloc, entry.tid, srcID, entry.length,
+                 entry.address);
 }
 
 void WitcherPMTrace::processTXAddEntry(Entry entry) {
@@ -94,18 +231,21 @@ void WitcherPMTrace::processTXAddEntry(Entry entry) {
                          << std::dec << entry.length;
 
   // print src info
-  Instruction* I = lsNumPass->getInstByID(entry.id);
-  std::string srcInfo = SourceLineMappingPass::locateSrcInfo(I);
-  pmtrace_of << "," << srcInfo << std::endl;
+  unsigned srcID = srcLocPass->getSrcID(entry.id);
+  const std::string &srcInfo = srcLocPass->getSrc(srcID);
+  pmtrace_of << "," << srcInfo << "\n";
+  writeBinRecord(PMTraceBinType::TXAdd, entry.tid, srcID, entry.length,
+                 entry.address);
 }
 
 void WitcherPMTrace::processFenceEntry(Entry entry) {
   pmtrace_of << "Fence," << std::dec << entry.tid;
 
   // print src info
-  Instruction* I = lsNumPass->getInstByID(entry.id);
-  std::string srcInfo = SourceLineMappingPass::locateSrcInfo(I);
-  pmtrace_of << "," << srcInfo << std::endl;
+  unsigned srcID = srcLocPass->getSrcID(entry.id);
+  const std::string &srcInfo = srcLocPass->getSrc(srcID);
+  pmtrace_of << "," << srcInfo << "\n";
+  writeBinRecord(PMTraceBinType::Fence, entry.tid, srcID);
 }
 
 void WitcherPMTrace::processFlushEntry(Entry entry) {
@@ -123,9 +263,10 @@ void WitcherPMTrace::processFlushEntry(Entry entry) {
                          << std::hex << addr;
 
   // print src info
-  Instruction* I = lsNumPass->getInstByID(entry.id);
-  std::string srcInfo = SourceLineMappingPass::locateSrcInfo(I);
-  pmtrace_of << "," << srcInfo << std::endl;
+  unsigned srcID = srcLocPass->getSrcID(entry.id);
+  const std::string &srcInfo = srcLocPass->getSrc(srcID);
+  pmtrace_of << "," << srcInfo << "\n";
+  writeBinRecord(PMTraceBinType::Flush, entry.tid, srcID, 0, addr);
 }
 
 void WitcherPMTrace::processStoreEntry(Entry entry) {
@@ -150,8 +291,7 @@ void WitcherPMTrace::processStoreEntry(Entry entry) {
                          << std::dec << entry.length << ",";
 
   // get the store value through the storeValueReader
-  unsigned char* val = (unsigned char*) malloc(entry.length);
-  storeValueReader.getNextValue(val, entry.length);
+  const unsigned char* val = storeValueReader.getNextValuePtr(entry.length);
 
   for(uintptr_t i = 0; i < entry.length - 1; ++i) {
     pmtrace_of << std::hex << std::setfill('0') << std::setw(2)
@@ -161,10 +301,10 @@ void WitcherPMTrace::processStoreEntry(Entry entry) {
              << (int)val[entry.length-1];
 
   // print src info
-  Instruction* I = lsNumPass->getInstByID(entry.id);
-  std::string srcInfo = SourceLineMappingPass::locateSrcInfo(I);
-  pmtrace_of << "," << srcInfo << std::endl;
-  free(val);
+  unsigned srcID = srcLocPass->getSrcID(entry.id);
+  const std::string &srcInfo = srcLocPass->getSrc(srcID);
+  pmtrace_of << "," << srcInfo << "\n";
+  writeBinStore(entry.tid, addr, entry.length, val, srcID);
 }
 
 void WitcherPMTrace::processRetEntry(Entry entry) {
@@ -185,9 +325,11 @@ void WitcherPMTrace::processRetEntry(Entry entry) {
   pmtrace_of << func_name << "," << std::dec << entry.tid;
 
   // print src info
-  Instruction* I = lsNumPass->getInstByID(entry.id);
-  std::string srcInfo = SourceLineMappingPass::locateSrcInfo(I);
-  pmtrace_of << "," << srcInfo << ",end" << std::endl;
+  unsigned srcID = srcLocPass->getSrcID(entry.id);
+  const std::string &srcInfo = srcLocPass->getSrc(srcID);
+  pmtrace_of << "," << srcInfo << ",end" << "\n";
+  writeBinRecord(PMTraceBinType::PMDKCallEnd, entry.tid, srcID, 0, 0,
+                 getBinStrId(func_name));
 }
 
 // We used call for marking TX boundaries.
@@ -202,23 +344,30 @@ void WitcherPMTrace::processCallEntry(Entry entry) {
 
   // TX start
   if (func_name == "witcher_tx_begin") {
+    // the split trace skips the call and ret entry of TX_START
+    tx_begin_index = curr_index + 2;
+
     pmtrace_of << "TXStart," << std::dec << entry.tid;
 
     // print src info
-    Instruction* I = lsNumPass->getInstByID(entry.id);
-    std::string srcInfo = SourceLineMappingPass::locateSrcInfo(I);
-    pmtrace_of << "," << srcInfo << std::endl;
+    unsigned srcID = srcLocPass->getSrcID(entry.id);
+    const std::string &srcInfo = srcLocPass->getSrc(srcID);
+    pmtrace_of << "," << srcInfo << "\n";
+    writeBinRecord(PMTraceBinType::TXStart, entry.tid, srcID);
     return;
   }
 
   // TX end
   if (func_name == "witcher_tx_end") {
+    tx_ranges.push_back(std::make_pair(tx_begin_index, curr_index));
+
     pmtrace_of << "TXEnd," << std::dec << entry.tid;
 
     // print src info
-    Instruction* I = lsNumPass->getInstByID(entry.id);
-    std::string srcInfo = SourceLineMappingPass::locateSrcInfo(I);
-    pmtrace_of << "," << srcInfo << std::endl;
+    unsigned srcID = srcLocPass->getSrcID(entry.id);
+    const std::string &srcInfo = srcLocPass->getSrc(srcID);
+    pmtrace_of << "," << srcInfo << "\n";
+    writeBinRecord(PMTraceBinType::TXEnd, entry.tid, srcID);
     return;
   }
 
@@ -226,16 +375,17 @@ void WitcherPMTrace::processCallEntry(Entry entry) {
   pmtrace_of << func_name << "," << std::dec << entry.tid;
 
   // print src info
-  Instruction* I = lsNumPass->getInstByID(entry.id);
-  std::string srcInfo = SourceLineMappingPass::locateSrcInfo(I);
-  pmtrace_of << "," << srcInfo << ",start" << std::endl;
+  unsigned srcID = srcLocPass->getSrcID(entry.id);
+  const std::string &srcInfo = srcLocPass->getSrc(srcID);
+  pmtrace_of << "," << srcInfo << ",start" << "\n";
+  writeBinRecord(PMTraceBinType::PMDKCallStart, entry.tid, srcID, 0, 0,
+                 getBinStrId(func_name));
 }
 
 void WitcherPMTrace::run() {
-  // a while loop for processing each entry
-  Entry entry;
-  ssize_t readsize;
-  while ((readsize = read(fd_trace, &entry, sizeof(entry))) == sizeof(entry)) {
+  // a loop for processing each entry of the mmaped trace
+  for (curr_index = 0; curr_index < trace_entries; ++curr_index) {
+    const Entry &entry = trace[curr_index];
     switch (entry.type) {
       case RecordType::CLType:
         processCallEntry(entry);
@@ -266,21 +416,113 @@ void WitcherPMTrace::run() {
 
     // Stop printing entries if we've hit the end of the log.
     if (entry.type == RecordType::ENType) {
-      readsize = 0;
       break;
     }
 
     // memecached doesn't have RecordType::ENType
     if (int(entry.type) == 0 && entry.id == 0 && entry.tid == 0 &&
           entry.address == 0 && entry.length == 0) {
-      readsize = 0;
       break;
     }
   }
+}
+
+// Write all of buf to fd, failing loudly on error (also without asserts)
+static void writeAll(int fd, const void *buf, size_t size,
+                     const std::string &path) {
+  const char *p = static_cast<const char *>(buf);
+  while (size > 0) {
+    ssize_t written = write(fd, p, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      report_fatal_error("Cannot write split trace " + path + ": " +
+                         strerror(errno));
+    }
+    p += written;
+    size -= written;
+  }
+}
+
+// Write the split trace and the BB id list of one TX. The entries of a TX are
+// contiguous in the mmaped trace, so the split trace is a single write.
+void WitcherPMTrace::writeSplitTrace(unsigned tx_index) {
+  unsigned long begin = tx_ranges[tx_index].first;
+  unsigned long end = tx_ranges[tx_index].second;
+  if (end < begin) {
+    end = begin;
+  }
+
+  if (!SplitPath.empty()) {
+    std::string output_file = SplitPath + "/" + std::to_string(tx_index);
+    int fd_output = open(output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                         0640u);
+    if (fd_output == -1) {
+      report_fatal_error("Cannot open split trace " + output_file + ": " +
+                         strerror(errno));
+    }
+
+    writeAll(fd_output, trace + begin, (end - begin) * sizeof(Entry),
+             output_file);
+
+    // write the END entry
+    Entry end_entry = Entry(RecordType::ENType, 0);
+    writeAll(fd_output, &end_entry, sizeof(end_entry), output_file);
+    if (close(fd_output) != 0) {
+      report_fatal_error("Cannot write split trace " + output_file + ": " +
+                         strerror(errno));
+    }
+  }
+
+  if (!SplitBBPath.empty()) {
+    std::string bb_list;
+    for (unsigned long index = begin; index < end; ++index) {
+      if (trace[index].type == RecordType::BBType) {
+        bb_list += std::to_string(trace[index].id);
+        bb_list += '\n';
+      }
+    }
+
+    std::string output_file = SplitBBPath + "/" + std::to_string(tx_index);
+    std::ofstream bb_of(output_file);
+    bb_of << bb_list;
+  }
+}
+
+void WitcherPMTrace::writeSplitTraces() {
+  if (!SplitIndexFilename.empty()) {
+    std::ofstream index_of(SplitIndexFilename);
+    for (unsigned tx_index = 0; tx_index < tx_ranges.size(); ++tx_index) {
+      unsigned long begin = tx_ranges[tx_index].first;
+      unsigned long end = std::max(begin, tx_ranges[tx_index].second);
+      index_of << tx_index << " " << begin << " " << end - begin << " 0\n";
+    }
+  }
+
+  if (SplitPath.empty() && SplitBBPath.empty()) {
+    return;
+  }
+
+  unsigned threads = SplitThreads;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
 
-  if (readsize != 0) {
-    fprintf(stderr, "Read of incorrect size\n");
-    exit(1);
+  // TXs are handed out one at a time, so a few large TXs don't stall a
+  // statically assigned chunk.
+  std::atomic<unsigned> next_tx(0);
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.emplace_back([this, &next_tx]() {
+      unsigned tx_index;
+      while ((tx_index = next_tx++) < tx_ranges.size()) {
+        writeSplitTrace(tx_index);
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
   }
 }
 
@@ -303,6 +545,52 @@ void WitcherPMTrace::init() {
     fd_trace = open (TraceFilename.c_str(), O_RDONLY);
   assert((fd_trace != -1) && "Cannot open trace file!\n");
 
+  // Map the whole trace once; every output is produced from the mapping.
+  // A trace which is not a regular file (e.g. stdin) is read in memory, as
+  // is an empty one, which mmap() rejects.
+  struct stat finfo;
+  int ret = fstat(fd_trace, &finfo);
+  assert((ret == 0) && "Cannot fstat() file!\n");
+  if (S_ISREG(finfo.st_mode) && finfo.st_size > 0) {
+    trace_entries = finfo.st_size / sizeof(Entry);
+    trace = (Entry *)mmap(0,
+                          finfo.st_size,
+                          PROT_READ,
+                          MAP_PRIVATE,
+                          fd_trace,
+                          0);
+    if (trace == MAP_FAILED) {
+      report_fatal_error("Trace mmap() failed: " + std::string(strerror(errno)));
+    }
+    madvise(trace, finfo.st_size, MADV_SEQUENTIAL);
+    trace_mapped = true;
+  } else {
+    // A pipe may return partial entries, so read bytes up to the EOF.
+    size_t size = 0;
+    trace_buf.resize(4096);
+    while (true) {
+      if (size == trace_buf.size() * sizeof(Entry)) {
+        trace_buf.resize(trace_buf.size() * 2);
+      }
+      ssize_t readsize = read(fd_trace, (char *)trace_buf.data() + size,
+                              trace_buf.size() * sizeof(Entry) - size);
+      if (readsize < 0 && errno == EINTR) {
+        continue;
+      }
+      if (readsize < 0) {
+        report_fatal_error("Cannot read trace: " +
+                           std::string(strerror(errno)));
+      }
+      if (readsize == 0) {
+        break;
+      }
+      size += readsize;
+    }
+    trace_entries = size / sizeof(Entry);
+    trace_buf.resize(trace_entries);
+    trace = trace_buf.data();
+  }
+
   // Open the store value file for read-only access.
   if (StoreFilename == "-")
     fd_store = STDIN_FILENO;
@@ -324,13 +612,25 @@ void WitcherPMTrace::init() {
   // init output file stream
   pmtrace_of.open(PMTraceFilename);
 
+  // reserve the header of the binary pmtrace, it is written in cleanup()
+  if (!PMTraceBinFilename.empty()) {
+    pmtrace_bin_of.open(PMTraceBinFilename, std::ios::binary | std::ios::trunc);
+    PMTraceBinHeader header = {};
+    pmtrace_bin_of.write(reinterpret_cast<const char *>(&header),
+                         sizeof(header));
+  }
+
   // get the QueryLoadStoreNumbers for instruction ID
   lsNumPass = &getAnalysis<QueryLoadStoreNumbers>();
+
+  // get the QuerySourceLocations for the source info of the instruction IDs
+  srcLocPass = &getAnalysis<QuerySourceLocations>();
 }
 
 bool WitcherPMTrace::runOnModule(Module &M) {
   init();
   run();
+  writeSplitTraces();
   cleanup();
   // This is an analysis pass, so always return false.
   return false;
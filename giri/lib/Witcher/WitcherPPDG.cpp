@@ -1,7 +1,6 @@
 #define DEBUG_TYPE "witcherppdg"
 
 #include "Witcher/Witcher.h"
-#include "Utility/SourceLineMapping.h"
 #include "Utility/Debug.h"
 
 #include "llvm/Support/CommandLine.h"
@@ -177,7 +176,7 @@ void WitcherPPDG::generateVertices(
     // Set the trace index, entry and source code information for this node
     TraceInfo traceInfo = TraceInfo(index,
                                     entry,
-                                    SourceLineMappingPass::locateSrcInfo(I));
+                                    srcLocPass->getSrcByLSID(entry.id));
 
     // add the value into the ppdg
     ppdg->createVertex(dynValue, traceInfo);
@@ -236,6 +235,9 @@ void WitcherPPDG::init() {
 
   // get the QueryLoadStoreNumbers for instruction ID
   lsNumPass = &getAnalysis<QueryLoadStoreNumbers>();
+
+  // get the QuerySourceLocations for the source info of the instruction IDs
+  srcLocPass = &getAnalysis<QuerySourceLocations>();
 }
 
 bool WitcherPPDG::runOnModule(Module &M) {
@@ -20,6 +20,22 @@ extern cl::opt<std::string> TraceFilename;
 
 extern cl::opt<std::string> PDGFilename;
 
+// A TX view of the trace file (see TraceView), used instead of a split trace
+static cl::opt<unsigned long>
+TraceViewOffset("trace-view-offset",
+                cl::desc("First entry of the TX view in the trace file"),
+                cl::init(0));
+
+static cl::opt<unsigned long>
+TraceViewLength("trace-view-length",
+                cl::desc("Number of entries of the TX view (0: whole trace)"),
+                cl::init(0));
+
+static cl::opt<unsigned long>
+TraceViewTid("trace-view-tid",
+             cl::desc("Thread of the TX view (0: all threads)"),
+             cl::init(0));
+
 //===----------------------------------------------------------------------===//
 //                        WitcherPDG Pass Statistics
 //===----------------------------------------------------------------------===//
@@ -38,9 +54,11 @@ void WitcherParallelPDG::init() {
   // Get references to other passes used by this pass.
   bbNumPass = &getAnalysis<QueryBasicBlockNumbers>();
   lsNumPass = &getAnalysis<QueryLoadStoreNumbers>();
+  execForcerPass = &getAnalysis<QueryExecForcers>();
 
   // Open the trace file and get ready to start using it.
-  Trace = new TraceFile(TraceFilename, bbNumPass, lsNumPass, false);
+  TraceView view(TraceViewOffset, TraceViewLength, TraceViewTid);
+  Trace = new TraceFile(TraceFilename, bbNumPass, lsNumPass, false, view);
 
   // Init the pdg
   pdg = new PDG();
@@ -61,64 +79,15 @@ void WitcherParallelPDG::slicingDataDep(DynValue* DV,
 }
 
 bool WitcherParallelPDG::findExecForcers(BasicBlock *BB,
-                                  std::set<unsigned> &bbNums) {
-  // Get the parent function containing this basic block.  We'll need it for
-  // several operations.
-  Function *F = BB->getParent();
-
-  // If we have already determined which basic blocks force execution of the
-  // specified basic block, determine the IDs of these basic blocks and return
-  // them.
-  if (ForceExecCache.find(BB) != ForceExecCache.end()) {
-    // Convert the basic blocks forcing execution into basic block ID numbers.
-    for (unsigned index = 0; index < ForceExecCache[BB].size(); ++index) {
-      BasicBlock *ForcerBB = ForceExecCache[BB][index];
-      bbNums.insert(bbNumPass->getID(ForcerBB));
-    }
-
-    // Determine if the entry basic block forces execution of the specified
-    // basic block.
-    return ForceAtLeastOnceCache[BB];
-  }
-
-  // Otherwise, we need to determine which basic blocks force the execution of
-  // the specified basic block.  We'll first need to grab the post-dominance
-  // frontier and post-dominance tree for the entire function.
-  //
-  // Note: As of LLVM 2.6, the post-dominance analyses below will get executed
-  //       every time we request them, so only ask for them once per function.
-  //
-  PostDominanceFrontier &PDF = getAnalysis<PostDominanceFrontier>(*F);
-  //PostDominatorTree &PDT = getAnalysis<PostDominatorTree>(*F);
-  PostDominatorTree &PDT = getAnalysis<PostDominatorTreeWrapperPass>(*F).getPostDomTree();
-
-  // Find which basic blocks force execution of each basic block within the
-  // function.  Record the results for future use.
-  for (Function::iterator bb = F->begin(); bb != F->end(); ++bb) {
-    // Find all of the basic blocks on which this basic block is
-    // control-dependent.  Record these blocks as they can force execution.
-    PostDominanceFrontier::iterator i = PDF.find(&*bb);
-    if (i != PDF.end()) {
-      PostDominanceFrontier::DomSetType &CDSet = i->second;
-      std::vector<BasicBlock *> &ForceExecSet = ForceExecCache[&*bb];
-      ForceExecSet.insert(ForceExecSet.end(), CDSet.begin(), CDSet.end());
-    }
-
-    // If the specified basic block post-dominates the entry block, then we
-    // know it will be executed at least once every time the function is called.
-    // Therefore, execution of the entry block forces execution of the basic
-    // block.
-    BasicBlock &entryBlock = F->getEntryBlock();
-    if (PDT.properlyDominates(&*bb, &entryBlock)) {
-      ForceExecCache[&*bb].push_back(&entryBlock);
-      ForceAtLeastOnceCache[BB] = true;
-    } else {
-      ForceAtLeastOnceCache[BB] = false;
-    }
-  }
-
-  // Now that we've updated the cache, call ourselves again to get the answer.
-  return findExecForcers(BB, bbNums);
+                                  ArrayRef<unsigned> &bbNums) {
+  // The forcers of every basic block have been computed once for the whole
+  // module, so this is a lookup in the flat tables.
+  unsigned id = bbNumPass->getID(BB);
+  bbNums = execForcerPass->getForcers(id);
+
+  // Determine if the entry basic block forces execution of the specified
+  // basic block.
+  return execForcerPass->isForcedAtLeastOnce(id);
 }
 
 void WitcherParallelPDG::slicingCtrlDep
@@ -156,7 +125,7 @@ void WitcherParallelPDG::slicingCtrlDep
     // Okay, this is not an entry basic block, and it has not been
     // processed before.  Find the set of basic blocks that can force
     // execution of this basic block.
-    std::set<unsigned> forcesExecSet;
+    ArrayRef<unsigned> forcesExecSet;
     bool found = findExecForcers(DBB.getBasicBlock(), forcesExecSet);
 
     // Find the previously executed basic block which caused execution of
@@ -174,8 +143,8 @@ void WitcherParallelPDG::slicingCtrlDep
     // TODO: if the entry BB is the forcer, and if the forcesExecSet only
     //       contains the entry BB???
               (forcesExecSet.size() == 1 &&
-               forcesExecSet.find(bbNumPass->getID(Forcer.getBasicBlock())) !=
-               forcesExecSet.end())) {
+               forcesExecSet.front() ==
+               bbNumPass->getID(Forcer.getBasicBlock()))) {
       DynValue DTerminator = Forcer.getTerminator();
 
       deque<DynValue*> ctrlDeps;
@@ -1,7 +1,6 @@
 #define DEBUG_TYPE "witcherppdg"
 
 #include "Witcher/WitcherParallel.h"
-#include "Utility/SourceLineMapping.h"
 #include "Utility/Debug.h"
 
 #include "llvm/Support/CommandLine.h"
@@ -170,7 +169,7 @@ void WitcherParallelPPDG::generateVertices(
     // Set the trace index, entry and source code information for this node
     TraceInfo traceInfo = TraceInfo(index,
                                     entry,
-                                    SourceLineMappingPass::locateSrcInfo(I));
+                                    srcLocPass->getSrcByLSID(entry.id));
 
     // add the value into the ppdg
     ppdg->createVertex(dynValue, traceInfo);
@@ -210,6 +209,9 @@ void WitcherParallelPPDG::init() {
   // get the QueryLoadStoreNumbers for instruction ID
   lsNumPass = &getAnalysis<QueryLoadStoreNumbers>();
 
+  // get the QuerySourceLocations for the source info of the instruction IDs
+  srcLocPass = &getAnalysis<QuerySourceLocations>();
+
   // init the ppdg
   ppdg = new PPDG();
 }
@@ -17,6 +17,11 @@ def main():
                         required=True,
                         help="Trace split path")
 
+    parser.add_argument("-view", "--trace-view-index",
+                        required=False,
+                        default=None,
+                        help="TX view index; -trace is then the whole trace")
+
     parser.add_argument("-giri", "--giri-lib",
                         required=True,
                         help="Giri lib path")
@@ -8,6 +8,7 @@ class PPDGParallel:
         self.init_args(args)
         self.init_output()
         self.init_trace_list()
+        self.init_exec_forcers()
         self.init_command_list()
         self.init_pool_executor()
 
@@ -27,6 +28,7 @@ class PPDGParallel:
     def init_args(self, args):
         self.opt = args.opt
         self.trace_split = args.trace_split
+        self.trace_view_index = args.trace_view_index
         self.giri_lib = args.giri_lib
         self.prefix = args.prefix
         self.pm_addr = args.pm_addr
@@ -40,6 +42,22 @@ class PPDGParallel:
         os.system('mkdir ' + self.output)
 
     def init_trace_list(self):
+        # in view mode, each TX is a range of the whole trace instead of a
+        # split trace file: name -> (offset, length, tid)
+        if self.trace_view_index is not None:
+            self.trace_views = {}
+            for line in open(self.trace_view_index):
+                name, offset, length, tid = line.split()
+                # an empty TX has nothing to analyze, and a zero length would
+                # open the whole trace
+                if int(length) == 0:
+                    continue
+                self.trace_views[name] = (offset, length, tid)
+            self.trace_list = list(self.trace_views.keys())
+            self.trace_list.sort( \
+                  key=lambda f:int(self.trace_views[f][1]), reverse=True)
+            return
+
         path = self.trace_split
         self.trace_list = \
           [f for f in os.listdir(path) if os.path.isfile(os.path.join(path, f))]
@@ -48,6 +66,32 @@ class PPDGParallel:
         self.trace_list.sort( \
               key=lambda f:os.path.getsize(os.path.join(path, f)), reverse=True)
 
+    # compute the exec forcer tables and the source locations of the module
+    # once; every pdg job loads them instead of re-running the post-dominance
+    # analyses and re-formatting the source locations
+    def init_exec_forcers(self):
+        self.exec_forcer_file = self.output + '/' + self.prefix + '.forcers'
+        self.src_loc_file = self.output + '/' + self.prefix + '.srcloc'
+        command = self.opt + \
+                  ' -load ' + self.giri_lib + '/libdgutility.so' + \
+                  ' -mergereturn -bbnum -lsnum' + \
+                  ' -query-execforcers' + \
+                  ' -exec-forcer-file=' + self.exec_forcer_file + \
+                  ' -query-srclocs' + \
+                  ' -src-loc-file=' + self.src_loc_file + \
+                  ' -remove-bbnum -remove-lsnum ' + \
+                  self.bc_file + ' -o /dev/null'
+        os.system(command)
+
+    def get_trace_args(self, trace):
+        if self.trace_view_index is None:
+            return ' -trace-file=' + self.prefix + '.trace.split/' + trace
+        offset, length, tid = self.trace_views[trace]
+        return ' -trace-file=' + self.trace_split + \
+               ' -trace-view-offset=' + offset + \
+               ' -trace-view-length=' + length + \
+               ' -trace-view-tid=' + tid
+
     def init_command_list(self):
         self.command_list =[]
         for trace in self.trace_list:
@@ -59,9 +103,11 @@ class PPDGParallel:
                       ' -load ' + self.giri_lib + '/libwitcher.so' + \
 		              ' -mergereturn -bbnum -lsnum' + \
 		              ' -dwitcherparallelpdg' + \
-                      ' -trace-file=' + self.prefix + '.trace.split/' + trace +\
+                      self.get_trace_args(trace) + \
                       ' -pdg-file=' + self.output + '/' + trace + '.pdg' + \
+                      ' -exec-forcer-file=' + self.exec_forcer_file + \
 		              ' -dwitcherparallelppdg' + \
+                      ' -src-loc-file=' + self.src_loc_file + \
 		              ' -pm-addr=' + self.pm_addr + \
 		              ' -pm-size=' + self.pm_size + \
                       ' -ppdg-file=' + self.output + '/' + trace + '.ppdg' + \
@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <stack>
@@ -68,6 +69,8 @@ extern "C" void recordSelect(unsigned id, unsigned char flag);
 extern "C" void recordFlush(unsigned id, unsigned char *p);
 extern "C" void recordFlushWrapper(unsigned id, unsigned char *p, uintptr_t);
 extern "C" void recordFence(unsigned id);
+extern "C" void recordPmemFlags(unsigned id, unsigned char *p, uintptr_t,
+                                unsigned flags);
 extern "C" void recordTxAdd(unsigned id, uint64_t oid_0, uint64_t oid_1,
                             uint64_t off, uint64_t size);
 extern "C" void recordTxAddDirect(unsigned id, unsigned char *p, uint64_t size);
@@ -103,6 +106,92 @@ struct FunRecord {
 };
 static std::unordered_map<pthread_t, std::stack<FunRecord>> FNStack;
 
+//===----------------------------------------------------------------------===//
+//                          Tracing Statistics
+//===----------------------------------------------------------------------===//
+
+/// Counters of the run-time, written at exit to the file named by the
+/// WITCHER_TRACE_STATS environment variable (see the trace-overhead target of
+/// Makefile.test.parallel.common). Nothing is counted without it.
+struct TraceStats {
+  bool enabled;
+  const char *path;
+  uint64_t entries[256]; ///< Entries added, by record type
+  uint64_t entryRemaps; ///< Remaps of the entry cache
+  uint64_t storeValueRemaps; ///< Remaps of the store value cache
+  uint64_t storeValueBytes; ///< Bytes added to the store value cache
+  uint64_t msyncNs; ///< Time spent in msync of both caches
+  uint64_t lockAcquires; ///< recordLock calls
+  uint64_t lockContended; ///< recordLock calls which waited for the mutex
+  uint64_t lockWaitNs; ///< Time spent waiting for EntryCacheMutex
+};
+
+static TraceStats traceStats;
+
+static uint64_t nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// msync, timed when the statistics are enabled
+static void syncCache(void *addr, size_t len) {
+  if (!traceStats.enabled) {
+    msync(addr, len, MS_SYNC);
+    return;
+  }
+  uint64_t start = nowNs();
+  msync(addr, len, MS_SYNC);
+  traceStats.msyncNs += nowNs() - start;
+}
+
+static void writeTraceStats() {
+  static const struct {
+    RecordType type;
+    const char *name;
+  } recordNames[] = {
+    {RecordType::BBType, "bb"},
+    {RecordType::LDType, "load"},
+    {RecordType::STType, "store"},
+    {RecordType::CLType, "call"},
+    {RecordType::RTType, "return"},
+    {RecordType::ENType, "end"},
+    {RecordType::PDType, "select"},
+    {RecordType::FLType, "flush"},
+    {RecordType::FEType, "fence"},
+    {RecordType::TXADDType, "txadd"},
+    {RecordType::TXALLOCType, "txalloc"},
+    {RecordType::MmapType, "mmap"},
+  };
+
+  FILE *file = fopen(traceStats.path, "w");
+  if (file == NULL) {
+    ERROR("[GIRI] Cannot open the statistics file %s: %s\n", traceStats.path,
+          strerror(errno));
+    return;
+  }
+  uint64_t total = 0;
+  for (const auto &record : recordNames) {
+    uint64_t count = traceStats.entries[(unsigned char)record.type];
+    fprintf(file, "entries %s: %lu\n", record.name, (unsigned long)count);
+    total += count;
+  }
+  fprintf(file, "entries: %lu\n", (unsigned long)total);
+  fprintf(file, "entry bytes: %lu\n", (unsigned long)(total * sizeof(Entry)));
+  fprintf(file, "store value bytes: %lu\n",
+          (unsigned long)traceStats.storeValueBytes);
+  fprintf(file, "entry cache remaps: %lu\n",
+          (unsigned long)traceStats.entryRemaps);
+  fprintf(file, "store value cache remaps: %lu\n",
+          (unsigned long)traceStats.storeValueRemaps);
+  fprintf(file, "msync: %lu ns\n", (unsigned long)traceStats.msyncNs);
+  fprintf(file, "lock acquires: %lu\n", (unsigned long)traceStats.lockAcquires);
+  fprintf(file, "lock contended: %lu\n",
+          (unsigned long)traceStats.lockContended);
+  fprintf(file, "lock wait: %lu ns\n", (unsigned long)traceStats.lockWaitNs);
+  fclose(file);
+}
+
 //===----------------------------------------------------------------------===//
 //                        Trace Entry Cache
 //===----------------------------------------------------------------------===//
@@ -200,8 +289,11 @@ void EntryCache::addToEntryCache(const Entry &entry) {
   if (index == EntryCacheSize) {
     DEBUG("[GIRI] Writing the cache to file and remapping...\n");
     // Unmap the data. This should force it to be written to disk.
-    msync(cache, EntryCacheBytes, MS_SYNC);
+    syncCache(cache, EntryCacheBytes);
     munmap(cache, EntryCacheBytes);
+    if (traceStats.enabled) {
+      traceStats.entryRemaps++;
+    }
     // Advance the file offset to the next portion of the file.
     fileOffset += EntryCacheBytes;
     // Remap the cache
@@ -210,6 +302,9 @@ void EntryCache::addToEntryCache(const Entry &entry) {
 
   // Add the entry to the entry cache and increment the index
   cache[index++] = entry;
+  if (traceStats.enabled) {
+    traceStats.entries[(unsigned char)entry.type]++;
+  }
 
 #if 0
   // Initial experiments show that this increases overhead (user + system time).
@@ -239,7 +334,7 @@ void EntryCache::closeCacheFile() {
 
   size_t len = sizeof(Entry) * index;
   // Unmap the data. This should force it to be written to disk.
-  msync(cache, len, MS_SYNC);
+  syncCache(cache, len);
   munmap(cache, len);
 
   // Truncate the file to be the actual size for small traces
@@ -332,8 +427,11 @@ void StoreValueCache::addToStoreValueCache(unsigned char *p, uintptr_t len) {
   if (currOffset + len > StoreValueCacheBytes) {
     DEBUG("[GIRI] Writing the store value cache to file and remapping...\n");
     // Unmap the data. This should force it to be written to disk.
-    msync(cache, StoreValueCacheBytes, MS_SYNC);
+    syncCache(cache, StoreValueCacheBytes);
     munmap(cache, StoreValueCacheBytes);
+    if (traceStats.enabled) {
+      traceStats.storeValueRemaps++;
+    }
     // Advance the file offset to the next portion of the file.
     fileOffset += StoreValueCacheBytes;
     // Remap the cache
@@ -343,11 +441,14 @@ void StoreValueCache::addToStoreValueCache(unsigned char *p, uintptr_t len) {
   // copy the value from p to the cache and update the cuurOffset
   memcpy(cache + currOffset, p, len);
   currOffset += len;
+  if (traceStats.enabled) {
+    traceStats.storeValueBytes += len;
+  }
 }
 
 void StoreValueCache::closeCacheFile() {
   // Unmap the data. This should force it to be written to disk.
-  msync(cache, currOffset, MS_SYNC);
+  syncCache(cache, currOffset);
   munmap(cache, currOffset);
 
   // Truncate the file to be the actual size for small traces
@@ -381,6 +482,10 @@ static void finish() {
 
   // destroy the mutexes
   pthread_mutex_destroy(&EntryCacheMutex);
+
+  if (traceStats.enabled) {
+    writeTraceStats();
+  }
 }
 
 /// Signal handler to write only tracing data to file
@@ -439,6 +544,9 @@ void recordInit(const char *name) {
 
   pthread_mutex_init(&EntryCacheMutex, NULL);
 
+  traceStats.path = getenv("WITCHER_TRACE_STATS");
+  traceStats.enabled = traceStats.path != NULL && traceStats.path[0] != 0;
+
   atexit(finish);
 
   // Register the signal handlers for flushing of diagnosis tracing data to file
@@ -460,7 +568,21 @@ void recordLock(const char *inst_name) {
     return;
   }
 
-  pthread_mutex_lock(&EntryCacheMutex);
+  if (!traceStats.enabled) {
+    pthread_mutex_lock(&EntryCacheMutex);
+  } else {
+    // only a contended lock is timed, so the uncontended path stays cheap;
+    // the counters are updated holding the mutex
+    uint64_t waitNs = 0;
+    if (pthread_mutex_trylock(&EntryCacheMutex) != 0) {
+      uint64_t start = nowNs();
+      pthread_mutex_lock(&EntryCacheMutex);
+      waitNs = nowNs() - start;
+      traceStats.lockContended++;
+    }
+    traceStats.lockAcquires++;
+    traceStats.lockWaitNs += waitNs;
+  }
   DEBUG("[GIRI] Lock for instruction: %s\n", inst_name);
 }
 
@@ -767,6 +889,27 @@ void recordFlushWrapper(unsigned id, unsigned char *ptr, uintptr_t length) {
   }
 }
 
+// The flags of pmem_memcpy, pmem_memmove and pmem_memset (libpmem.h)
+#define PMEM_F_MEM_NODRAIN (1U << 0)
+#define PMEM_F_MEM_NOFLUSH (1U << 5)
+
+/// This function records the flush and the drain pmem_memcpy, pmem_memmove
+/// and pmem_memset do after their store, as their flags tell.
+/// \param id - The ID assigned to the corresponding instruction in the LLVM IR
+/// \param ptr - The destination of the call.
+/// \param length - The number of bytes stored.
+/// \param flags - The flags of the call.
+void recordPmemFlags(unsigned id, unsigned char *ptr, uintptr_t length,
+                     unsigned flags) {
+  if (flags & PMEM_F_MEM_NOFLUSH) {
+    return;
+  }
+  recordFlushWrapper(id, ptr, length);
+  if (!(flags & PMEM_F_MEM_NODRAIN)) {
+    recordFence(id);
+  }
+}
+
 /// This function records a Memory Fence instruction.
 /// \param id - The ID assigned to the corresponding instruction in the LLVM IR
 void recordFence(unsigned id) {
@@ -0,0 +1,204 @@
+//===- WitcherOpFile.cpp - Runtime of the binary op file ------------------===//
+//
+//                          Witcher
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the opening, conversion and writing of the op files
+// described in Witcher/WitcherOpFile.h. It is built without the tracing
+// instrumentation and linked into the benchmark mains like the tracing
+// runtime, so the traced run of a main does not trace the decoding of the op
+// file: the main only reads the records of the image through
+// witcher_ops_get.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Witcher/WitcherOpFile.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The ops loaded by the fork server, shared with its children
+static struct witcher_ops witcher_loaded_ops;
+
+size_t witcher_ops_convert(const char *buf, size_t size, char **image) {
+  // count the ops and their fields to size the image
+  uint64_t num_ops = 0;
+  for (size_t off = 0; off < size; num_ops++) {
+    const char *eol = (const char *)memchr(buf + off, '\n', size - off);
+    off = eol == NULL ? size : eol - buf + 1;
+  }
+  uint64_t strs_offset = sizeof(struct witcher_op_file_header) +
+                         num_ops * sizeof(struct witcher_op_record);
+  // every char of the text is in a field or a separator, and a field adds a
+  // NUL: the fields take at most size + num_ops bytes
+  size_t capacity = strs_offset + size + num_ops;
+  *image = (char *)calloc(1, capacity);
+
+  struct witcher_op_file_header *header =
+      (struct witcher_op_file_header *)*image;
+  struct witcher_op_record *records =
+      (struct witcher_op_record *)(*image + sizeof *header);
+  char *strs = *image + strs_offset;
+  size_t strs_size = 0;
+
+  size_t off = 0;
+  for (uint64_t i = 0; i < num_ops; i++) {
+    const char *eol = (const char *)memchr(buf + off, '\n', size - off);
+    size_t end = eol == NULL ? size : eol - buf + 1;
+    struct witcher_op_record *record = &records[i];
+    // split the line as strtok(line, ";") does: empty fields are skipped
+    while (off < end) {
+      if (buf[off] == ';') {
+        off++;
+        continue;
+      }
+      const char *sep = (const char *)memchr(buf + off, ';', end - off);
+      size_t field_end = sep == NULL ? end : sep - buf;
+      if (record->num_fields < WITCHER_OP_MAX_FIELDS) {
+        record->fields[record->num_fields++] = (uint32_t)strs_size;
+        memcpy(strs + strs_size, buf + off, field_end - off);
+        strs_size += field_end - off + 1;
+      }
+      off = field_end;
+    }
+    record->opcode = record->num_fields > 0 ? strs[record->fields[0]] : 0;
+  }
+
+  header->magic = WITCHER_OP_FILE_MAGIC;
+  header->version = WITCHER_OP_FILE_VERSION;
+  header->num_ops = num_ops;
+  header->strs_offset = strs_offset;
+  header->size = strs_offset + strs_size;
+  return header->size;
+}
+
+int witcher_ops_map(struct witcher_ops *ops, const char *op_file_path) {
+  size_t len = strlen(op_file_path);
+  char *bin_path = (char *)malloc(len + sizeof WITCHER_OP_FILE_SUFFIX);
+  memcpy(bin_path, op_file_path, len);
+  memcpy(bin_path + len, WITCHER_OP_FILE_SUFFIX, sizeof WITCHER_OP_FILE_SUFFIX);
+  int fd = open(bin_path, O_RDONLY);
+  free(bin_path);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct stat text_st, bin_st;
+  if (fstat(fd, &bin_st) != 0 ||
+      (stat(op_file_path, &text_st) == 0 &&
+       text_st.st_mtime > bin_st.st_mtime) ||
+      (size_t)bin_st.st_size < sizeof(struct witcher_op_file_header)) {
+    close(fd);
+    return -1;
+  }
+  // private, the mains may write to the fields as they did to their lines
+  void *image = mmap(NULL, bin_st.st_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    return -1;
+  }
+
+  struct witcher_op_file_header *header =
+      (struct witcher_op_file_header *)image;
+  // the records must lie between the header and the fields, and the fields
+  // in the image, else a stale or corrupt file is read out of the mapping
+  uint64_t max_ops = (UINT64_MAX - sizeof *header) /
+                     sizeof(struct witcher_op_record);
+  if (header->magic != WITCHER_OP_FILE_MAGIC ||
+      header->version != WITCHER_OP_FILE_VERSION ||
+      header->size > (uint64_t)bin_st.st_size ||
+      header->num_ops > max_ops ||
+      header->strs_offset < sizeof *header +
+                            header->num_ops * sizeof(struct witcher_op_record) ||
+      header->strs_offset > header->size) {
+    munmap(image, bin_st.st_size);
+    return -1;
+  }
+  ops->image = (char *)image;
+  ops->image_size = bin_st.st_size;
+  ops->mapped = 1;
+  return 0;
+}
+
+int witcher_ops_open(struct witcher_ops *ops, const char *op_file_path) {
+  memset(ops, 0, sizeof *ops);
+  if (witcher_ops_map(ops, op_file_path) != 0) {
+    FILE *op_file = fopen(op_file_path, "r");
+    if (op_file == NULL) {
+      perror("fopen op file failed");
+      return -1;
+    }
+    fseek(op_file, 0, SEEK_END);
+    long size = ftell(op_file);
+    fseek(op_file, 0, SEEK_SET);
+    char *buf = (char *)malloc(size + 1);
+    size = fread(buf, 1, size, op_file);
+    fclose(op_file);
+
+    ops->image_size = witcher_ops_convert(buf, size, &ops->image);
+    free(buf);
+  }
+
+  ops->path = strdup(op_file_path);
+  ops->header = (struct witcher_op_file_header *)ops->image;
+  ops->records = (struct witcher_op_record *)(ops->image + sizeof *ops->header);
+  ops->strs = ops->image + ops->header->strs_offset;
+  return 0;
+}
+
+void witcher_ops_close(struct witcher_ops *ops) {
+  if (ops->mapped) {
+    munmap(ops->image, ops->image_size);
+  } else {
+    free(ops->image);
+  }
+  free(ops->path);
+  memset(ops, 0, sizeof *ops);
+}
+
+int witcher_ops_write(struct witcher_ops *ops, const char *bin_path) {
+  FILE *bin_file = fopen(bin_path, "w");
+  if (bin_file == NULL) {
+    perror("fopen binary op file failed");
+    return -1;
+  }
+  size_t size = ops->header->size;
+  int ret = fwrite(ops->image, 1, size, bin_file) == size ? 0 : -1;
+  return fclose(bin_file) == 0 ? ret : -1;
+}
+
+void witcher_load_op_file(const char *op_file_path) {
+  witcher_ops_open(&witcher_loaded_ops, op_file_path);
+}
+
+struct witcher_ops *witcher_ops_find(const char *op_file_path,
+                                     struct witcher_ops *own_ops) {
+  if (witcher_loaded_ops.path != NULL &&
+      strcmp(op_file_path, witcher_loaded_ops.path) == 0) {
+    return &witcher_loaded_ops;
+  }
+  return witcher_ops_open(own_ops, op_file_path) == 0 ? own_ops : NULL;
+}
+
+uint64_t witcher_ops_select(struct witcher_ops *ops, int start_index,
+                            int skip_index, uint64_t serial_end,
+                            uint64_t **indexes, uint64_t *num_serial) {
+  uint64_t num_ops = ops->header->num_ops;
+  uint64_t num_selected = 0;
+  *indexes = (uint64_t *)malloc((num_ops + 1) * sizeof(uint64_t));
+  *num_serial = 0;
+  for (uint64_t i = start_index > 0 ? start_index : 0; i < num_ops; i++) {
+    if (i != (uint64_t)skip_index) {
+      *num_serial += i < serial_end;
+      (*indexes)[num_selected++] = i;
+    }
+  }
+  return num_selected;
+}
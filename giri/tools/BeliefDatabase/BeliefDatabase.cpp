@@ -0,0 +1,375 @@
+//===- BeliefDatabase.cpp - Native belief database and crash candidates ---===//
+//
+//                          Witcher
+//
+//===----------------------------------------------------------------------===//
+//
+// This library is the native version of WitcherBeliefDatabase and of
+// CrashCandidates.get_crash_candidates_from_tx. It loads the PPDGs, builds the
+// PM object list and the likely-ordering/atomicity beliefs, and generates the
+// crash candidates of a TX from indexed lookups instead of checking every pair
+// of stores. It is loaded by replay/engines/witcher/nativebeliefdatabase.py
+// through ctypes.
+//
+// The beliefs are the same as in witcherbeliefdatabase.py:
+//  - ST -dd/cd-> LD: LD -hb-> ST, LD is a critical read
+//  - LD -cd-> LD':   LD -hb-> LD' and every load LD depends on without going
+//                    through a store -hb-> LD', LD' is a critical read
+// A candidate (p, v) persists the store p and leaves the store v volatile. It
+// is generated if both stores are critical (both orders), or if there is a
+// belief obj(v) -hb-> obj(p).
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct PPDGNode {
+  bool store;
+  uint64_t address;
+  uint64_t size;
+};
+
+struct PPDG {
+  std::unordered_map<long, PPDGNode> nodes;
+  // (src, tgt) -> is a data edge; a later edge between the same nodes
+  // overrides the type, as in the networkx graph
+  std::map<std::pair<long, long>, bool> edges;
+  // tgt -> srcs
+  std::unordered_map<long, std::vector<long>> preds;
+};
+
+struct PMObject {
+  uint64_t address;
+  uint64_t size;
+  uint64_t end() const { return address + size; }
+};
+
+} // namespace
+
+struct BeliefDatabase {
+  // sorted, non-overlapping PM objects
+  std::vector<PMObject> objects;
+  // sorted successors of each object in the belief graph
+  std::vector<std::vector<uint32_t>> succs;
+  // sorted predecessors of each object in the belief graph
+  std::vector<std::vector<uint32_t>> preds;
+  std::vector<bool> critical;
+  size_t num_beliefs = 0;
+};
+
+// Parse the PPDGs written by PPDG::write_graphviz
+static bool parsePPDGs(const char *path, std::vector<PPDG> &ppdgs) {
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    perror("belief database: cannot open the ppdg file");
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.compare(0, 7, "digraph") == 0) {
+      ppdgs.emplace_back();
+      continue;
+    }
+    if (line.empty() || line[0] == '}' || ppdgs.empty()) {
+      continue;
+    }
+    PPDG &ppdg = ppdgs.back();
+
+    size_t arrow = line.find("->");
+    if (arrow != std::string::npos) {
+      // <src>-><tgt> [label="data"];
+      long src = strtol(line.c_str(), nullptr, 10);
+      long tgt = strtol(line.c_str() + arrow + 2, nullptr, 10);
+      bool data = line.find("\"data\"") != std::string::npos;
+      auto key = std::make_pair(src, tgt);
+      if (ppdg.edges.find(key) == ppdg.edges.end()) {
+        ppdg.preds[tgt].push_back(src);
+      }
+      ppdg.edges[key] = data;
+      continue;
+    }
+
+    // <id>[label="TI:...:::Src:...:::TraceEntry:<Store|Load>,<hex addr>,<len>"];
+    size_t entry = line.find("TraceEntry:");
+    if (entry == std::string::npos) {
+      continue;
+    }
+    const char *p = line.c_str() + entry + strlen("TraceEntry:");
+    PPDGNode node;
+    node.store = strncmp(p, "Store", 5) == 0;
+    p = strchr(p, ',');
+    if (p == nullptr) {
+      continue;
+    }
+    char *end;
+    node.address = strtoull(p + 1, &end, 16);
+    node.size = strtoull(end + 1, nullptr, 10);
+    ppdg.nodes[strtol(line.c_str(), nullptr, 10)] = node;
+  }
+  return true;
+}
+
+// Merge the overlapping ranges of the nodes into the PM objects
+static void initPMObjects(BeliefDatabase *db, const std::vector<PPDG> &ppdgs) {
+  std::vector<PMObject> ranges;
+  for (const PPDG &ppdg : ppdgs) {
+    for (const auto &n : ppdg.nodes) {
+      // size = 0 for memcpy memset memmove
+      if (n.second.size > 0) {
+        ranges.push_back({n.second.address, n.second.size});
+      }
+    }
+  }
+  std::sort(ranges.begin(), ranges.end(),
+            [](const PMObject &a, const PMObject &b) {
+              return a.address < b.address;
+            });
+
+  for (const PMObject &r : ranges) {
+    if (!db->objects.empty() && r.address < db->objects.back().end()) {
+      PMObject &last = db->objects.back();
+      last.size = std::max(last.end(), r.end()) - last.address;
+    } else {
+      db->objects.push_back(r);
+    }
+  }
+}
+
+// return the id of the PM object overlapping [address, address + size), or -1
+static long findPMObject(const BeliefDatabase *db, uint64_t address,
+                         uint64_t size) {
+  auto it = std::upper_bound(db->objects.begin(), db->objects.end(), address,
+                             [](uint64_t addr, const PMObject &obj) {
+                               return addr < obj.end();
+                             });
+  if (it == db->objects.end() || it->address >= address + size) {
+    return -1;
+  }
+  return it - db->objects.begin();
+}
+
+static void initBeliefs(BeliefDatabase *db, const std::vector<PPDG> &ppdgs) {
+  size_t num_objects = db->objects.size();
+  db->critical.assign(num_objects, false);
+  std::unordered_set<uint64_t> beliefs;
+  auto addBelief = [&](long hb_src, long hb_tgt) {
+    beliefs.insert((uint64_t)hb_src * num_objects + hb_tgt);
+  };
+  auto objOf = [&](const PPDGNode &n) {
+    return findPMObject(db, n.address, n.size);
+  };
+
+  for (const PPDG &ppdg : ppdgs) {
+    for (const auto &e : ppdg.edges) {
+      auto src_it = ppdg.nodes.find(e.first.first);
+      auto tgt_it = ppdg.nodes.find(e.first.second);
+      if (src_it == ppdg.nodes.end() || tgt_it == ppdg.nodes.end()) {
+        continue;
+      }
+      const PPDGNode &src = src_it->second;
+      const PPDGNode &tgt = tgt_it->second;
+      if (src.size == 0 || tgt.size == 0) {
+        continue;
+      }
+      long src_obj = objOf(src);
+      long tgt_obj = objOf(tgt);
+
+      // src(ST) -dd/cd-> tgt(LD): tgt -hb-> src
+      if (src.store && !tgt.store) {
+        addBelief(tgt_obj, src_obj);
+        db->critical[tgt_obj] = true;
+      }
+
+      // src(LD) -cd-> tgt(LD): src -hb-> tgt, and transitively
+      if (!e.second && !src.store && !tgt.store) {
+        addBelief(src_obj, tgt_obj);
+        db->critical[tgt_obj] = true;
+
+        // the loads src depends on, without going through a store
+        std::unordered_set<long> processed;
+        std::deque<long> queue;
+        queue.push_back(e.first.first);
+        while (!queue.empty()) {
+          long node_id = queue.front();
+          queue.pop_front();
+          auto preds_it = ppdg.preds.find(node_id);
+          if (preds_it == ppdg.preds.end()) {
+            continue;
+          }
+          for (long pred_id : preds_it->second) {
+            if (!processed.insert(pred_id).second) {
+              continue;
+            }
+            auto pred_it = ppdg.nodes.find(pred_id);
+            if (pred_it == ppdg.nodes.end() || pred_it->second.store) {
+              continue;
+            }
+            queue.push_back(pred_id);
+            if (pred_it->second.size == 0) {
+              continue;
+            }
+            addBelief(objOf(pred_it->second), tgt_obj);
+          }
+        }
+      }
+    }
+  }
+
+  db->succs.assign(num_objects, {});
+  db->preds.assign(num_objects, {});
+  for (uint64_t b : beliefs) {
+    uint32_t hb_src = b / num_objects;
+    uint32_t hb_tgt = b % num_objects;
+    db->succs[hb_src].push_back(hb_tgt);
+    db->preds[hb_tgt].push_back(hb_src);
+  }
+  for (size_t i = 0; i < num_objects; ++i) {
+    std::sort(db->succs[i].begin(), db->succs[i].end());
+    std::sort(db->preds[i].begin(), db->preds[i].end());
+  }
+  db->num_beliefs = beliefs.size();
+}
+
+static bool hasBelief(const BeliefDatabase *db, long hb_src, long hb_tgt) {
+  if (hb_src < 0 || hb_tgt < 0) {
+    return false;
+  }
+  const std::vector<uint32_t> &succs = db->succs[hb_src];
+  return std::binary_search(succs.begin(), succs.end(), (uint32_t)hb_tgt);
+}
+
+extern "C" {
+
+/// Load the PPDGs at ppdg_path and build the belief database.
+/// \return nullptr if the PPDG file can't be read.
+BeliefDatabase *belief_db_open(const char *ppdg_path) {
+  std::vector<PPDG> ppdgs;
+  if (!parsePPDGs(ppdg_path, ppdgs)) {
+    return nullptr;
+  }
+
+  BeliefDatabase *db = new BeliefDatabase();
+  initPMObjects(db, ppdgs);
+  initBeliefs(db, ppdgs);
+  return db;
+}
+
+size_t belief_db_num_objects(BeliefDatabase *db) {
+  return db->objects.size();
+}
+
+size_t belief_db_num_beliefs(BeliefDatabase *db) {
+  return db->num_beliefs;
+}
+
+/// Generate the crash candidates of a TX with n stores, store i writes
+/// sizes[i] bytes at addresses[i]. The candidates are in the order of
+/// CrashCandidates.get_crash_candidates_from_tx: by max(p, v) and then by
+/// min(p, v).
+/// \return an array of 2 * *num_candidates store indexes (p, v), to be freed
+/// with belief_db_free, or nullptr if there is no candidate.
+uint32_t *belief_db_crash_candidates(BeliefDatabase *db, size_t n,
+                                     const uint64_t *addresses,
+                                     const uint64_t *sizes,
+                                     size_t *num_candidates) {
+  std::vector<long> obj(n);
+  std::vector<bool> critical(n);
+  // the stores of each object, in order
+  std::unordered_map<long, std::vector<uint32_t>> obj_stores;
+  for (size_t i = 0; i < n; ++i) {
+    obj[i] = findPMObject(db, addresses[i], sizes[i]);
+    critical[i] = obj[i] >= 0 && db->critical[obj[i]];
+    if (obj[i] >= 0) {
+      obj_stores[obj[i]].push_back(i);
+    }
+  }
+
+  std::vector<uint32_t> critical_stores;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> pres;
+  std::vector<size_t> seen(n, (size_t)-1);
+  auto addPres = [&](const std::vector<uint32_t> &stores, size_t suc) {
+    for (uint32_t pre : stores) {
+      if (pre >= suc) {
+        break;
+      }
+      if (seen[pre] != suc) {
+        seen[pre] = suc;
+        pres.push_back(pre);
+      }
+    }
+  };
+
+  for (size_t suc = 0; suc < n; ++suc) {
+    pres.clear();
+    if (critical[suc]) {
+      addPres(critical_stores, suc);
+    }
+    if (obj[suc] >= 0) {
+      for (const auto *objs : {&db->succs[obj[suc]], &db->preds[obj[suc]]}) {
+        for (uint32_t o : *objs) {
+          auto it = obj_stores.find(o);
+          if (it != obj_stores.end()) {
+            addPres(it->second, suc);
+          }
+        }
+      }
+    }
+    std::sort(pres.begin(), pres.end());
+
+    for (uint32_t pre : pres) {
+      // breaking atomicity, no extra ordering check
+      if (critical[pre] && critical[suc]) {
+        candidates.insert(candidates.end(), {pre, (uint32_t)suc});
+        candidates.insert(candidates.end(), {(uint32_t)suc, pre});
+        continue;
+      }
+      // persist pre and leave suc volatile
+      if (hasBelief(db, obj[suc], obj[pre])) {
+        candidates.insert(candidates.end(), {pre, (uint32_t)suc});
+      }
+      // persist suc and leave pre volatile
+      if (hasBelief(db, obj[pre], obj[suc])) {
+        candidates.insert(candidates.end(), {(uint32_t)suc, pre});
+      }
+    }
+
+    if (critical[suc]) {
+      critical_stores.push_back(suc);
+    }
+  }
+
+  *num_candidates = candidates.size() / 2;
+  if (candidates.empty()) {
+    return nullptr;
+  }
+  uint32_t *res = (uint32_t *)malloc(candidates.size() * sizeof(uint32_t));
+  memcpy(res, candidates.data(), candidates.size() * sizeof(uint32_t));
+  return res;
+}
+
+void belief_db_free(uint32_t *candidates) {
+  free(candidates);
+}
+
+void belief_db_close(BeliefDatabase *db) {
+  delete db;
+}
+
+}
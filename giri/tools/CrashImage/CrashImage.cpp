@@ -0,0 +1,444 @@
+//===- CrashImage.cpp - Build crash images from a base PM image ----------===//
+//
+//                          Witcher
+//
+//===----------------------------------------------------------------------===//
+//
+// This library builds the PM image of each crash state from the pre-crash
+// image (the base) without copying the whole pool every time. It is loaded by
+// replay/engines/witcher/crashimage.py through ctypes.
+//
+// A crash image is built in one of two ways:
+//  - reflink: the image is a FICLONE clone of the base, so it shares all the
+//    blocks of the base and only the pages written later are copied.
+//  - scratch: the filesystem can't clone, so the builder keeps one scratch
+//    image next to the base and the crash image is a hard link to it. The
+//    previous state left its crash plan and the writes of its validation in
+//    the scratch image, and the validation writes are not known to the
+//    builder. Before each build, the scratch image is emptied by punching a
+//    hole over it, and only the pages of the base that are not zero are
+//    copied back. They are found once per base, not once per crash state.
+//    If most of the base is not zero, or the filesystem can't punch holes,
+//    the pages that differ from the base are copied back instead.
+//
+// A scratch crash image is only valid until the next build.
+//
+// The builder also hashes the delta a crash plan makes to the base, so crash
+// plans producing the same crash image are only validated once.
+//
+// The scratch image can also be a memfd, optionally backed by hugepages. The
+// validate exe then opens it as /proc/self/fd/<fd> (the fd is inherited), so
+// crash images never go through the filesystem.
+//
+//===----------------------------------------------------------------------===//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#define CRASH_IMAGE_PAGE_BYTES 4096
+#define CRASH_IMAGE_HUGEPAGE_BYTES (2UL * 1024 * 1024)
+
+struct CrashImageBuilder {
+  std::string base_path;
+  std::string scratch_path;
+  int base_fd = -1;
+  int scratch_fd = -1;
+  size_t size = 0;
+  const char *base_map = nullptr;
+  char *scratch_map = nullptr;
+  // cleared once FICLONE fails on the filesystem of the base
+  bool reflink = true;
+  // the scratch image is a memfd
+  bool memfd = false;
+  bool hugepages = false;
+  // read-only mapping of the base for the delta hashes
+  const char *delta_map = nullptr;
+  size_t delta_size = 0;
+  // the pages of the base that are not zero, valid until the base changes
+  std::vector<size_t> base_pages;
+  bool base_pages_valid = false;
+  // cleared once punching a hole fails on the scratch image
+  bool punch = true;
+};
+
+static void unmapScratch(CrashImageBuilder *b) {
+  b->base_pages_valid = false;
+  if (b->base_map) {
+    munmap((void *)b->base_map, b->size);
+    b->base_map = nullptr;
+  }
+  if (b->scratch_map) {
+    munmap(b->scratch_map, b->size);
+    b->scratch_map = nullptr;
+  }
+  // the memfd is kept, since the validate exe may have inherited it
+  if (b->scratch_fd != -1 && !b->memfd) {
+    close(b->scratch_fd);
+    b->scratch_fd = -1;
+  }
+}
+
+// Create the memfd of the scratch image. Hugepages need a pool size aligned
+// to the hugepage size and reserved hugepages; without them, the memfd asks
+// for transparent hugepages instead.
+static int createMemfd(CrashImageBuilder *b, size_t size) {
+  if (b->hugepages && size % CRASH_IMAGE_HUGEPAGE_BYTES == 0) {
+    int fd = memfd_create("witcher-crash-image", MFD_CLOEXEC | MFD_HUGETLB);
+    // hugetlb memfds can be truncated beyond the reserved hugepages, so
+    // try to map it too
+    if (fd != -1 && ftruncate(fd, size) == 0) {
+      void *map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (map != MAP_FAILED) {
+        munmap(map, size);
+        return fd;
+      }
+    }
+    perror("crash image: no hugetlb memfd, using a regular memfd");
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+
+  int fd = memfd_create("witcher-crash-image", MFD_CLOEXEC);
+  if (fd == -1) {
+    perror("crash image: cannot create the memfd");
+  }
+  return fd;
+}
+
+// Create the scratch image as a full copy of the base
+static int initScratch(CrashImageBuilder *b, size_t size) {
+  unmapScratch(b);
+  b->size = size;
+
+  if (!b->memfd) {
+    b->scratch_fd = open(b->scratch_path.c_str(), O_RDWR | O_CREAT | O_TRUNC,
+                         0640u);
+  } else if (b->scratch_fd == -1) {
+    b->scratch_fd = createMemfd(b, size);
+  }
+  if (b->scratch_fd == -1 || ftruncate(b->scratch_fd, size) != 0) {
+    perror("crash image: cannot create the scratch image");
+    return -1;
+  }
+
+  b->base_map = (const char *)mmap(0, size, PROT_READ, MAP_SHARED,
+                                   b->base_fd, 0);
+  b->scratch_map = (char *)mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                b->scratch_fd, 0);
+  if (b->base_map == MAP_FAILED || b->scratch_map == MAP_FAILED) {
+    perror("crash image: cannot mmap the images");
+    b->base_map = nullptr;
+    b->scratch_map = nullptr;
+    return -1;
+  }
+
+  if (b->memfd && b->hugepages) {
+    madvise(b->scratch_map, size, MADV_HUGEPAGE);
+  }
+
+  memcpy(b->scratch_map, b->base_map, size);
+  return size / CRASH_IMAGE_PAGE_BYTES;
+}
+
+static size_t pageBytes(CrashImageBuilder *b, size_t off) {
+  return b->size - off < CRASH_IMAGE_PAGE_BYTES ?
+         b->size - off : CRASH_IMAGE_PAGE_BYTES;
+}
+
+// Find the pages of the base that are not zero
+static void scanBase(CrashImageBuilder *b) {
+  static const char zeros[CRASH_IMAGE_PAGE_BYTES] = {0};
+  b->base_pages.clear();
+  for (size_t off = 0; off < b->size; off += CRASH_IMAGE_PAGE_BYTES) {
+    if (memcmp(b->base_map + off, zeros, pageBytes(b, off)) != 0) {
+      b->base_pages.push_back(off);
+    }
+  }
+  b->base_pages_valid = true;
+}
+
+// Empty the scratch image and copy back the pages of the base that are not
+// zero. \return the number of pages copied, or -1 if the scratch image
+// can't be emptied.
+static long refillScratch(CrashImageBuilder *b) {
+  if (fallocate(b->scratch_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0,
+                b->size) != 0) {
+    if (errno != EOPNOTSUPP && errno != ENOSYS) {
+      perror("crash image: cannot punch the scratch image");
+    }
+    b->punch = false;
+    return -1;
+  }
+
+  for (size_t off : b->base_pages) {
+    memcpy(b->scratch_map + off, b->base_map + off, pageBytes(b, off));
+  }
+  return b->base_pages.size();
+}
+
+// Restore the scratch image to the base. base_changed tells that the base
+// was written since the previous build.
+static long restoreScratch(CrashImageBuilder *b, bool base_changed) {
+  if (base_changed || !b->base_pages_valid) {
+    scanBase(b);
+  }
+
+  size_t num_pages = (b->size + CRASH_IMAGE_PAGE_BYTES - 1) /
+                     CRASH_IMAGE_PAGE_BYTES;
+  if (b->punch && b->base_pages.size() * 2 < num_pages) {
+    long restored = refillScratch(b);
+    if (restored >= 0) {
+      return restored;
+    }
+  }
+
+  // Copy back the pages of the scratch image that differ from the base
+  long restored = 0;
+  for (size_t off = 0; off < b->size; off += CRASH_IMAGE_PAGE_BYTES) {
+    size_t len = pageBytes(b, off);
+    if (memcmp(b->scratch_map + off, b->base_map + off, len) != 0) {
+      memcpy(b->scratch_map + off, b->base_map + off, len);
+      ++restored;
+    }
+  }
+  return restored;
+}
+
+static int buildReflink(CrashImageBuilder *b, const char *dst_path) {
+  int dst_fd = open(dst_path, O_WRONLY | O_CREAT | O_TRUNC, 0640u);
+  if (dst_fd == -1) {
+    perror("crash image: cannot create the crash image");
+    return -1;
+  }
+
+  int ret = ioctl(dst_fd, FICLONE, b->base_fd);
+  int err = errno;
+  close(dst_fd);
+  if (ret == 0) {
+    return 0;
+  }
+
+  unlink(dst_path);
+  if (err == EOPNOTSUPP || err == EXDEV || err == EINVAL || err == ENOTTY ||
+      err == EPERM) {
+    b->reflink = false;
+    return 1;
+  }
+  errno = err;
+  perror("crash image: FICLONE failed");
+  return -1;
+}
+
+static long buildScratch(CrashImageBuilder *b, const char *dst_path,
+                         bool base_changed) {
+  struct stat finfo;
+  if (fstat(b->base_fd, &finfo) != 0) {
+    perror("crash image: cannot fstat the base image");
+    return -1;
+  }
+
+  long pages;
+  if (b->scratch_map == nullptr || (size_t)finfo.st_size != b->size) {
+    pages = initScratch(b, finfo.st_size);
+  } else {
+    pages = restoreScratch(b, base_changed);
+  }
+  if (pages < 0 || b->memfd) {
+    return pages;
+  }
+
+  // the crash image is the scratch image under the name of the crash state
+  if (unlink(dst_path) != 0 && errno != ENOENT) {
+    perror("crash image: cannot remove the old crash image");
+    return -1;
+  }
+  if (link(b->scratch_path.c_str(), dst_path) != 0) {
+    perror("crash image: cannot link the scratch image");
+    return -1;
+  }
+  return pages;
+}
+
+static bool mapDeltaBase(CrashImageBuilder *b) {
+  struct stat finfo;
+  if (fstat(b->base_fd, &finfo) != 0) {
+    perror("crash image: cannot fstat the base image");
+    return false;
+  }
+  if (b->delta_map != nullptr && b->delta_size == (size_t)finfo.st_size) {
+    return true;
+  }
+
+  if (b->delta_map != nullptr) {
+    munmap((void *)b->delta_map, b->delta_size);
+  }
+  b->delta_size = finfo.st_size;
+  b->delta_map = (const char *)mmap(0, b->delta_size, PROT_READ, MAP_SHARED,
+                                    b->base_fd, 0);
+  if (b->delta_map == MAP_FAILED) {
+    perror("crash image: cannot mmap the base image");
+    b->delta_map = nullptr;
+    return false;
+  }
+  return true;
+}
+
+// FNV-1a
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *)data;
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= p[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+extern "C" {
+
+void crash_image_builder_close(CrashImageBuilder *b);
+
+/// Open a builder for the base image at base_path.
+/// \return nullptr if the base image can't be opened.
+CrashImageBuilder *crash_image_builder_open(const char *base_path) {
+  int fd = open(base_path, O_RDONLY);
+  if (fd == -1) {
+    perror("crash image: cannot open the base image");
+    return nullptr;
+  }
+
+  CrashImageBuilder *b = new CrashImageBuilder();
+  b->base_path = base_path;
+  b->scratch_path = b->base_path + "-scratch";
+  b->base_fd = fd;
+  return b;
+}
+
+/// Open a builder for the base image at base_path whose crash images are a
+/// memfd, backed by hugepages if hugepages is not 0.
+/// \return nullptr if the base image can't be opened.
+CrashImageBuilder *crash_image_builder_open_memfd(const char *base_path,
+                                                  int hugepages) {
+  CrashImageBuilder *b = crash_image_builder_open(base_path);
+  if (b == nullptr) {
+    return nullptr;
+  }
+
+  b->reflink = false;
+  b->memfd = true;
+  b->hugepages = hugepages != 0;
+
+  // create the memfd now, so it can be inherited before the first build
+  struct stat finfo;
+  if (fstat(b->base_fd, &finfo) != 0 || initScratch(b, finfo.st_size) < 0) {
+    crash_image_builder_close(b);
+    return nullptr;
+  }
+  return b;
+}
+
+/// \return the memfd of the crash images, or -1 if they are not a memfd.
+int crash_image_memfd(CrashImageBuilder *b) {
+  return b->memfd ? b->scratch_fd : -1;
+}
+
+/// Build the crash image dst_path from the current content of the base image.
+/// A memfd crash image is rebuilt in place and dst_path is ignored.
+/// base_changed must not be 0 if the base was written since the last build.
+/// \return the number of pages copied for the image, 0 for a reflink, or -1
+/// on error.
+long crash_image_build(CrashImageBuilder *b, const char *dst_path,
+                       int base_changed) {
+  if (b->reflink) {
+    int ret = buildReflink(b, dst_path);
+    if (ret <= 0) {
+      return ret;
+    }
+  }
+  return buildScratch(b, dst_path, base_changed != 0);
+}
+
+/// Hash the delta that persisting the stores makes to the current base: the
+/// bytes the stores leave different from the base, in offset order. Store i
+/// writes sizes[i] bytes at offsets[i], its value is the next sizes[i] bytes
+/// of values, and later stores overwrite earlier ones. Crash plans with the
+/// same delta hash on the same base produce the same crash image.
+/// \return 0 on error, otherwise the hash and the number of changed bytes
+/// in *changed.
+uint64_t crash_image_delta_hash(CrashImageBuilder *b, size_t n,
+                                const uint64_t *offsets,
+                                const uint32_t *sizes, const char *values,
+                                uint64_t *changed) {
+  if (!mapDeltaBase(b)) {
+    return 0;
+  }
+
+  // the final value of each written byte
+  std::unordered_map<uint64_t, char> written;
+  for (size_t i = 0; i < n; ++i) {
+    if (offsets[i] + sizes[i] > b->delta_size) {
+      fprintf(stderr, "crash image: store out of the base image\n");
+      return 0;
+    }
+    for (uint32_t j = 0; j < sizes[i]; ++j) {
+      written[offsets[i] + j] = values[j];
+    }
+    values += sizes[i];
+  }
+
+  std::vector<std::pair<uint64_t, char>> delta;
+  for (const auto &w : written) {
+    if (b->delta_map[w.first] != w.second) {
+      delta.push_back(w);
+    }
+  }
+  std::sort(delta.begin(), delta.end());
+
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const auto &d : delta) {
+    hash = hashBytes(hash, &d.first, sizeof(d.first));
+    hash = hashBytes(hash, &d.second, sizeof(d.second));
+  }
+  *changed = delta.size();
+  // 0 is the error value
+  return hash == 0 ? 1 : hash;
+}
+
+/// \return 1 if the crash images are reflinks of the base, 0 if they are the
+/// scratch image.
+int crash_image_is_reflink(CrashImageBuilder *b) {
+  return b->reflink;
+}
+
+/// Close the builder and remove its scratch image.
+void crash_image_builder_close(CrashImageBuilder *b) {
+  bool scratch = b->scratch_fd != -1 && !b->memfd;
+  unmapScratch(b);
+  if (scratch) {
+    unlink(b->scratch_path.c_str());
+  }
+  if (b->memfd && b->scratch_fd != -1) {
+    close(b->scratch_fd);
+  }
+  if (b->delta_map != nullptr) {
+    munmap((void *)b->delta_map, b->delta_size);
+  }
+  close(b->base_fd);
+  delete b;
+}
+
+}
@@ -0,0 +1,53 @@
+//===- OpFileConverter.cpp - Convert a text op file to a binary one -------===//
+//
+//                          Witcher
+//
+//===----------------------------------------------------------------------===//
+//
+// This tool converts the text op file read by the benchmark mains to the
+// binary op file described in Witcher/WitcherOpFile.h. The mains read
+// <op file>.bin instead of <op file> when it is there and up to date.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/CommandLine.h"
+
+#include <iostream>
+#include <string>
+
+#include "Witcher/WitcherOpFile.h"
+
+using namespace llvm;
+
+static cl::opt<std::string>
+OpFilename(cl::Positional, cl::desc("op file name"), cl::Required);
+
+static cl::opt<std::string>
+BinFilename(cl::Positional, cl::desc("binary op file name"), cl::init(""));
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "Op File Converter\n");
+
+  std::string BinPath = BinFilename;
+  if (BinPath.empty()) {
+    BinPath = OpFilename + WITCHER_OP_FILE_SUFFIX;
+  }
+
+  struct witcher_ops ops;
+  if (witcher_ops_open(&ops, OpFilename.c_str()) != 0) {
+    return 1;
+  }
+  if (ops.mapped) {
+    // the binary op file is already up to date
+    witcher_ops_close(&ops);
+    return 0;
+  }
+  int ret = witcher_ops_write(&ops, BinPath.c_str());
+  if (ret != 0) {
+    std::cerr << "cannot write the binary op file " << BinPath << "\n";
+  } else {
+    std::cout << ops.header->num_ops << " ops written to " << BinPath << "\n";
+  }
+  witcher_ops_close(&ops);
+  return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+//===- OpGenerator.cpp - Generate benchmark op files ----------------------===//
+//
+//                          Witcher
+//
+//===----------------------------------------------------------------------===//
+//
+// This tool generates the op files run by the benchmark mains to measure the
+// indexes natively (see the bench target of Makefile.test.parallel.common).
+// The op file starts with a load phase inserting -load keys, followed by -n
+// ops mixing inserts of new keys with gets, updates and deletes of the keys
+// already inserted, picked with the key distribution -dist:
+//   uniform - every key inserted is equally likely
+//   zipf    - the scrambled zipfian distribution of YCSB, -theta skewed
+//   latest  - zipfian over the most recently inserted keys
+// The text op file is written with its binary op file (Witcher/WitcherOpFile.h).
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/CommandLine.h"
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "Witcher/WitcherOpFile.h"
+
+using namespace llvm;
+
+static cl::opt<std::string>
+OpFilename(cl::Positional, cl::desc("op file name"), cl::Required);
+
+static cl::opt<unsigned long long>
+NumLoadKeys("load", cl::desc("keys inserted before the ops"), cl::init(100000));
+
+static cl::opt<unsigned long long>
+NumOps("n", cl::desc("number of ops after the load phase"), cl::init(100000));
+
+static cl::opt<std::string>
+Dist("dist", cl::desc("key distribution: uniform, zipf or latest"),
+     cl::init("uniform"));
+
+static cl::opt<double>
+Theta("theta", cl::desc("skew of the zipf distributions"), cl::init(0.99));
+
+static cl::opt<unsigned>
+ReadPercent("reads", cl::desc("percentage of gets"), cl::init(50));
+
+static cl::opt<unsigned>
+UpdatePercent("updates", cl::desc("percentage of updates"), cl::init(0));
+
+static cl::opt<unsigned>
+DeletePercent("deletes", cl::desc("percentage of deletes"), cl::init(0));
+
+static cl::opt<std::string>
+UpdateOp("update-op", cl::desc("opcode of an update, 'i' for the indexes "
+                               "updating with an insert"),
+         cl::init("u"));
+
+static cl::opt<unsigned long long>
+Seed("seed", cl::desc("random seed"), cl::init(1));
+
+// keys are kept below 10^15 as in the random op files
+static const uint64_t KeySpace = 1000000000000000ULL;
+
+// Scrambled keys, so the hot keys of the zipf distributions are not
+// neighbours in the index
+static uint64_t keyOf(uint64_t Index) {
+  uint64_t X = Index + 0x9e3779b97f4a7c15ULL;
+  X = (X ^ (X >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  X = (X ^ (X >> 27)) * 0x94d049bb133111ebULL;
+  X ^= X >> 31;
+  return X % (KeySpace - 1) + 1;
+}
+
+// Zipfian over [0, N) (Gray et al., "Quickly generating billion-record
+// synthetic databases"), as in YCSB
+class ZipfGenerator {
+  uint64_t N;
+  double Theta, Alpha, ZetaN, Eta;
+
+  static double zeta(uint64_t N, double Theta) {
+    double Sum = 0;
+    for (uint64_t I = 1; I <= N; I++) {
+      Sum += 1 / pow((double)I, Theta);
+    }
+    return Sum;
+  }
+
+public:
+  ZipfGenerator(uint64_t N, double Theta) : N(N), Theta(Theta) {
+    Alpha = 1 / (1 - Theta);
+    ZetaN = zeta(N, Theta);
+    Eta = (1 - pow(2.0 / N, 1 - Theta)) / (1 - zeta(2, Theta) / ZetaN);
+  }
+
+  template <class RNG> uint64_t next(RNG &Rand) {
+    double U = std::uniform_real_distribution<double>(0, 1)(Rand);
+    double UZ = U * ZetaN;
+    if (UZ < 1) {
+      return 0;
+    }
+    if (UZ < 1 + pow(0.5, Theta)) {
+      return 1;
+    }
+    return (uint64_t)(N * pow(Eta * U - Eta + 1, Alpha)) % N;
+  }
+};
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "Op Generator\n");
+
+  if (ReadPercent + UpdatePercent + DeletePercent > 100) {
+    std::cerr << "more than 100% of gets, updates and deletes\n";
+    return 1;
+  }
+  if (Dist != "uniform" && Dist != "zipf" && Dist != "latest") {
+    std::cerr << "unknown key distribution " << Dist << "\n";
+    return 1;
+  }
+
+  std::mt19937_64 Rand(Seed);
+  std::uniform_int_distribution<unsigned> Percent(0, 99);
+  uint64_t MaxKeys = NumLoadKeys + NumOps;
+  ZipfGenerator Zipf(std::max<uint64_t>(MaxKeys, 2), Theta);
+
+  std::string Text;
+  uint64_t NumKeys = 0;
+  auto insert = [&]() {
+    uint64_t Key = keyOf(NumKeys++);
+    Text += "i;" + std::to_string(Key) + ";" +
+            std::to_string(Rand() % KeySpace) + ";\n";
+  };
+  // a key already inserted
+  auto pick = [&]() {
+    uint64_t Index;
+    if (Dist == "uniform") {
+      Index = Rand() % NumKeys;
+    } else if (Dist == "zipf") {
+      Index = Zipf.next(Rand) % NumKeys;
+    } else {
+      Index = NumKeys - 1 - Zipf.next(Rand) % NumKeys;
+    }
+    return std::to_string(keyOf(Index));
+  };
+
+  for (uint64_t I = 0; I < NumLoadKeys; I++) {
+    insert();
+  }
+  for (uint64_t I = 0; I < NumOps; I++) {
+    unsigned P = Percent(Rand);
+    if (NumKeys == 0 || P >= ReadPercent + UpdatePercent + DeletePercent) {
+      insert();
+    } else if (P < ReadPercent) {
+      Text += "g;" + pick() + ";\n";
+    } else if (P < ReadPercent + UpdatePercent) {
+      Text += UpdateOp + ";" + pick() + ";" +
+              std::to_string(Rand() % KeySpace) + ";\n";
+    } else {
+      Text += "d;" + pick() + ";\n";
+    }
+  }
+
+  FILE *OpFile = fopen(OpFilename.c_str(), "w");
+  if (OpFile == NULL ||
+      fwrite(Text.data(), 1, Text.size(), OpFile) != Text.size() ||
+      fclose(OpFile) != 0) {
+    std::cerr << "cannot write the op file " << OpFilename << "\n";
+    return 1;
+  }
+
+  struct witcher_ops Ops;
+  memset(&Ops, 0, sizeof Ops);
+  Ops.image_size = witcher_ops_convert(Text.data(), Text.size(), &Ops.image);
+  Ops.header = (struct witcher_op_file_header *)Ops.image;
+  std::string BinPath = OpFilename + WITCHER_OP_FILE_SUFFIX;
+  int Ret = witcher_ops_write(&Ops, BinPath.c_str());
+  witcher_ops_close(&Ops);
+  if (Ret != 0) {
+    std::cerr << "cannot write the binary op file " << BinPath << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,396 @@
+//===- PMCache.cpp - Native cache-line persistence simulator -------------===//
+//
+//                          Witcher
+//
+//===----------------------------------------------------------------------===//
+//
+// This library is the native version of WitcherCache. It loads the atomic
+// write ops of a binary PM trace (see Witcher/PMTraceBin.h) and simulates
+// the persistence domain of the replay PM image: stores wait in the cache
+// until a flush of their cacheline and the next fence write them back to the
+// image. It is loaded by replay/engines/witcher/nativecache.py through ctypes.
+//
+// The cachelines live in an open-addressed table. Each cacheline keeps its
+// pending stores in order in a ring: a flush marks every pending store of the
+// line as flushing, so the flushing stores are always a prefix of the ring and
+// a fence only advances its head. The stores of the same cacheline up to a
+// store X (the stores persisted with the crash plan X) are the ring from the
+// head to X, returned without copying.
+//
+// Op indexes are the indexes of WitcherTrace.atomic_write_ops.
+//
+//===----------------------------------------------------------------------===//
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "Witcher/PMTraceBinReader.h"
+
+using namespace witcher;
+
+// Keep in sync with CACHELINE_BYTES in replay/mem/cachenumbers.py
+#define PM_CACHE_LINE_BYTES 64
+#define PM_CACHE_NO_LINE UINT64_MAX
+#define PM_CACHE_NO_POS UINT32_MAX
+
+namespace {
+
+enum StoreState : uint8_t { Clear = 0, Flushing = 1, Fenced = 2 };
+
+struct Op {
+  PMTraceBinType type;
+  uint32_t size;
+  uint64_t address;
+  // offset of the value in PMCache::values, for an AtomicStore
+  uint64_t value;
+};
+
+struct Cacheline {
+  uint64_t address;
+  // pending stores in order, the ring starts at head
+  std::vector<uint32_t> stores;
+  uint32_t head;
+  // the stores before flushed are flushing
+  uint32_t flushed;
+  // the line is in PMCache::flushed_lines
+  bool in_flushed_lines;
+};
+
+struct Slot {
+  uint64_t address;
+  uint32_t line;
+};
+
+} // namespace
+
+struct PMCache {
+  std::vector<Op> ops;
+  std::vector<uint8_t> values;
+
+  // state of each store op and, while it is pending, its position in the
+  // ring of its cacheline
+  std::vector<uint8_t> state;
+  std::vector<uint32_t> line_of;
+  std::vector<uint32_t> pos;
+
+  // open-addressed cacheline table, the lines are reused after a write back
+  // of all stores
+  std::vector<Slot> table;
+  std::vector<uint32_t> used_slots;
+  std::vector<Cacheline> lines;
+  uint32_t num_lines = 0;
+  // lines with flushing stores, written back at the next fence
+  std::vector<uint32_t> flushed_lines;
+
+  // the replay PM image
+  int fd = -1;
+  uint8_t *image = nullptr;
+  size_t image_size = 0;
+  uint64_t map_base = 0;
+};
+
+// Load the atomic write ops of the binary PM trace at path, numbered as in
+// extract_operations_bin
+static bool loadTrace(PMCache *c, const char *path) {
+  PMTraceBinReader reader("pm cache: ");
+  if (!reader.open(path)) {
+    return false;
+  }
+  // only the chunks of the store values are ops
+  return reader.forEach([&](const PMTraceBinRecord &r, const char *value) {
+    Op op;
+    op.type = r.type;
+    op.size = r.size;
+    op.address = r.address;
+    op.value = 0;
+    if (r.type == PMTraceBinType::AtomicStore) {
+      op.value = c->values.size();
+      c->values.insert(c->values.end(), value, value + r.size);
+    } else if (r.type == PMTraceBinType::Flush) {
+      op.address -= op.address % PM_CACHE_LINE_BYTES;
+    }
+    c->ops.push_back(op);
+  });
+}
+
+static bool mapImage(PMCache *c, const char *path) {
+  c->fd = open(path, O_RDWR);
+  if (c->fd < 0) {
+    perror("pm cache: cannot open the pm image");
+    return false;
+  }
+  struct stat st;
+  if (fstat(c->fd, &st) < 0) {
+    perror("pm cache: cannot stat the pm image");
+    return false;
+  }
+  c->image_size = st.st_size;
+  void *map = mmap(nullptr, c->image_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   c->fd, 0);
+  if (map == MAP_FAILED) {
+    perror("pm cache: cannot map the pm image");
+    return false;
+  }
+  c->image = (uint8_t *)map;
+  return true;
+}
+
+static inline uint64_t hashLine(uint64_t address) {
+  return (address / PM_CACHE_LINE_BYTES) * 0x9e3779b97f4a7c15ULL;
+}
+
+static void growTable(PMCache *c) {
+  std::vector<Slot> old;
+  old.swap(c->table);
+  c->table.assign(old.empty() ? 1024 : old.size() * 2,
+                  Slot{PM_CACHE_NO_LINE, 0});
+  c->used_slots.clear();
+  size_t mask = c->table.size() - 1;
+  for (const Slot &s : old) {
+    if (s.address == PM_CACHE_NO_LINE) {
+      continue;
+    }
+    size_t i = hashLine(s.address) & mask;
+    while (c->table[i].address != PM_CACHE_NO_LINE) {
+      i = (i + 1) & mask;
+    }
+    c->table[i] = s;
+    c->used_slots.push_back(i);
+  }
+}
+
+// Find the cacheline of address, create one if not having
+static uint32_t getLine(PMCache *c, uint64_t address) {
+  uint64_t line_address = address - address % PM_CACHE_LINE_BYTES;
+  if ((c->num_lines + 1) * 2 > c->table.size()) {
+    growTable(c);
+  }
+  size_t mask = c->table.size() - 1;
+  size_t i = hashLine(line_address) & mask;
+  while (c->table[i].address != PM_CACHE_NO_LINE) {
+    if (c->table[i].address == line_address) {
+      return c->table[i].line;
+    }
+    i = (i + 1) & mask;
+  }
+
+  uint32_t line = c->num_lines++;
+  if (line == c->lines.size()) {
+    c->lines.emplace_back();
+  }
+  Cacheline &l = c->lines[line];
+  l.address = line_address;
+  l.stores.clear();
+  l.head = 0;
+  l.flushed = 0;
+  l.in_flushed_lines = false;
+  c->table[i] = Slot{line_address, line};
+  c->used_slots.push_back(i);
+  return line;
+}
+
+static inline void writeBack(PMCache *c, uint32_t store) {
+  const Op &op = c->ops[store];
+  uint64_t off = op.address - c->map_base;
+  if (off + op.size <= c->image_size) {
+    memcpy(c->image + off, &c->values[op.value], op.size);
+  }
+  c->state[store] = Fenced;
+  c->pos[store] = PM_CACHE_NO_POS;
+}
+
+// Drop the written back stores at the head of a ring once they are the
+// larger part of it, so a line that is never empty stays small
+static void compactLine(PMCache *c, Cacheline &l) {
+  if (l.head == l.stores.size()) {
+    l.stores.clear();
+    l.flushed = 0;
+    l.head = 0;
+    return;
+  }
+  if (l.head < 64 || l.head * 2 < l.stores.size()) {
+    return;
+  }
+  l.stores.erase(l.stores.begin(), l.stores.begin() + l.head);
+  l.flushed -= l.head;
+  l.head = 0;
+  for (uint32_t i = 0; i < l.stores.size(); i++) {
+    c->pos[l.stores[i]] = i;
+  }
+}
+
+static void acceptStore(PMCache *c, uint32_t store) {
+  uint32_t line = getLine(c, c->ops[store].address);
+  Cacheline &l = c->lines[line];
+  c->state[store] = Clear;
+  c->line_of[store] = line;
+  c->pos[store] = l.stores.size();
+  l.stores.push_back(store);
+}
+
+static void acceptFlush(PMCache *c, uint32_t flush) {
+  uint32_t line = getLine(c, c->ops[flush].address);
+  Cacheline &l = c->lines[line];
+  for (uint32_t i = l.flushed; i < l.stores.size(); i++) {
+    c->state[l.stores[i]] = Flushing;
+  }
+  l.flushed = l.stores.size();
+  if (l.flushed > l.head && !l.in_flushed_lines) {
+    l.in_flushed_lines = true;
+    c->flushed_lines.push_back(line);
+  }
+}
+
+// return true when it is a fence
+static bool accept(PMCache *c, uint32_t op) {
+  switch (c->ops[op].type) {
+  case PMTraceBinType::AtomicStore:
+    acceptStore(c, op);
+    return false;
+  case PMTraceBinType::Flush:
+    acceptFlush(c, op);
+    return false;
+  case PMTraceBinType::Fence:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static void writeBackFlushingStores(PMCache *c) {
+  for (uint32_t line : c->flushed_lines) {
+    Cacheline &l = c->lines[line];
+    for (uint32_t i = l.head; i < l.flushed; i++) {
+      writeBack(c, l.stores[i]);
+    }
+    l.head = l.flushed;
+    l.in_flushed_lines = false;
+    compactLine(c, l);
+  }
+  c->flushed_lines.clear();
+}
+
+static void writeBackAllStores(PMCache *c) {
+  for (uint32_t line = 0; line < c->num_lines; line++) {
+    Cacheline &l = c->lines[line];
+    for (uint32_t i = l.head; i < l.stores.size(); i++) {
+      writeBack(c, l.stores[i]);
+    }
+  }
+  for (uint32_t i : c->used_slots) {
+    c->table[i].address = PM_CACHE_NO_LINE;
+  }
+  c->used_slots.clear();
+  c->flushed_lines.clear();
+  c->num_lines = 0;
+}
+
+extern "C" {
+
+/// Load the binary PM trace at trace_path and map the replay PM image at
+/// pm_path, whose offset 0 is the PM address map_base.
+/// \return nullptr if the trace or the image can't be loaded.
+PMCache *pm_cache_open(const char *trace_path, const char *pm_path,
+                       uint64_t map_base) {
+  PMCache *c = new PMCache();
+  c->map_base = map_base;
+  if (!loadTrace(c, trace_path) || !mapImage(c, pm_path)) {
+    if (c->image != nullptr) {
+      munmap(c->image, c->image_size);
+    }
+    if (c->fd >= 0) {
+      close(c->fd);
+    }
+    delete c;
+    return nullptr;
+  }
+  c->state.assign(c->ops.size(), Clear);
+  c->line_of.assign(c->ops.size(), 0);
+  c->pos.assign(c->ops.size(), PM_CACHE_NO_POS);
+  return c;
+}
+
+size_t pm_cache_num_ops(PMCache *c) {
+  return c->ops.size();
+}
+
+/// Accept the op, as WitcherCache.accept.
+/// \return 1 if it is a fence, 0 otherwise.
+int pm_cache_accept(PMCache *c, size_t op) {
+  return accept(c, op) ? 1 : 0;
+}
+
+/// Accept the ops from begin until a fence or end.
+/// \return the index of the fence, or end if there is no fence.
+size_t pm_cache_accept_until_fence(PMCache *c, size_t begin, size_t end) {
+  for (size_t op = begin; op < end; op++) {
+    if (accept(c, op)) {
+      return op;
+    }
+  }
+  return end;
+}
+
+/// Replay the ops [begin, end) without crashing: the flushing stores are
+/// written back at each fence, and all stores at each TXEnd and right before
+/// the first TXStart first_tx_start.
+void pm_cache_replay(PMCache *c, size_t begin, size_t end,
+                     size_t first_tx_start) {
+  for (size_t op = begin; op < end; op++) {
+    if (accept(c, op)) {
+      writeBackFlushingStores(c);
+    }
+    if (c->ops[op].type == PMTraceBinType::TXEnd ||
+        op + 1 == first_tx_start) {
+      writeBackAllStores(c);
+    }
+  }
+}
+
+void pm_cache_write_back_flushing_stores(PMCache *c) {
+  writeBackFlushingStores(c);
+}
+
+void pm_cache_write_back_all_stores(PMCache *c) {
+  writeBackAllStores(c);
+}
+
+/// \return the state of a store: 0 clear, 1 flushing, 2 fenced.
+int pm_cache_store_state(PMCache *c, size_t store) {
+  return c->state[store];
+}
+
+/// Get the pending stores of the cacheline of a store up to the store itself.
+/// \return the number of stores, *stores points to them until the next op is
+/// accepted or written back, or 0 if the store is not pending.
+size_t pm_cache_stores_before(PMCache *c, size_t store,
+                              const uint32_t **stores) {
+  uint32_t pos = c->pos[store];
+  if (pos == PM_CACHE_NO_POS) {
+    *stores = nullptr;
+    return 0;
+  }
+  Cacheline &l = c->lines[c->line_of[store]];
+  *stores = l.stores.data() + l.head;
+  return pos - l.head + 1;
+}
+
+/// Write the PM image back to its file.
+void pm_cache_flush(PMCache *c) {
+  msync(c->image, c->image_size, MS_SYNC);
+}
+
+void pm_cache_close(PMCache *c) {
+  munmap(c->image, c->image_size);
+  close(c->fd);
+  delete c;
+}
+
+} // extern "C"
@@ -0,0 +1,370 @@
+//===- PersistCost.cpp - Flush and fence cost report of a PM trace --------===//
+//
+//                          Witcher
+//
+//===----------------------------------------------------------------------===//
+//
+// This tool estimates the time spent persisting in a binary PM trace (see
+// Witcher/PMTraceBin.h) with a simple cost model, and ranks the flushes and
+// fences by source location, so the costliest redundant ones (the
+// extra_flushes and extra_fences of WitcherTC) can be removed first.
+//
+// The trace has a single flush kind, -flush picks the instruction it is
+// costed as:
+//   clflush    - serializing: each flush waits for its write back
+//                (-clflush-ns), a fence only costs -fence-ns
+//   clflushopt - the write backs of a thread overlap and are waited for by
+//   clwb         its next fence, -lines-per-fence at a time: the fence costs
+//                -fence-ns plus ceil(flushed lines / -lines-per-fence) write
+//                backs (-clflushopt-ns or -clwb-ns), the write backs being
+//                charged to the flushes
+// As in WitcherTC, a flush is redundant when its cacheline holds no store
+// which is not flushed yet, and a fence is redundant when its thread flushed
+// no store since its last fence. The cachelines are shared by the threads,
+// a fence only writes back the stores flushed by its own thread.
+//
+// The estimated time is reported per operation type (flush or fence, in the
+// application or in a PMDK function) and per source location, ranked by
+// redundant time (-sort=total to rank by total time).
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/CommandLine.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Witcher/PMTraceBinReader.h"
+
+using namespace llvm;
+using namespace witcher;
+
+static cl::opt<std::string>
+TraceFilename(cl::Positional, cl::desc("binary PM trace file name"),
+              cl::Required);
+
+static cl::opt<std::string>
+FlushInst("flush", cl::desc("flush instruction: clflush, clflushopt or clwb"),
+          cl::init("clwb"));
+
+static cl::opt<double>
+ClflushNs("clflush-ns", cl::desc("write back latency of a clflush (ns)"),
+          cl::init(250));
+
+static cl::opt<double>
+ClflushoptNs("clflushopt-ns",
+             cl::desc("write back latency of a clflushopt (ns)"),
+             cl::init(110));
+
+static cl::opt<double>
+ClwbNs("clwb-ns", cl::desc("write back latency of a clwb (ns)"),
+       cl::init(100));
+
+static cl::opt<double>
+FenceNs("fence-ns", cl::desc("cost of a fence without write back (ns)"),
+        cl::init(20));
+
+static cl::opt<unsigned>
+LinesPerFence("lines-per-fence",
+              cl::desc("write backs overlapping at a fence, for clflushopt "
+                       "and clwb"),
+              cl::init(4));
+
+static cl::opt<bool>
+TXOnly("tx-only", cl::desc("only cost the ops between witcher_tx_begin and "
+                           "witcher_tx_end, as WitcherTC"),
+       cl::init(false));
+
+static cl::opt<std::string>
+SortBy("sort", cl::desc("rank the source locations by redundant or total "
+                        "time"),
+       cl::init("redundant"));
+
+static cl::opt<unsigned>
+Top("top", cl::desc("number of source locations reported, 0 for all"),
+    cl::init(30));
+
+// Keep in sync with CACHELINE_BYTES in replay/mem/cachenumbers.py
+#define PM_COST_LINE_BYTES 64
+
+namespace {
+
+enum OpKind { FlushOp = 0, FenceOp = 1 };
+
+struct Cost {
+  uint64_t count = 0;
+  uint64_t redundant = 0;
+  double ns = 0;
+  double redundant_ns = 0;
+};
+
+// Stores of a cacheline not fenced yet
+struct Line {
+  uint32_t clear = 0;
+  uint32_t flushing = 0;
+};
+
+// A flush waiting for its write back at the next fence of its thread
+struct PendingFlush {
+  uint32_t src;
+  uint32_t context;
+  bool redundant;
+};
+
+struct Thread {
+  // PMDK functions being run, as string ids
+  std::vector<uint32_t> calls;
+  std::vector<PendingFlush> flushes;
+  // stores flushed by the thread per cacheline, written back at its next
+  // fence
+  std::unordered_map<uint64_t, uint32_t> flushedLines;
+};
+
+} // namespace
+
+// String table of the trace
+static std::vector<std::string> Strs;
+// Cost per (source location, kind) and per (PMDK function or
+// application, kind)
+static std::vector<Cost> LocCosts;
+static std::map<std::pair<std::string, unsigned>, Cost> TypeCosts;
+
+static std::unordered_map<uint64_t, Line> Lines;
+static std::unordered_map<uint64_t, Thread> Threads;
+
+static bool Serializing;
+static double WriteBackNs;
+
+static const uint32_t NoContext = UINT32_MAX;
+
+// Add count ops costing ns to a source location and an operation type
+static void charge(uint32_t src, uint32_t context, OpKind kind, unsigned count,
+                   double ns, bool redundant) {
+  Cost &loc = LocCosts[src * 2 + kind];
+  Cost &type = TypeCosts[std::make_pair(
+      context == NoContext ? std::string("application") : Strs[context], kind)];
+  for (Cost *c : {&loc, &type}) {
+    c->count += count;
+    c->ns += ns;
+    if (redundant) {
+      c->redundant += count;
+      c->redundant_ns += ns;
+    }
+  }
+}
+
+// The write backs of the flushes of a thread overlap, LinesPerFence at a
+// time, and are shared by the flushes
+static void drainFlushes(Thread &t) {
+  if (t.flushes.empty()) {
+    return;
+  }
+  size_t n = t.flushes.size();
+  double drain = (n + LinesPerFence - 1) / LinesPerFence * WriteBackNs;
+  for (const PendingFlush &f : t.flushes) {
+    charge(f.src, f.context, FlushOp, 0, drain / n, f.redundant);
+  }
+  t.flushes.clear();
+}
+
+static void processStore(const PMTraceBinRecord &r) {
+  // an atomic write never crosses a cacheline
+  Lines[r.address / PM_COST_LINE_BYTES].clear++;
+}
+
+static void processFlush(const PMTraceBinRecord &r, Thread &t) {
+  uint32_t context = t.calls.empty() ? NoContext : t.calls.back();
+  uint64_t address = r.address / PM_COST_LINE_BYTES;
+  auto it = Lines.find(address);
+  bool redundant = it == Lines.end() || it->second.clear == 0;
+  if (!redundant) {
+    t.flushedLines[address] += it->second.clear;
+    it->second.flushing += it->second.clear;
+    it->second.clear = 0;
+  }
+
+  if (Serializing) {
+    charge(r.src, context, FlushOp, 1, WriteBackNs, redundant);
+  } else {
+    charge(r.src, context, FlushOp, 1, 0, redundant);
+    t.flushes.push_back(PendingFlush{r.src, context, redundant});
+  }
+}
+
+static void processFence(const PMTraceBinRecord &r, Thread &t) {
+  uint32_t context = t.calls.empty() ? NoContext : t.calls.back();
+  bool redundant = t.flushedLines.empty();
+  for (const auto &flushed : t.flushedLines) {
+    auto it = Lines.find(flushed.first);
+    it->second.flushing -= flushed.second;
+    if (it->second.clear == 0 && it->second.flushing == 0) {
+      Lines.erase(it);
+    }
+  }
+  t.flushedLines.clear();
+
+  charge(r.src, context, FenceOp, 1, FenceNs, redundant);
+  drainFlushes(t);
+}
+
+static bool run(const char *path) {
+  PMTraceBinReader reader;
+  if (!reader.open(path)) {
+    return false;
+  }
+  Strs = reader.strs();
+  LocCosts.resize(Strs.size() * 2);
+
+  bool inTX = false;
+  // only the atomic writes of the stores are costed
+  return reader.forEach([&](const PMTraceBinRecord &r, const char *) {
+    Thread &t = Threads[r.tid];
+    switch (r.type) {
+    case PMTraceBinType::TXStart:
+      inTX = true;
+      break;
+    case PMTraceBinType::TXEnd:
+      inTX = false;
+      break;
+    case PMTraceBinType::PMDKCallStart:
+      t.calls.push_back(r.aux);
+      break;
+    case PMTraceBinType::PMDKCallEnd:
+      if (!t.calls.empty()) {
+        t.calls.pop_back();
+      }
+      break;
+    case PMTraceBinType::AtomicStore:
+      if (inTX || !TXOnly) {
+        processStore(r);
+      }
+      break;
+    case PMTraceBinType::Flush:
+      if (inTX || !TXOnly) {
+        processFlush(r, t);
+      }
+      break;
+    case PMTraceBinType::Fence:
+      if (inTX || !TXOnly) {
+        processFence(r, t);
+      }
+      break;
+    default:
+      break;
+    }
+  });
+}
+
+static void printHeader(const char *first) {
+  printf("%-40s %10s %10s %12s %14s %6s\n", first, "count", "redundant",
+         "time (us)", "redundant (us)", "%");
+}
+
+static void printCost(const std::string &name, const Cost &c, double total) {
+  printf("%-40s %10lu %10lu %12.1f %14.1f %6.1f\n", name.c_str(),
+         (unsigned long)c.count, (unsigned long)c.redundant, c.ns / 1000,
+         c.redundant_ns / 1000, total > 0 ? c.ns * 100 / total : 0.0);
+}
+
+static void report() {
+  static const char *KindNames[] = {"flush", "fence"};
+
+  Cost total;
+  for (const Cost &c : LocCosts) {
+    total.count += c.count;
+    total.redundant += c.redundant;
+    total.ns += c.ns;
+    total.redundant_ns += c.redundant_ns;
+  }
+
+  printf("flush: %s, write back %.0f ns, fence %.0f ns", FlushInst.c_str(),
+         WriteBackNs, (double)FenceNs);
+  if (!Serializing) {
+    printf(", %u lines per fence", (unsigned)LinesPerFence);
+  }
+  printf("\nestimated persistence time: %.1f us, redundant: %.1f us\n\n",
+         total.ns / 1000, total.redundant_ns / 1000);
+
+  printf("By operation type\n");
+  printHeader("type");
+  std::vector<std::pair<std::string, Cost>> types;
+  for (const auto &it : TypeCosts) {
+    types.emplace_back(std::string(KindNames[it.first.second]) + " in " +
+                       it.first.first, it.second);
+  }
+  std::stable_sort(types.begin(), types.end(),
+                   [](const std::pair<std::string, Cost> &a,
+                      const std::pair<std::string, Cost> &b) {
+                     return a.second.ns > b.second.ns;
+                   });
+  for (const auto &it : types) {
+    printCost(it.first, it.second, total.ns);
+  }
+
+  bool byTotal = SortBy == "total";
+  std::vector<uint32_t> locs;
+  for (uint32_t i = 0; i < LocCosts.size(); i++) {
+    if (LocCosts[i].count > 0) {
+      locs.push_back(i);
+    }
+  }
+  std::stable_sort(locs.begin(), locs.end(), [byTotal](uint32_t a,
+                                                       uint32_t b) {
+    const Cost &ca = LocCosts[a], &cb = LocCosts[b];
+    if (!byTotal && ca.redundant_ns != cb.redundant_ns) {
+      return ca.redundant_ns > cb.redundant_ns;
+    }
+    return ca.ns > cb.ns;
+  });
+  if (Top > 0 && locs.size() > Top) {
+    locs.resize(Top);
+  }
+
+  printf("\nBy source location, ranked by %s time\n",
+         byTotal ? "total" : "redundant");
+  printHeader("location");
+  for (uint32_t i : locs) {
+    printCost(Strs[i / 2] + " (" + KindNames[i % 2] + ")", LocCosts[i],
+              total.ns);
+  }
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "PM Persist Cost\n");
+
+  if (FlushInst == "clflush") {
+    Serializing = true;
+    WriteBackNs = ClflushNs;
+  } else if (FlushInst == "clflushopt") {
+    WriteBackNs = ClflushoptNs;
+  } else if (FlushInst == "clwb") {
+    WriteBackNs = ClwbNs;
+  } else {
+    fprintf(stderr, "unknown flush instruction %s\n", FlushInst.c_str());
+    return 1;
+  }
+  if (LinesPerFence == 0) {
+    fprintf(stderr, "-lines-per-fence must be at least 1\n");
+    return 1;
+  }
+  if (SortBy != "redundant" && SortBy != "total") {
+    fprintf(stderr, "unknown ranking %s\n", SortBy.c_str());
+    return 1;
+  }
+
+  if (!run(TraceFilename.c_str())) {
+    return 1;
+  }
+  // the flushes never fenced still wait for their write backs
+  for (auto &it : Threads) {
+    drainFlushes(it.second);
+  }
+  report();
+  return 0;
+}
@@ -0,0 +1,545 @@
+//===- TCCheck.cpp - Streaming WitcherTC performance bug checker ----------===//
+//
+//                          Witcher
+//
+//===----------------------------------------------------------------------===//
+//
+// This tool is the native version of the WitcherTC replay engine
+// (replay/engines/witchertc/witchertcengine.py). It streams the atomic write
+// ops of a binary PM trace (see Witcher/PMTraceBin.h) and writes the same
+// files to the output directory: unfluhsed_stores, extra_flushes,
+// extra_fences, unlogged_stores, extra_logs, unTXed_stores and summary.
+//
+// The engine keeps every store not fenced yet in a list scanned on each
+// flush and fence. Here the pending stores are only counted per cacheline:
+// the stores of a line are flushed and fenced in order, so a line keeps the
+// op index below which its stores are flushed and the one below which they
+// are fenced. A flush only looks at its line and a fence at the lines
+// flushed since the last fence. The stores still pending at a TX start are
+// found among the stores of the previous TX only, as the older ones were
+// already reported. The PMDK logs of a TX are kept as a union of ranges.
+//
+// As in the engine, only the ops of the witcher TXs are checked, and the TXs
+// longer than -max-tx-ops ops are skipped. The entries of a file are written
+// in trace order.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/CommandLine.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Witcher/PMTraceBinReader.h"
+
+using namespace llvm;
+using namespace witcher;
+
+static cl::opt<std::string>
+TraceFilename(cl::Positional, cl::desc("binary PM trace file name"),
+              cl::Required);
+
+static cl::opt<std::string>
+OutputDir("o", cl::desc("output directory"), cl::init("tc"));
+
+static cl::opt<unsigned long long>
+MaxTXOps("max-tx-ops", cl::desc("skip the TXs with more ops, 0 for none"),
+         cl::init(90000));
+
+static cl::opt<bool>
+DumpOps("dump-ops", cl::desc("also write the atomic write ops to "
+                             "atmoic_write.pmtrace"),
+        cl::init(false));
+
+// Keep in sync with CACHELINE_BYTES in replay/mem/cachenumbers.py
+#define TC_LINE_BYTES 64
+
+namespace {
+
+// An atomic write op, numbered as in WitcherTrace.atomic_write_ops
+struct Op {
+  uint64_t id;
+  PMTraceBinType type;
+  uint64_t tid;
+  uint32_t src;
+  uint32_t size;
+  uint64_t address;
+  uint64_t aux;
+  uint8_t value[AtomicWriteBytes];
+};
+
+// Stores of a cacheline not fenced yet
+struct Line {
+  uint32_t clear;
+  uint32_t flushing;
+  // the stores of the line below these op indexes are flushed and fenced
+  uint64_t flushed_up_to;
+  uint64_t fenced_up_to;
+  bool in_flushed_lines;
+};
+
+// Union of the ranges logged in a PMDK TX
+class LogRanges {
+  // disjoint [start, end) ranges, which may touch
+  std::map<uint64_t, uint64_t> ranges;
+  // the empty ranges, which still overlap the ranges strictly around them
+  std::set<uint64_t> points;
+
+public:
+  // Same as range_cmp(op, log) == 0 for one of the logs
+  bool overlaps(uint64_t start, uint64_t end) const {
+    auto it = ranges.lower_bound(end);
+    if (it != ranges.begin() && (--it)->second > start) {
+      return true;
+    }
+    auto pt = points.upper_bound(start);
+    return pt != points.end() && *pt < end;
+  }
+
+  void add(uint64_t start, uint64_t end) {
+    if (start == end) {
+      points.insert(start);
+      return;
+    }
+    // merge the ranges overlapping [start, end)
+    auto it = ranges.lower_bound(end);
+    while (it != ranges.begin()) {
+      auto prev = std::prev(it);
+      if (prev->second <= start) {
+        break;
+      }
+      start = std::min(start, prev->first);
+      end = std::max(end, prev->second);
+      it = ranges.erase(prev);
+    }
+    ranges[start] = end;
+  }
+
+  void clear() {
+    ranges.clear();
+    points.clear();
+  }
+};
+
+struct PMDKState {
+  bool in_tx = false;
+  unsigned nested_txs = 0;
+  std::vector<uint32_t> calls;
+};
+
+} // namespace
+
+static PMTraceBinReader Reader;
+static std::vector<std::string> Strs;
+static uint32_t TXBeginStr = UINT32_MAX, TXEndStr = UINT32_MAX;
+
+// Whether each complete witcher TX is checked
+static std::vector<bool> CheckTX;
+
+static std::unordered_map<uint64_t, Line> Lines;
+static std::vector<uint64_t> FlushedLines;
+// stores since the last TX start
+static std::vector<Op> NewStores;
+
+static std::vector<Op> UnflushedStores, ExtraFlushes, ExtraFences,
+                       UnloggedStores, ExtraLogs, UnTXedStores;
+
+static bool openTrace(const char *path) {
+  if (!Reader.open(path)) {
+    return false;
+  }
+  Strs = Reader.strs();
+  for (uint32_t i = 0; i < Strs.size(); i++) {
+    if (Strs[i] == "pmemobj_tx_begin") {
+      TXBeginStr = i;
+    } else if (Strs[i] == "pmemobj_tx_end") {
+      TXEndStr = i;
+    }
+  }
+  return true;
+}
+
+// Call f on each atomic write op of the trace, in order
+template <class F> static bool forEachOp(F f) {
+  // only the chunks of the store values are ops
+  uint64_t id = 0;
+  return Reader.forEach([&](const PMTraceBinRecord &r, const char *value) {
+    Op op;
+    op.id = id++;
+    op.type = r.type;
+    op.tid = r.tid;
+    op.src = r.src;
+    op.size = r.size;
+    op.address = r.address;
+    op.aux = r.aux;
+    if (r.type == PMTraceBinType::AtomicStore) {
+      memcpy(op.value, value, r.size);
+    } else if (r.type == PMTraceBinType::Flush) {
+      op.address -= op.address % TC_LINE_BYTES;
+      op.size = TC_LINE_BYTES;
+    }
+    f(op);
+  });
+}
+
+// Same as witcher_tx_ranges: the TXs are the ops from a TXStart up to, but
+// not including, the next TXEnd
+template <class F> static bool forEachTXOp(F f) {
+  size_t tx = 0;
+  bool inTX = false;
+  return forEachOp([&](const Op &op) {
+    if (op.type == PMTraceBinType::TXStart) {
+      inTX = tx < CheckTX.size() && CheckTX[tx];
+      tx++;
+    } else if (op.type == PMTraceBinType::TXEnd) {
+      inTX = false;
+    }
+    if (inTX) {
+      f(op);
+    }
+  });
+}
+
+// Collect the TXs and pick the ones checked
+static bool scanTXs() {
+  bool started = false;
+  uint64_t start = 0;
+  return forEachOp([&](const Op &op) {
+    if (op.type == PMTraceBinType::TXStart) {
+      if (started) {
+        fprintf(stderr, "warning: nested witcher TX at op %lu\n",
+                (unsigned long)op.id);
+      }
+      started = true;
+      start = op.id;
+    } else if (op.type == PMTraceBinType::TXEnd && started) {
+      started = false;
+      CheckTX.push_back(MaxTXOps == 0 || op.id - start <= MaxTXOps);
+    }
+  });
+}
+
+// Python repr of the value bytes of a store
+static std::string bytesRepr(const uint8_t *value, uint32_t size) {
+  bool single = false, dbl = false;
+  for (uint32_t i = 0; i < size; i++) {
+    single |= value[i] == '\'';
+    dbl |= value[i] == '"';
+  }
+  char quote = single && !dbl ? '"' : '\'';
+  std::string s = "b";
+  s += quote;
+  for (uint32_t i = 0; i < size; i++) {
+    uint8_t c = value[i];
+    char hex[5];
+    if (c == quote || c == '\\') {
+      s += '\\';
+      s += (char)c;
+    } else if (c == '\t') {
+      s += "\\t";
+    } else if (c == '\n') {
+      s += "\\n";
+    } else if (c == '\r') {
+      s += "\\r";
+    } else if (c < ' ' || c >= 0x7f) {
+      snprintf(hex, sizeof(hex), "\\x%02x", c);
+      s += hex;
+    } else {
+      s += (char)c;
+    }
+  }
+  s += quote;
+  return s;
+}
+
+// Same as str() of the op in replay/mem/memoryoperations.py
+static std::string opStr(const Op &op) {
+  char buf[64];
+  std::string base = "id:" + std::to_string(op.id) + ",tid:" +
+                     std::to_string(op.tid) + ",src_info:" + Strs[op.src];
+  auto range = [&]() {
+    snprintf(buf, sizeof(buf), "addr:0x%lx,size:%u,",
+             (unsigned long)op.address, op.size);
+    return std::string(buf);
+  };
+  switch (op.type) {
+  case PMTraceBinType::AtomicStore:
+    snprintf(buf, sizeof(buf), "addr:0x%lx,size:%u,value:",
+             (unsigned long)op.address, op.size);
+    return "Store:" + std::string(buf) + bytesRepr(op.value, op.size) + "," +
+           base;
+  case PMTraceBinType::Flush:
+    return "Flush:" + range() + base;
+  case PMTraceBinType::Fence:
+    return "Fence:" + base;
+  case PMTraceBinType::TXStart:
+    return "TXStart:" + base;
+  case PMTraceBinType::TXEnd:
+    return "TXEnd:" + base;
+  case PMTraceBinType::TXAdd:
+    return "PMDKTXadd:" + range() + base;
+  case PMTraceBinType::TXAlloc:
+    return "PMDKTXAlloc:" + range() + base;
+  case PMTraceBinType::PMDKCallStart:
+    return Strs[op.aux] + ":start:" + base;
+  case PMTraceBinType::PMDKCallEnd:
+    return Strs[op.aux] + ":end:" + base;
+  default:
+    return base;
+  }
+}
+
+// A store is pending until a fence after a flush of its line
+static bool isPending(const Op &store) {
+  auto it = Lines.find(store.address / TC_LINE_BYTES);
+  return it != Lines.end() && store.id >= it->second.fenced_up_to;
+}
+
+// Report the stores still pending, as the engine at a TX start
+static void reportPendingStores() {
+  for (const Op &store : NewStores) {
+    if (isPending(store)) {
+      UnflushedStores.push_back(store);
+    }
+  }
+  NewStores.clear();
+}
+
+static void acceptStore(const Op &op) {
+  uint64_t address = op.address / TC_LINE_BYTES;
+  auto it = Lines.find(address);
+  if (it == Lines.end()) {
+    // the older stores of the line are all fenced
+    it = Lines.emplace(address, Line{0, 0, op.id, op.id, false}).first;
+  }
+  it->second.clear++;
+  NewStores.push_back(op);
+}
+
+static void acceptFlush(const Op &op) {
+  uint64_t address = op.address / TC_LINE_BYTES;
+  auto it = Lines.find(address);
+  if (it == Lines.end() || it->second.clear == 0) {
+    ExtraFlushes.push_back(op);
+    return;
+  }
+  Line &line = it->second;
+  line.flushing += line.clear;
+  line.clear = 0;
+  line.flushed_up_to = op.id;
+  if (!line.in_flushed_lines) {
+    line.in_flushed_lines = true;
+    FlushedLines.push_back(address);
+  }
+}
+
+static void acceptFence(const Op &op) {
+  if (FlushedLines.empty()) {
+    ExtraFences.push_back(op);
+    return;
+  }
+  for (uint64_t address : FlushedLines) {
+    auto it = Lines.find(address);
+    Line &line = it->second;
+    line.fenced_up_to = line.flushed_up_to;
+    line.flushing = 0;
+    line.in_flushed_lines = false;
+    if (line.clear == 0) {
+      Lines.erase(it);
+    }
+  }
+  FlushedLines.clear();
+}
+
+// Track the PMDK calls and TXs, returns true at the end of the outermost
+// PMDK TX
+static bool acceptPMDKCall(const Op &op, PMDKState &s, bool &usePMDKTX) {
+  uint32_t func = op.aux;
+  if (op.type == PMTraceBinType::PMDKCallStart) {
+    s.calls.push_back(func);
+  } else if (s.calls.empty() || s.calls.back() != func) {
+    fprintf(stderr, "warning: unmatched end of %s at op %lu\n",
+            Strs[func].c_str(), (unsigned long)op.id);
+  } else {
+    s.calls.pop_back();
+  }
+
+  if (func == TXBeginStr && op.type == PMTraceBinType::PMDKCallEnd) {
+    if (!s.in_tx) {
+      s.in_tx = true;
+      usePMDKTX = true;
+    } else {
+      s.nested_txs++;
+    }
+  }
+  if (func == TXEndStr && op.type == PMTraceBinType::PMDKCallStart) {
+    if (s.nested_txs > 0) {
+      s.nested_txs--;
+    } else {
+      s.in_tx = false;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool check() {
+  PMDKState s;
+  bool usePMDKTX = false;
+  LogRanges logs;
+  bool ok = forEachTXOp([&](const Op &op) {
+    switch (op.type) {
+    case PMTraceBinType::TXStart:
+    case PMTraceBinType::TXEnd:
+      reportPendingStores();
+      break;
+    case PMTraceBinType::PMDKCallStart:
+    case PMTraceBinType::PMDKCallEnd:
+      if (acceptPMDKCall(op, s, usePMDKTX)) {
+        logs.clear();
+      }
+      break;
+    case PMTraceBinType::TXAdd:
+    case PMTraceBinType::TXAlloc:
+      if (logs.overlaps(op.address, op.address + op.size)) {
+        ExtraLogs.push_back(op);
+      }
+      logs.add(op.address, op.address + op.size);
+      break;
+    case PMTraceBinType::AtomicStore:
+      acceptStore(op);
+      if (s.in_tx && s.calls.empty() &&
+          !logs.overlaps(op.address, op.address + op.size)) {
+        UnloggedStores.push_back(op);
+      }
+      break;
+    case PMTraceBinType::Flush:
+      acceptFlush(op);
+      break;
+    case PMTraceBinType::Fence:
+      acceptFence(op);
+      break;
+    default:
+      break;
+    }
+  });
+  if (!ok) {
+    return false;
+  }
+  reportPendingStores();
+
+  if (!usePMDKTX) {
+    return true;
+  }
+  // the stores outside the PMDK TXs and functions
+  s = PMDKState();
+  return forEachTXOp([&](const Op &op) {
+    if (op.type == PMTraceBinType::PMDKCallStart ||
+        op.type == PMTraceBinType::PMDKCallEnd) {
+      acceptPMDKCall(op, s, usePMDKTX);
+    } else if (op.type == PMTraceBinType::AtomicStore && !s.in_tx &&
+               s.calls.empty()) {
+      UnTXedStores.push_back(op);
+    }
+  });
+}
+
+// Same layout as CTRes.print: the source locations, then the ops of each
+static bool printRes(const std::string &name, std::vector<Op> &res) {
+  std::sort(res.begin(), res.end(),
+            [](const Op &a, const Op &b) { return a.id < b.id; });
+  res.erase(std::unique(res.begin(), res.end(),
+                        [](const Op &a, const Op &b) { return a.id == b.id; }),
+            res.end());
+
+  std::vector<uint32_t> keys;
+  std::unordered_map<uint32_t, std::vector<const Op *>> bySrc;
+  for (const Op &op : res) {
+    std::vector<const Op *> &ops = bySrc[op.src];
+    if (ops.empty()) {
+      keys.push_back(op.src);
+    }
+    ops.push_back(&op);
+  }
+
+  std::string path = OutputDir + "/" + name;
+  FILE *f = fopen(path.c_str(), "w");
+  if (f == nullptr) {
+    perror(path.c_str());
+    return false;
+  }
+  for (uint32_t key : keys) {
+    fprintf(f, "KEY: %s\n", Strs[key].c_str());
+  }
+  fprintf(f, "\n");
+  for (uint32_t key : keys) {
+    fprintf(f, "KEY: %s\n", Strs[key].c_str());
+    for (const Op *op : bySrc[key]) {
+      fprintf(f, "\t%s\n", opStr(*op).c_str());
+    }
+    fprintf(f, "\n");
+  }
+  return fclose(f) == 0;
+}
+
+static bool printSummary() {
+  std::string path = OutputDir + "/summary";
+  FILE *f = fopen(path.c_str(), "w");
+  if (f == nullptr) {
+    perror(path.c_str());
+    return false;
+  }
+  fprintf(f, "unflushed_stores:%zu\n", UnflushedStores.size());
+  fprintf(f, "extra_flushes:%zu\n", ExtraFlushes.size());
+  fprintf(f, "extra_fences:%zu\n", ExtraFences.size());
+  fprintf(f, "unlogged_stores:%zu\n", UnloggedStores.size());
+  fprintf(f, "extra_logs:%zu\n", ExtraLogs.size());
+  fprintf(f, "unTXed_stores:%zu\n", UnTXedStores.size());
+  return fclose(f) == 0;
+}
+
+static bool dumpOps() {
+  std::string path = OutputDir + "/atmoic_write.pmtrace";
+  FILE *f = fopen(path.c_str(), "w");
+  if (f == nullptr) {
+    perror(path.c_str());
+    return false;
+  }
+  bool ok = forEachOp([&](const Op &op) {
+    fprintf(f, "%s\n", opStr(op).c_str());
+  });
+  return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "WitcherTC Checker\n");
+
+  if (!openTrace(TraceFilename.c_str()) || !scanTXs() || !check()) {
+    return 1;
+  }
+
+  if (mkdir(OutputDir.c_str(), 0755) != 0 && errno != EEXIST) {
+    perror(OutputDir.c_str());
+    return 1;
+  }
+  // the unique entries are counted in the summary
+  bool ok = printRes("unfluhsed_stores", UnflushedStores) &&
+            printRes("extra_flushes", ExtraFlushes) &&
+            printRes("extra_fences", ExtraFences) &&
+            printRes("unlogged_stores", UnloggedStores) &&
+            printRes("extra_logs", ExtraLogs) &&
+            printRes("unTXed_stores", UnTXedStores) &&
+            printSummary() &&
+            (!DumpOps || dumpOps());
+  return ok ? 0 : 1;
+}
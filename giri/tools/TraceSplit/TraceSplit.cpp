@@ -19,6 +19,12 @@ static cl::opt<std::string> ExtTracingFuncFilename(cl::Positional,
 static cl::opt<std::string>
 OutputPath(cl::Positional, cl::desc("output path"), cl::init("-"));
 
+// In view mode, the output path is an index file with one TX view per line:
+// "<tx name> <first entry> <number of entries> <tid>", and no trace is copied.
+static cl::opt<bool>
+ViewMode("view", cl::desc("Write an index of TX views instead of split traces"),
+         cl::init(false));
+
 // A file descriptor for trace file
 int fd_trace = 0;
 // A vector storing ext tracing functions
@@ -31,10 +37,18 @@ int tx_start_to_skip = 0;
 int curr_tx_index = 0;
 // fd for writing the trace of one tx
 int fd_output = 0;
+// index of the current entry and of the first entry of the current tx
+unsigned long curr_index = 0;
+unsigned long tx_begin_index = 0;
+// output stream of the TX view index
+std::ofstream view_of;
 
 // cleanup stuff
 void cleanup() {
   close(fd_trace);
+  if (ViewMode) {
+    view_of.close();
+  }
 }
 
 // We used call for marking TX boundaries.
@@ -55,6 +69,12 @@ void processCallEntry(Entry entry) {
     // we need to skip the call and ret entry of TX_START
     tx_start_to_skip = 2;
 
+    // a view only needs to know where the tx starts
+    if (ViewMode) {
+      tx_begin_index = curr_index + 2;
+      return;
+    }
+
     // open the file to write the trace of one tx
     assert(fd_output == 0);
     if (OutputPath == "-") {
@@ -70,6 +90,15 @@ void processCallEntry(Entry entry) {
 
   // TX end
   if (func_name == "witcher_tx_end") {
+    if (ViewMode) {
+      assert(inside_tx == true);
+      inside_tx = false;
+      view_of << curr_tx_index << " " << tx_begin_index << " "
+              << curr_index - tx_begin_index << " 0\n";
+      curr_tx_index++;
+      return;
+    }
+
     // write the END entry
     Entry entry = Entry(RecordType::ENType, 0);
     write(fd_output, &entry, sizeof(entry));
@@ -114,11 +143,13 @@ void run() {
       if (tx_start_to_skip > 0) {
         // we need to skip the call and ret entry of TX_START
         tx_start_to_skip--;
-      } else {
+      } else if (!ViewMode) {
         // write the entry inside a tx
         write(fd_output, &entry, sizeof(entry));
       }
     }
+
+    curr_index++;
   }
 
   if (readsize != 0) {
@@ -152,6 +183,12 @@ void init(int argc, char** argv) {
 
   // parse ext tracing functions
   parseExtTracingFunc();
+
+  // open the TX view index
+  if (ViewMode) {
+    view_of.open(OutputPath);
+    assert(view_of.is_open() && "Cannot open view index file!\n");
+  }
 }
 
 int main(int argc, char ** argv) {
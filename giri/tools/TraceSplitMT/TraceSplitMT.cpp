@@ -19,18 +19,29 @@ static cl::opt<std::string> ExtTracingFuncFilename(cl::Positional,
 static cl::opt<std::string>
 OutputPath(cl::Positional, cl::desc("output path"), cl::init("-"));
 
+// In view mode, the output path is an index file with one TX view per line:
+// "<tx name> <first entry> <number of entries> <tid>", and no trace is copied.
+// The entries of the other threads inside a view are dropped by TraceFile
+// when it opens the view.
+static cl::opt<bool>
+ViewMode("view", cl::desc("Write an index of TX views instead of split traces"),
+         cl::init(false));
+
 // A file descriptor for trace file
 int fd_trace = 0;
 // A vector storing ext tracing functions
 std::vector<std::string> ext_tracing_func_vector;
+// output stream of the TX view index
+std::ofstream view_of;
 
 class ThreadHandler {
 public:
   ThreadHandler(pthread_t tid) : tid(tid) {}
 
-  void accept(Entry entry) {
+  void accept(Entry entry, unsigned long index) {
     assert(entry.tid == this->tid);
 
+    curr_index = index;
     if (entry.type == RecordType::CLType) {
       processCallEntry(entry);
     }
@@ -39,7 +50,11 @@ public:
       if (tx_start_to_skip > 0) {
         // we need to skip the call and ret entry of TX_START
         tx_start_to_skip--;
-      } else {
+        // the view starts right after the ret entry of TX_START
+        if (tx_start_to_skip == 0) {
+          tx_begin_index = index + 1;
+        }
+      } else if (!ViewMode) {
         // write the entry inside a tx
         write(fd_output, &entry, sizeof(entry));
       }
@@ -56,6 +71,9 @@ private:
   int curr_tx_index = 0;
   // fd for writing the trace of one tx
   int fd_output = 0;
+  // index of the current entry and of the first entry of the current tx
+  unsigned long curr_index = 0;
+  unsigned long tx_begin_index = 0;
 
   // We used call for marking TX boundaries.
   void processCallEntry(Entry entry) {
@@ -75,6 +93,10 @@ private:
       // we need to skip the call and ret entry of TX_START
       tx_start_to_skip = 2;
 
+      if (ViewMode) {
+        return;
+      }
+
       // open the file to write the trace of one tx
       assert(fd_output == 0);
       if (OutputPath == "-") {
@@ -91,6 +113,15 @@ private:
 
     // TX end
     if (func_name == "witcher_tx_end") {
+      if (ViewMode) {
+        assert(inside_tx == true);
+        inside_tx = false;
+        view_of << tid << "-" << curr_tx_index << " " << tx_begin_index << " "
+                << curr_index - tx_begin_index << " " << tid << "\n";
+        curr_tx_index++;
+        return;
+      }
+
       // write the END entry
       Entry entry = Entry(RecordType::ENType, 0);
       write(fd_output, &entry, sizeof(entry));
@@ -117,13 +148,18 @@ std::map<pthread_t, ThreadHandler*> thread_map;
 void cleanup() {
   // TODO map
   close(fd_trace);
+  if (ViewMode) {
+    view_of.close();
+  }
 }
 
 void run() {
   // a while loop for processing each entry
   Entry entry;
   ssize_t readsize;
-  while ((readsize = read(fd_trace, &entry, sizeof(entry))) == sizeof(entry)) {
+  unsigned long index = 0;
+  for (; (readsize = read(fd_trace, &entry, sizeof(entry))) == sizeof(entry);
+       ++index) {
     if (entry.type == RecordType::ENType) {
       readsize = 0;
       break;
@@ -138,7 +174,7 @@ void run() {
       thread_handler = new ThreadHandler(tid);
       thread_map.insert(std::pair<pthread_t,ThreadHandler*>(tid,thread_handler));
     }
-    thread_handler->accept(entry);
+    thread_handler->accept(entry, index);
   }
 
   if (readsize != 0) {
@@ -172,6 +208,12 @@ void init(int argc, char** argv) {
 
   // parse ext tracing functions
   parseExtTracingFunc();
+
+  // open the TX view index
+  if (ViewMode) {
+    view_of.open(OutputPath);
+    assert(view_of.is_open() && "Cannot open view index file!\n");
+  }
 }
 
 int main(int argc, char ** argv) {
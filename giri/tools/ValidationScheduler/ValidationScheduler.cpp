@@ -0,0 +1,339 @@
+//===- ValidationScheduler.cpp - Multi-core crash validation scheduler ----===//
+//
+//                          Witcher
+//
+//===----------------------------------------------------------------------===//
+//
+// This tool runs the validation tasks of the parallel replay engine on all
+// cores. It starts one long-lived worker per core
+// (witcher_parallel_unit.py -worker), so the trace and the belief database
+// are loaded once per core instead of once per TX, and sends each worker one
+// task line at a time on its stdin. A worker answers each task with one line.
+//
+// The tasks of a group (the fences of one TX) are meant to run in order on
+// one worker: a task has a replay cost, paid unless its worker has just run
+// the previous task of its group, which it then resumes.
+//
+// Each core has its own deque of tasks. The groups are first spread over the
+// deques by decreasing cost, each one to the least loaded deque with its
+// tasks in order. A core runs the tasks of its deque from the front and, once
+// it is empty, steals from the back of the deque with the most cost left. A
+// stolen task pays its replay cost, so it is only stolen if the thief can run
+// it before its core would be done with its deque.
+//
+// The tasks file has one task per line:
+// "<cost> <replay cost> <group> <task line for the worker>", the tasks of a
+// group in order. The busy time, the tasks run and stolen and the utilization
+// of each core are written to the utilization file.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/CommandLine.h"
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+
+extern char **environ;
+
+static cl::opt<std::string>
+TasksFilename(cl::Positional, cl::desc("tasks file name"), cl::Required);
+
+static cl::opt<std::string>
+UtilFilename("util", cl::desc("per-core utilization output file"),
+             cl::init("-"));
+
+static cl::opt<unsigned>
+NumCores("j", cl::desc("number of cores, 0 for all of them"), cl::init(0));
+
+static cl::list<std::string>
+WorkerCommand(cl::ConsumeAfter, cl::desc("<worker command>..."));
+
+struct Task {
+  double cost;
+  double replay_cost;
+  std::string group;
+  std::string line;
+  // the cost counted in the cost left of its deque
+  double queued_cost;
+};
+
+struct Core {
+  std::deque<Task> tasks;
+  double cost_left = 0;
+
+  // the worker process of the core and its pipes
+  pid_t pid = -1;
+  FILE *to_worker = nullptr;
+  FILE *from_worker = nullptr;
+
+  uint64_t busy_ns = 0;
+  size_t num_tasks = 0;
+  size_t num_stolen = 0;
+  size_t num_failed = 0;
+};
+
+// the deques of all the cores
+static std::mutex tasks_lock;
+static std::vector<Core> cores;
+
+static uint64_t nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool readTasks(std::vector<Task> &tasks) {
+  std::ifstream in(TasksFilename);
+  if (!in.is_open()) {
+    std::cerr << "cannot open the tasks file " << TasksFilename << "\n";
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream ss(line);
+    Task task;
+    if (!(ss >> task.cost >> task.replay_cost >> task.group)) {
+      continue;
+    }
+    std::getline(ss >> std::ws, task.line);
+    tasks.push_back(task);
+  }
+  return true;
+}
+
+struct Group {
+  std::vector<Task> tasks;
+  double cost = 0;
+};
+
+// Spread the groups over the deques: by decreasing cost, each one to the
+// least loaded deque. Only the first task of a group pays its replay cost.
+static void spreadTasks(std::vector<Task> &tasks) {
+  std::vector<Group> groups;
+  std::map<std::string, size_t> group_ids;
+  for (Task &task : tasks) {
+    auto it = group_ids.insert(std::make_pair(task.group, groups.size()));
+    if (it.second) {
+      groups.emplace_back();
+    }
+    Group &group = groups[it.first->second];
+    task.queued_cost = task.cost;
+    if (group.tasks.empty()) {
+      task.queued_cost += task.replay_cost;
+    }
+    group.cost += task.queued_cost;
+    group.tasks.push_back(task);
+  }
+
+  std::stable_sort(groups.begin(), groups.end(),
+                   [](const Group &a, const Group &b) {
+                     return a.cost > b.cost;
+                   });
+  for (const Group &group : groups) {
+    Core *least = &cores[0];
+    for (Core &core : cores) {
+      if (core.cost_left < least->cost_left) {
+        least = &core;
+      }
+    }
+    least->tasks.insert(least->tasks.end(), group.tasks.begin(),
+                        group.tasks.end());
+    least->cost_left += group.cost;
+  }
+}
+
+// Take the next task of a core: the front of its deque, or the back of the
+// deque with the most cost left if it is worth stealing
+static bool takeTask(size_t id, Task &task, bool &stolen) {
+  std::lock_guard<std::mutex> guard(tasks_lock);
+  Core *victim = &cores[id];
+  stolen = victim->tasks.empty();
+  if (stolen) {
+    for (Core &core : cores) {
+      if (!core.tasks.empty() && (victim->tasks.empty() ||
+                                  core.cost_left > victim->cost_left)) {
+        victim = &core;
+      }
+    }
+    if (victim->tasks.empty()) {
+      return false;
+    }
+    const Task &back = victim->tasks.back();
+    if (back.cost + back.replay_cost >= victim->cost_left) {
+      return false;
+    }
+    task = back;
+    victim->tasks.pop_back();
+  } else {
+    task = victim->tasks.front();
+    victim->tasks.pop_front();
+  }
+  victim->cost_left -= task.queued_cost;
+  return true;
+}
+
+static bool startWorker(Core &core) {
+  int to_fds[2], from_fds[2];
+  if (pipe2(to_fds, O_CLOEXEC) < 0 || pipe2(from_fds, O_CLOEXEC) < 0) {
+    perror("pipe failed");
+    return false;
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, to_fds[0], STDIN_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, from_fds[1], STDOUT_FILENO);
+
+  std::vector<char *> argv;
+  for (std::string &arg : WorkerCommand) {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(nullptr);
+
+  int err = posix_spawnp(&core.pid, argv[0], &actions, nullptr, argv.data(),
+                         environ);
+  posix_spawn_file_actions_destroy(&actions);
+  close(to_fds[0]);
+  close(from_fds[1]);
+  if (err != 0) {
+    fprintf(stderr, "cannot start the worker %s: %s\n", argv[0],
+            strerror(err));
+    close(to_fds[1]);
+    close(from_fds[0]);
+    core.pid = -1;
+    return false;
+  }
+  core.to_worker = fdopen(to_fds[1], "w");
+  core.from_worker = fdopen(from_fds[0], "r");
+  return true;
+}
+
+static void stopWorker(Core &core) {
+  if (core.pid < 0) {
+    return;
+  }
+  fclose(core.to_worker);
+  fclose(core.from_worker);
+  int status;
+  waitpid(core.pid, &status, 0);
+  core.pid = -1;
+}
+
+static void runCore(size_t id) {
+  Core &core = cores[id];
+  Task task;
+  bool stolen;
+  while (takeTask(id, task, stolen)) {
+    if (core.pid < 0 && !startWorker(core)) {
+      core.num_failed++;
+      continue;
+    }
+
+    uint64_t t0 = nowNs();
+    fprintf(core.to_worker, "%s\n", task.line.c_str());
+    fflush(core.to_worker);
+    char response[256];
+    bool done = fgets(response, sizeof response, core.from_worker) != nullptr;
+    core.busy_ns += nowNs() - t0;
+
+    core.num_tasks++;
+    core.num_stolen += stolen;
+    if (!done) {
+      // the worker died with the task, the next task gets a new one
+      fprintf(stderr, "worker %d died running task %s\n", (int)core.pid,
+              task.line.c_str());
+      stopWorker(core);
+      core.num_failed++;
+    } else if (strncmp(response, "done", 4) != 0) {
+      core.num_failed++;
+    }
+  }
+  stopWorker(core);
+}
+
+static void writeUtilization(uint64_t wall_ns) {
+  std::ofstream file;
+  bool to_file = UtilFilename != "-";
+  if (to_file) {
+    file.open(UtilFilename);
+  }
+  std::ostream &out = to_file ? file : std::cout;
+
+  char line[256];
+  uint64_t busy_ns = 0;
+  for (size_t id = 0; id < cores.size(); id++) {
+    const Core &core = cores[id];
+    busy_ns += core.busy_ns;
+    snprintf(line, sizeof line,
+             "core %zu: busy %.3fs, utilization %.1f%%, tasks %zu, "
+             "stolen %zu, failed %zu\n",
+             id, core.busy_ns / 1e9,
+             wall_ns ? 100.0 * core.busy_ns / wall_ns : 0.0,
+             core.num_tasks, core.num_stolen, core.num_failed);
+    out << line;
+  }
+  snprintf(line, sizeof line,
+           "cores: %zu, wall %.3fs, utilization %.1f%%\n", cores.size(),
+           wall_ns / 1e9,
+           wall_ns ? 100.0 * busy_ns / wall_ns / cores.size() : 0.0);
+  out << line;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "Validation Scheduler\n");
+  if (WorkerCommand.empty()) {
+    std::cerr << "no worker command\n";
+    return 1;
+  }
+
+  std::vector<Task> tasks;
+  if (!readTasks(tasks)) {
+    return 1;
+  }
+
+  unsigned num_cores = NumCores;
+  if (num_cores == 0) {
+    num_cores = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_cores = std::max<size_t>(1, std::min<size_t>(num_cores, tasks.size()));
+  cores.resize(num_cores);
+  spreadTasks(tasks);
+
+  // a worker dying must not kill the scheduler
+  signal(SIGPIPE, SIG_IGN);
+
+  uint64_t t0 = nowNs();
+  std::vector<std::thread> threads;
+  for (size_t id = 0; id < cores.size(); id++) {
+    threads.emplace_back(runCore, id);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  writeUtilization(nowNs() - t0);
+
+  size_t num_failed = 0;
+  for (const Core &core : cores) {
+    num_failed += core.num_failed;
+  }
+  return num_failed == 0 ? 0 : 2;
+}
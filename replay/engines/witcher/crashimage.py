@@ -0,0 +1,101 @@
+from logging import getLogger
+import ctypes
+import os
+
+# libcrashimage.so is built with the giri tools
+CRASH_IMAGE_LIB = os.environ.get('WITCHER_HOME', '') + \
+                  '/giri/build-llvm9/libcrashimage.so'
+
+_lib = None
+
+def _load_lib():
+    global _lib
+    if _lib is None:
+        lib = ctypes.CDLL(CRASH_IMAGE_LIB)
+        lib.crash_image_builder_open.argtypes = [ctypes.c_char_p]
+        lib.crash_image_builder_open.restype = ctypes.c_void_p
+        lib.crash_image_builder_open_memfd.argtypes = [ctypes.c_char_p,
+                                                       ctypes.c_int]
+        lib.crash_image_builder_open_memfd.restype = ctypes.c_void_p
+        lib.crash_image_memfd.argtypes = [ctypes.c_void_p]
+        lib.crash_image_memfd.restype = ctypes.c_int
+        lib.crash_image_build.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                          ctypes.c_int]
+        lib.crash_image_build.restype = ctypes.c_long
+        lib.crash_image_delta_hash.argtypes = [ctypes.c_void_p,
+                                               ctypes.c_size_t,
+                                               ctypes.POINTER(ctypes.c_uint64),
+                                               ctypes.POINTER(ctypes.c_uint32),
+                                               ctypes.c_char_p,
+                                               ctypes.POINTER(ctypes.c_uint64)]
+        lib.crash_image_delta_hash.restype = ctypes.c_uint64
+        lib.crash_image_is_reflink.argtypes = [ctypes.c_void_p]
+        lib.crash_image_is_reflink.restype = ctypes.c_int
+        lib.crash_image_builder_close.argtypes = [ctypes.c_void_p]
+        lib.crash_image_builder_close.restype = None
+        _lib = lib
+    return _lib
+
+# Build crash images from the current replay pm file without a full copy
+# each time (see giri/tools/CrashImage/CrashImage.cpp). Unless the images
+# are reflinks, an image is only valid until the next build.
+# With memfd, the crash image is a memfd rebuilt in place for each crash state,
+# which a child process inheriting the fd opens as get_memfd_path().
+class CrashImageBuilder:
+    def __init__(self, base_file, memfd=False, hugepages=False):
+        self.lib = _load_lib()
+        if memfd:
+            self.builder = self.lib.crash_image_builder_open_memfd(
+                base_file.encode(), int(hugepages))
+        else:
+            self.builder = self.lib.crash_image_builder_open(base_file.encode())
+        assert self.builder, 'cannot open the base image ' + base_file
+
+    # base_changed must be True if the base was written since the last build
+    def build(self, crash_state_file, base_changed=True):
+        pages = self.lib.crash_image_build(self.builder,
+                                           crash_state_file.encode(),
+                                           int(base_changed))
+        assert pages >= 0, 'cannot build the crash image ' + crash_state_file
+        getLogger().debug('crash image ' + crash_state_file + ': ' + \
+                          str(pages) + ' pages copied')
+
+    # return the hash of the delta the stores make to the base and the
+    # number of bytes they change, map_base is the address of offset 0
+    def delta_hash(self, stores, map_base):
+        n = len(stores)
+        offsets = (ctypes.c_uint64 * n)(*[store.get_base_address() - map_base
+                                          for store in stores])
+        sizes = (ctypes.c_uint32 * n)(*[len(store.value_bytes)
+                                        for store in stores])
+        values = b''.join([store.value_bytes for store in stores])
+        changed = ctypes.c_uint64(0)
+        delta_hash = self.lib.crash_image_delta_hash(self.builder, n, offsets,
+                                                     sizes, values,
+                                                     ctypes.byref(changed))
+        assert delta_hash != 0, 'cannot hash the crash plan delta'
+        return delta_hash, changed.value
+
+    def is_reflink(self):
+        return self.lib.crash_image_is_reflink(self.builder) == 1
+
+    # return the memfd of the crash images, or None
+    def get_memfd(self):
+        fd = self.lib.crash_image_memfd(self.builder)
+        return fd if fd >= 0 else None
+
+    def get_memfd_path(self):
+        return '/proc/self/fd/' + str(self.get_memfd())
+
+    def close(self):
+        if self.builder:
+            self.lib.crash_image_builder_close(self.builder)
+            self.builder = None
+
+# return a crash image builder, or None if the library is not built
+def get_crash_image_builder(base_file, memfd=False, hugepages=False):
+    try:
+        return CrashImageBuilder(base_file, memfd, hugepages)
+    except OSError:
+        getLogger().debug('no ' + CRASH_IMAGE_LIB + ', crash images use cp')
+        return None
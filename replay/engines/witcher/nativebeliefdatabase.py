@@ -0,0 +1,79 @@
+from logging import getLogger
+import ctypes
+import os
+
+# libbeliefdb.so is built with the giri tools
+BELIEF_DB_LIB = os.environ.get('WITCHER_HOME', '') + \
+                '/giri/build-llvm9/libbeliefdb.so'
+
+_lib = None
+
+def _load_lib():
+    global _lib
+    if _lib is None:
+        lib = ctypes.CDLL(BELIEF_DB_LIB)
+        lib.belief_db_open.argtypes = [ctypes.c_char_p]
+        lib.belief_db_open.restype = ctypes.c_void_p
+        lib.belief_db_num_objects.argtypes = [ctypes.c_void_p]
+        lib.belief_db_num_objects.restype = ctypes.c_size_t
+        lib.belief_db_num_beliefs.argtypes = [ctypes.c_void_p]
+        lib.belief_db_num_beliefs.restype = ctypes.c_size_t
+        lib.belief_db_crash_candidates.argtypes = \
+                                    [ctypes.c_void_p,
+                                     ctypes.c_size_t,
+                                     ctypes.POINTER(ctypes.c_uint64),
+                                     ctypes.POINTER(ctypes.c_uint64),
+                                     ctypes.POINTER(ctypes.c_size_t)]
+        lib.belief_db_crash_candidates.restype = \
+                                    ctypes.POINTER(ctypes.c_uint32)
+        lib.belief_db_free.argtypes = [ctypes.POINTER(ctypes.c_uint32)]
+        lib.belief_db_free.restype = None
+        lib.belief_db_close.argtypes = [ctypes.c_void_p]
+        lib.belief_db_close.restype = None
+        _lib = lib
+    return _lib
+
+# The belief database built natively from the ppdg file (see
+# giri/tools/BeliefDatabase/BeliefDatabase.cpp). It gives the same crash
+# candidates as CrashCandidates.get_crash_candidates_from_tx with
+# WitcherBeliefDatabase, without checking every pair of stores.
+class NativeBeliefDatabase:
+    def __init__(self, ppdg_file):
+        self.lib = _load_lib()
+        self.db = self.lib.belief_db_open(ppdg_file.encode())
+        assert self.db, 'cannot load the ppdg ' + ppdg_file
+        getLogger().debug('native belief database: ' + \
+                          str(self.lib.belief_db_num_objects(self.db)) + \
+                          ' pm objects, ' + \
+                          str(self.lib.belief_db_num_beliefs(self.db)) + \
+                          ' beliefs')
+
+    # return the crash candidates [persisted store, volatile store] of the
+    # stores of a tx
+    def get_crash_candidates_from_tx(self, stores):
+        n = len(stores)
+        addresses = (ctypes.c_uint64 * n)(*[store.address for store in stores])
+        sizes = (ctypes.c_uint64 * n)(*[store.size for store in stores])
+        num_candidates = ctypes.c_size_t(0)
+        res = self.lib.belief_db_crash_candidates(self.db, n, addresses, sizes,
+                                                  ctypes.byref(num_candidates))
+        if not res:
+            return []
+        indexes = res[:2 * num_candidates.value]
+        self.lib.belief_db_free(res)
+        return [[stores[indexes[i]], stores[indexes[i+1]]]
+                for i in range(0, len(indexes), 2)]
+
+    def close(self):
+        if self.db:
+            self.lib.belief_db_close(self.db)
+            self.db = None
+
+# return a native belief database, or None if the library is not built
+def get_native_belief_database(ppdg_file):
+    try:
+        return NativeBeliefDatabase(ppdg_file)
+    except OSError:
+        getLogger().debug('no ' + BELIEF_DB_LIB + \
+                          ', crash candidates use the python beliefs')
+        return None
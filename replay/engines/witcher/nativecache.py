@@ -0,0 +1,116 @@
+from logging import getLogger
+import ctypes
+import os
+
+# libpmcache.so is built with the giri tools
+PM_CACHE_LIB = os.environ.get('WITCHER_HOME', '') + \
+               '/giri/build-llvm9/libpmcache.so'
+
+STORE_FENCED = 2
+
+_lib = None
+
+def _load_lib():
+    global _lib
+    if _lib is None:
+        lib = ctypes.CDLL(PM_CACHE_LIB)
+        lib.pm_cache_open.argtypes = [ctypes.c_char_p, ctypes.c_char_p,
+                                      ctypes.c_uint64]
+        lib.pm_cache_open.restype = ctypes.c_void_p
+        lib.pm_cache_num_ops.argtypes = [ctypes.c_void_p]
+        lib.pm_cache_num_ops.restype = ctypes.c_size_t
+        lib.pm_cache_accept.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        lib.pm_cache_accept.restype = ctypes.c_int
+        lib.pm_cache_accept_until_fence.argtypes = [ctypes.c_void_p,
+                                                    ctypes.c_size_t,
+                                                    ctypes.c_size_t]
+        lib.pm_cache_accept_until_fence.restype = ctypes.c_size_t
+        lib.pm_cache_replay.argtypes = [ctypes.c_void_p, ctypes.c_size_t,
+                                        ctypes.c_size_t, ctypes.c_size_t]
+        lib.pm_cache_replay.restype = None
+        lib.pm_cache_write_back_flushing_stores.argtypes = [ctypes.c_void_p]
+        lib.pm_cache_write_back_flushing_stores.restype = None
+        lib.pm_cache_write_back_all_stores.argtypes = [ctypes.c_void_p]
+        lib.pm_cache_write_back_all_stores.restype = None
+        lib.pm_cache_store_state.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        lib.pm_cache_store_state.restype = ctypes.c_int
+        lib.pm_cache_stores_before.argtypes = \
+                                [ctypes.c_void_p,
+                                 ctypes.c_size_t,
+                                 ctypes.POINTER(ctypes.POINTER(ctypes.c_uint32))]
+        lib.pm_cache_stores_before.restype = ctypes.c_size_t
+        lib.pm_cache_flush.argtypes = [ctypes.c_void_p]
+        lib.pm_cache_flush.restype = None
+        lib.pm_cache_close.argtypes = [ctypes.c_void_p]
+        lib.pm_cache_close.restype = None
+        _lib = lib
+    return _lib
+
+# The cache simulated natively on the ops of the binary trace (see
+# giri/tools/PMCache/PMCache.cpp). It has the interface of WitcherCache, but
+# the states of the stores are kept in the native cache instead of in the
+# Store ops, so they are read with is_fenced.
+class NativeWitcherCache:
+    def __init__(self, trace, replay_pm_file, map_base, binary_file):
+        self.lib = _load_lib()
+        self.trace = trace
+        self.cache = self.lib.pm_cache_open(trace.trace_bin_file.encode(),
+                                            replay_pm_file.encode(),
+                                            int(map_base, 16))
+        assert self.cache, 'cannot simulate the cache of ' + \
+                           trace.trace_bin_file
+        num_ops = self.lib.pm_cache_num_ops(self.cache)
+        assert num_ops == len(trace.atomic_write_ops), \
+               'unexpected number of ops in ' + trace.trace_bin_file
+        # the stores are written back to the same file
+        self.binary_file = binary_file
+
+    # return true when it is a fence
+    def accept(self, op):
+        return self.lib.pm_cache_accept(self.cache, op.id) == 1
+
+    # accept the ops from begin until a fence or end, return the index of the
+    # fence or end
+    def accept_until_fence(self, ops, begin, end):
+        return self.lib.pm_cache_accept_until_fence(self.cache, begin, end)
+
+    # replay the ops [begin, end) without crash
+    def replay(self, ops, begin, end, first_tx_start_id):
+        self.lib.pm_cache_replay(self.cache, begin, end, first_tx_start_id)
+
+    def write_back_all_flushing_stores(self):
+        self.lib.pm_cache_write_back_flushing_stores(self.cache)
+
+    def write_back_all_stores(self):
+        self.lib.pm_cache_write_back_all_stores(self.cache)
+
+    # get all stores from crash_plan
+    # (1) crash_plan itself
+    # (2) all stores in the same cacheline happen before it
+    def get_stores_from_crash_plan(self, crash_plan):
+        stores = ctypes.POINTER(ctypes.c_uint32)()
+        n = self.lib.pm_cache_stores_before(self.cache, crash_plan.id,
+                                            ctypes.byref(stores))
+        assert n > 0, 'crash plan not in the cache: ' + str(crash_plan)
+        return [self.trace.atomic_write_ops[i] for i in stores[:n]]
+
+    def is_fenced(self, store):
+        return self.lib.pm_cache_store_state(self.cache, store.id) == \
+               STORE_FENCED
+
+    def close(self):
+        if self.cache:
+            self.lib.pm_cache_close(self.cache)
+            self.cache = None
+
+# return a native cache, or None if the trace is not binary or the library is
+# not built
+def get_native_cache(trace, replay_pm_file, map_base, binary_file):
+    if getattr(trace, 'trace_bin_file', None) == None:
+        return None
+    try:
+        return NativeWitcherCache(trace, replay_pm_file, map_base, binary_file)
+    except OSError:
+        getLogger().debug('no ' + PM_CACHE_LIB + \
+                          ', the cache is simulated in python')
+        return None
@@ -0,0 +1,96 @@
+from subprocess import Popen, PIPE, DEVNULL
+from logging import getLogger
+import os
+import select
+import signal
+
+# A validate exe running as a fork server (see witcher_fork_server in
+# WitcherAnnotation.h). The server loads the op file once and forks a child
+# per crash state, so a validation costs a fork instead of an exec, dynamic
+# linking and op file parsing.
+#
+# The server also times the phases of each child, see WITCHER_PHASE_* in
+# WitcherAnnotation.h.
+PHASES = ['pool_open', 'recovery', 'suffix']
+
+# With oracles loaded, the children compare their output with the full and
+# the skip oracle while running. The result for an oracle is the index of the
+# first oracle line the output does not match, or one of these (see
+# WITCHER_ORACLE_* in WitcherAnnotation.h).
+ORACLE_MATCH = -1
+ORACLE_LENGTH = -2
+ORACLE_NONE = -3
+
+class ValidateForkServer:
+    # pass_fds are inherited by the server and so by its children
+    def __init__(self, validate_exe, op_file, pass_fds=()):
+        self.proc = Popen([validate_exe, '--fork-server', op_file],
+                          stdin=PIPE, stdout=PIPE, stderr=DEVNULL,
+                          pass_fds=pass_fds)
+        self.buf = b''
+        # phase times in seconds of the last child, by phase name
+        self.last_phase_times = dict()
+        # [full, skip] oracle results of the last child, None if it did not
+        # compare its output
+        self.last_oracle_res = None
+
+    # read a response line, return None if timeout (in seconds) expires
+    def read_line(self, timeout=None):
+        fd = self.proc.stdout.fileno()
+        while b'\n' not in self.buf:
+            ready, _, _ = select.select([fd], [], [], timeout)
+            if not ready:
+                return None
+            data = os.read(fd, 4096)
+            assert data, 'validate fork server exited'
+            self.buf += data
+        line, self.buf = self.buf.split(b'\n', 1)
+        return line
+
+    # run the validate exe with args (without argv[0]) in a forked child
+    # return the child pid, its return code and if it timed out
+    def execute(self, args, timeout):
+        self.proc.stdin.write((' '.join(args) + '\n').encode())
+        self.proc.stdin.flush()
+        pid = int(self.read_line())
+
+        timed_out = False
+        status = self.read_line(timeout)
+        if status is None:
+            os.kill(pid, signal.SIGKILL)
+            status = self.read_line()
+            timed_out = True
+        status = status.split()
+        self.last_phase_times = dict()
+        for phase, ns in zip(PHASES, status[1:]):
+            self.last_phase_times[phase] = int(ns) / 1e9
+        self.last_oracle_res = [int(res) for res in status[4:6]]
+        if len(self.last_oracle_res) != 2 or \
+                ORACLE_NONE in self.last_oracle_res:
+            self.last_oracle_res = None
+        status = int(status[0])
+
+        # same convention as Popen.returncode
+        if os.WIFSIGNALED(status):
+            returncode = -os.WTERMSIG(status)
+        else:
+            returncode = os.WEXITSTATUS(status)
+        getLogger().debug('fork server child ' + str(pid) + \
+                          ' returns ' + str(returncode))
+        return pid, returncode, timed_out
+
+    # load the oracles the outputs of the next children are compared with, the
+    # first output line is compared with the line full_start of the full
+    # oracle and skip_start of the skip one; return False if the server can't
+    # load them
+    def set_oracles(self, full, full_start, skip, skip_start):
+        request = ['--oracles', full, str(full_start), skip, str(skip_start)]
+        self.proc.stdin.write((' '.join(request) + '\n').encode())
+        self.proc.stdin.flush()
+        num_lines = [int(n) for n in self.read_line().split()]
+        getLogger().debug('fork server oracles: ' + str(num_lines) + ' lines')
+        return min(num_lines) >= 0
+
+    def close(self):
+        self.proc.stdin.close()
+        self.proc.wait()
@@ -1,6 +1,7 @@
 from misc.utils import Rangeable, range_cmp
 from logging import getLogger
 from collections import deque
+from engines.witcher.nativebeliefdatabase import get_native_belief_database
 import networkx as nx
 
 class PMObject(Rangeable):
@@ -159,6 +160,7 @@ class WitcherBelief:
 class WitcherBeliefDatabase:
     def __init__(self, witcher_ppdgs):
         self.witcher_ppdg_list = witcher_ppdgs.witcher_ppdg_list
+        self.ppdg_file = witcher_ppdgs.file_name
 
         # Get all pm objects into a list
         # If two objects overlap, we will merge them
@@ -177,6 +179,24 @@ class WitcherBeliefDatabase:
         # used for accelerating get_pm_object
         self.dict_store_to_obj = dict()
 
+        # the same beliefs built natively, loaded on first use since it can't
+        # be pickled
+        self.native = None
+        self.native_inited = False
+
+    def __getstate__(self):
+        state = self.__dict__.copy()
+        state['native'] = None
+        state['native_inited'] = False
+        return state
+
+    # return the native belief database, None if it is not available
+    def get_native(self):
+        if not self.native_inited:
+            self.native = get_native_belief_database(self.ppdg_file)
+            self.native_inited = True
+        return self.native
+
     # Get pm object from a store
     def get_pm_object(self, store):
         if store.id in self.dict_store_to_obj:
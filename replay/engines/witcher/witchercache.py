@@ -96,6 +96,32 @@ class WitcherCache(CacheBase):
             raise NotSupportedOperationException(op)
         return is_fence
 
+    # accept the ops from begin until a fence or end, return the index of the
+    # fence or end
+    def accept_until_fence(self, ops, begin, end):
+        for i in range(begin, end):
+            if self.accept(ops[i]):
+                return i
+        return end
+
+    # replay the ops [begin, end) without crash
+    def replay(self, ops, begin, end, first_tx_start_id):
+        for op in ops[begin:end]:
+            # if it is fence
+            if self.accept(op):
+                # if it is fence then write back all flushing stores
+                self.write_back_all_flushing_stores()
+            # if it is TXEnd then write back all stores
+            if isinstance(op, TXEnd):
+                self.write_back_all_stores()
+            # if it is the one right before the first TXStart
+            # then write back all stores
+            if op.id == first_tx_start_id - 1:
+                self.write_back_all_stores()
+
+    def is_fenced(self, store_op):
+        return store_op.is_fenced()
+
     # accept_store
     # create or find the cacheline and let it accept the store
     def accept_store(self, store_op):
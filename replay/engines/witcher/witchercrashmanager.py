@@ -63,6 +63,11 @@ class CrashCandidates:
             self.crash_candidates_per_tx.append(crash_candidates)
 
     def get_crash_candidates_from_tx(self, stores):
+        # the native belief database only looks up the pairs with a belief
+        native = self.belief_database.get_native()
+        if native != None:
+            return native.get_crash_candidates_from_tx(stores)
+
         # TODO
         if len(stores) > 100000:
             return []
@@ -235,8 +240,10 @@ class WitcherCrashManager:
             # pop the valid candidate out and put it into
             processed_candidates.append(crash_candidates.pop(0))
 
+            p_fenced = self.cache.is_fenced(p_store)
+            v_fenced = self.cache.is_fenced(v_store)
             # if both of them are not fenced (volatile in the cache)
-            if not p_store.is_fenced() and not v_store.is_fenced():
+            if not p_fenced and not v_fenced:
                 # if the p_store happens first, no matter whether they are in
                 # the same cacheline, we are able to only persist p_store and
                 # leave v_store volatile
@@ -250,10 +257,10 @@ class WitcherCrashManager:
                         crash_plans.add(p_store)
 
             # if p_store is already persisted
-            if p_store.is_fenced():
+            if p_fenced:
                 # p_store and v_store cannot be both fenced here
                 # because the last fence already processed the candidate
-                assert(not v_store.is_fenced())
+                assert(not v_fenced)
                 # If a crash plan is a fence op, it means persisting nothing
                 crash_plans.add(fence_op)
 
@@ -269,8 +276,9 @@ class WitcherCrashManager:
         for processed_candidate in processed_candidates[::-1]:
             p_store = processed_candidate[0]
             v_store = processed_candidate[1]
-            if (not p_store.is_fenced() and not v_store.is_fenced()) or \
-                    (p_store.is_fenced() and not v_store.is_fenced()):
+            p_fenced = self.cache.is_fenced(p_store)
+            v_fenced = self.cache.is_fenced(v_store)
+            if (not p_fenced and not v_fenced) or (p_fenced and not v_fenced):
                 crash_candidates.insert(0, processed_candidate)
 
     # directly run for the target, so we don't need the belief stuff
@@ -2,10 +2,15 @@ from engines.witcher.binaryfile import BinaryFile
 from mem.memoryoperations import Store, Fence
 from logging import getLogger
 import os
+import shutil
 import subprocess
+import time
 from subprocess import Popen, PIPE, TimeoutExpired
 from engines.witcherparallel.servermemcached import run_memcached
 from engines.witcherparallel.serverredis import run_redis
+from engines.witcher.validateforkserver import ValidateForkServer
+from engines.witcher.validateforkserver import ORACLE_MATCH, ORACLE_LENGTH
+from engines.witcher.crashimage import get_crash_image_builder
 
 class WitcherCrashValidator:
     def __init__(self, cache, validate_exe, replay_pm_file, mmap_addr,
@@ -30,6 +35,19 @@ class WitcherCrashValidator:
         # 'full': 'oracle-full'
         # NUM : '/oracle-skip-tx-$(NUM)'
         self.oracles = dict()
+        # lines of the oracles read so far, by oracle path
+        self.oracle_lines = dict()
+
+        # seconds spent in each validation phase, summed over crash states
+        self.phase_times = dict()
+
+        # crash plans producing the same crash image are validated once:
+        # key is (tx_index, fence_index, delta hash, changed bytes), val is
+        # the args of update_result for the crash state validated for it
+        self.dedup = False
+        self.dedup_results = dict()
+        self.last_result = None
+        self.dedup_stats = {'unique': 0, 'duplicate': 0}
 
         self.tested_crash_plans  = []
         self.reported_crash_plans = []
@@ -43,14 +61,98 @@ class WitcherCrashValidator:
         # a flag to decide whether we need to keep generated pm files
         self.keep_pm_file = False
 
+        # validate exe running as a fork server, None for a process per run
+        self.fork_server = None
+        # compare the outputs with the oracles in the fork server children,
+        # and the (full, skip) oracles loaded in the server
+        self.stream_oracles = False
+        self.fork_server_oracles = None
+
+        # native crash image builder, None if it is not available
+        self.crash_image_builder = None
+        self.crash_image_builder_inited = False
+        # the (tx_index, fence_index) of the base of the last crash image
+        self.crash_image_base = None
+
+        # path of the memfd crash image and the fds the validate exe inherits,
+        # None and () if crash images are files
+        self.memfd_image = None
+        self.pass_fds = ()
+
     # enable keeping generated pm files
     def enable_keep_pm_file(self):
         self.keep_pm_file = True
 
+    # validate each distinct crash image once
+    def enable_dedup(self):
+        self.dedup = True
+
+    # validate crash states in children forked by the validate exe
+    def enable_fork_server(self):
+        self.fork_server = ValidateForkServer('./' + self.validate_exe,
+                                              self.op_file,
+                                              self.pass_fds)
+
+    # compare the outputs with the oracles while the fork server children run
+    # the suffix, which stops at the first line matching neither oracle
+    def enable_stream_oracles(self):
+        self.stream_oracles = True
+
+    # build crash images in a memfd the validate exe inherits, optionally
+    # backed by hugepages; enable it before the fork server so it inherits it
+    def enable_memfd_images(self, hugepages=False):
+        assert self.fork_server == None, 'enable memfd before the fork server'
+        if self.keep_pm_file == True:
+            return
+        self.crash_image_builder = get_crash_image_builder(self.replay_pm_file,
+                                                           True, hugepages)
+        self.crash_image_builder_inited = True
+        if self.crash_image_builder != None:
+            self.memfd_image = self.crash_image_builder.get_memfd_path()
+            self.pass_fds = (self.crash_image_builder.get_memfd(),)
+
+    # return the path of the pm image of crash_state_file
+    def get_pm_image(self, crash_state_file):
+        if self.memfd_image != None:
+            return self.memfd_image
+        return crash_state_file
+
+    # stop the fork server and the crash image builder
+    def close(self):
+        if self.fork_server != None:
+            self.fork_server.close()
+            self.fork_server = None
+        if self.crash_image_builder != None:
+            self.crash_image_builder.close()
+            self.crash_image_builder = None
+            self.memfd_image = None
+            self.pass_fds = ()
+
+    def add_phase_time(self, phase, seconds):
+        self.phase_times[phase] = self.phase_times.get(phase, 0) + seconds
+
     # validate at tx_index fence_index wiht crash_plans
     def validate(self, tx_index, fence_index, crash_plans):
         # validate crash_plan one by one
         for crash_plan in crash_plans:
+            # reuse the result of a crash plan with the same crash image
+            dedup_key = self.get_dedup_key(tx_index, fence_index, crash_plan)
+            if dedup_key in self.dedup_results:
+                validated_output, crash_core_dump, should_report, \
+                    mismatch_res = self.dedup_results[dedup_key]
+                # recorded under its own crash plan, with the output of the
+                # crash plan validated for the same image
+                crash_state_output = self.get_crash_state_file(
+                    tx_index, fence_index, crash_plan) + '-output'
+                self.link_output(validated_output, crash_state_output)
+                self.update_result(crash_state_output,
+                                   crash_plan.src_info,
+                                   crash_core_dump,
+                                   should_report,
+                                   mismatch_res)
+                self.dedup_stats['duplicate'] += 1
+                continue
+
             # construct the crash pm first
             crash_state_file = self.construct_crash_state(tx_index,
                                                           fence_index,
@@ -58,14 +160,41 @@ class WitcherCrashValidator:
             # then check its consistency
             self.check_consistency(crash_state_file, tx_index, crash_plan.src_info)
 
+            if dedup_key != None:
+                self.dedup_results[dedup_key] = self.last_result
+                self.dedup_stats['unique'] += 1
+
+    # return the dedup key of the crash image of crash_plan, None if crash
+    # images are not deduplicated
+    def get_dedup_key(self, tx_index, fence_index, crash_plan):
+        if self.dedup == False:
+            return None
+        self.init_crash_image_builder()
+        if self.crash_image_builder == None:
+            return None
+
+        t0 = time.perf_counter()
+        stores = []
+        if not isinstance(crash_plan, Fence):
+            stores = self.cache.get_stores_from_crash_plan(crash_plan)
+        delta_hash, changed = self.crash_image_builder.delta_hash(
+                                       stores, int(self.mmap_addr, 16))
+        self.add_phase_time('dedup', time.perf_counter() - t0)
+        return (tx_index, fence_index, delta_hash, changed)
+
     # construct the crash pm by persisting the crash plan on current pm
     def construct_crash_state(self, tx_index, fence_index, crash_plan):
         # get the current pm first
+        t0 = time.perf_counter()
         crash_state_file = self.generate_current_state(tx_index,
                                                        fence_index,
                                                        crash_plan)
         # then persist the crash plan on it
+        t1 = time.perf_counter()
         self.persist_crash_plan(crash_state_file, crash_plan)
+        t2 = time.perf_counter()
+        self.add_phase_time('crash_image', t1 - t0)
+        self.add_phase_time('persist', t2 - t1)
 
         # here we make a copy of crash pm for debugging
         # since suffix may modify it
@@ -77,24 +206,59 @@ class WitcherCrashValidator:
 
         return crash_state_file
 
+    # file path: replay_pm_file-tx_index-fence_index-crash_plan_id
+    def get_crash_state_file(self, tx_index, fence_index, crash_plan):
+        return self.replay_pm_file + '-' + \
+               str(tx_index) + '-' + \
+               str(fence_index) + '-' + \
+               str(crash_plan.id)
+
+    # make output the same file as validated_output, if there is one
+    def link_output(self, validated_output, output):
+        if not os.path.isfile(validated_output):
+            return
+        if os.path.lexists(output):
+            os.remove(output)
+        try:
+            os.link(validated_output, output)
+        except OSError:
+            shutil.copyfile(validated_output, output)
+
     # copy the current pm into the output dir
     def generate_current_state(self, tx_index, fence_index, crash_plan):
         # flush the pm.img before copy
         self.cache.binary_file.flush()
-        # file path: replay_pm_file-tx_index-store_id
-        crash_state_file = self.replay_pm_file + '-' + \
-                           str(tx_index) + '-' + \
-                           str(fence_index) + '-' + \
-                           str(crash_plan.id)
-
-        # TODO: should be optimized instead of using cp
-        # copy the current replay_pm_file
+        crash_state_file = self.get_crash_state_file(tx_index, fence_index,
+                                                     crash_plan)
+
+        self.copy_current_state(crash_state_file, (tx_index, fence_index))
+
+        return crash_state_file
+
+    # copy the current replay_pm_file to crash_state_file, the replay_pm_file
+    # only changes between crash states of different base (tx_index,
+    # fence_index)
+    def copy_current_state(self, crash_state_file, base=None):
+        self.init_crash_image_builder()
+
+        # a kept pm file must not be reused by the next crash image
+        if self.crash_image_builder != None and (self.keep_pm_file == False or
+                                self.crash_image_builder.is_reflink()):
+            base_changed = base == None or base != self.crash_image_base
+            self.crash_image_base = base
+            self.crash_image_builder.build(crash_state_file, base_changed)
+            return
+
         cmd = ['cp',
                self.replay_pm_file,
                crash_state_file]
         os.system(' '.join(cmd))
 
-        return crash_state_file
+    def init_crash_image_builder(self):
+        if not self.crash_image_builder_inited:
+            self.crash_image_builder = \
+                                get_crash_image_builder(self.replay_pm_file)
+            self.crash_image_builder_inited = True
 
     # persist the crash plan on the current pm
     def persist_crash_plan(self, crash_state_file, crash_plan):
@@ -105,7 +269,8 @@ class WitcherCrashValidator:
         assert(isinstance(crash_plan, Store))
 
         # init the binary file of the current pm
-        binary_file = BinaryFile(crash_state_file, self.mmap_addr)
+        binary_file = BinaryFile(self.get_pm_image(crash_state_file),
+                                 self.mmap_addr)
         # get all the stores should be persisted
         # (1) crash_plan itself
         # (2) all stores in the same cacheline happens before it
@@ -126,8 +291,17 @@ class WitcherCrashValidator:
                 run_redis(crash_state_file, self.op_file, self.mmap_size,
                               tx_index+1, -1, crash_state_file+'-output', self.tx_id)
         else:
+            if self.stream_oracles and self.fork_server != None:
+                t0 = time.perf_counter()
+                self.load_fork_server_oracles(tx_index)
+                self.add_phase_time('oracle', time.perf_counter() - t0)
+            t0 = time.perf_counter()
             crash_state_output, returncode, crash_core_dump, timeout = \
                        self.execute_from_crash_state(crash_state_file, tx_index)
+            self.add_phase_time('execute', time.perf_counter() - t0)
+            if self.fork_server != None:
+                for phase, seconds in self.fork_server.last_phase_times.items():
+                    self.add_phase_time(phase, seconds)
 
         if timeout == True:
             self.update_result(crash_state_output,
@@ -150,13 +324,24 @@ class WitcherCrashValidator:
             return
 
         # get 2 oracle: full and skip
+        t0 = time.perf_counter()
         oracle_full, oracle_skip = self.get_oracles(tx_index)
-
-        # compare the output with 2 oracles
-        inconsistent, mismatch_res = self.compare_to_oracles(crash_state_output,
+        t1 = time.perf_counter()
+
+        # compare the output with 2 oracles, unless the fork server child
+        # already did while running
+        if self.stream_oracles and self.fork_server != None and \
+                self.fork_server.last_oracle_res != None:
+            inconsistent, mismatch_res = self.compare_streamed_to_oracles(
+                                           self.fork_server.last_oracle_res)
+        else:
+            inconsistent, mismatch_res = self.compare_to_oracles(
+                                                             crash_state_output,
                                                              oracle_full,
                                                              oracle_skip,
                                                              tx_index)
+        self.add_phase_time('oracle', t1 - t0)
+        self.add_phase_time('compare', time.perf_counter() - t1)
 
         # update result
         self.update_result(crash_state_output,
@@ -173,6 +358,9 @@ class WitcherCrashValidator:
                       crash_core_dump,
                       should_report,
                       mismatch_res):
+        self.last_result = (crash_state_output, crash_core_dump,
+                            should_report, mismatch_res)
+
         # update tested crash plan
         self.tested_crash_plans.append(crash_state_output)
 
@@ -202,7 +390,8 @@ class WitcherCrashValidator:
 
     # remove the pm file for saving disk space
     def cleanup_pm_file(self, crash_state_file):
-        if self.keep_pm_file == True:
+        if self.keep_pm_file == True or \
+           self.get_pm_image(crash_state_file) != crash_state_file:
             return
 
         cmd = ['rm',
@@ -215,7 +404,7 @@ class WitcherCrashValidator:
         skip_tx_index = -1
         crash_state_output = crash_state_file + '-output'
         cmd = ['./' + self.validate_exe,
-               crash_state_file,
+               self.get_pm_image(crash_state_file),
                self.mmap_size,
                self.pmdk_pool_layout,
                self.op_file,
@@ -224,7 +413,14 @@ class WitcherCrashValidator:
                crash_state_output]
 
         getLogger().debug('validate cmd: ' + ' '.join(cmd))
-        proc = Popen(cmd, stdout=PIPE, stderr=PIPE)
+        if self.fork_server != None:
+            pid, returncode, timeout = self.fork_server.execute(cmd[1:], 10)
+            crash_core_dump = None
+            if timeout == False and returncode != 0:
+                crash_core_dump = self.get_crash_core_dump(pid)
+            return crash_state_output, returncode, crash_core_dump, timeout
+
+        proc = Popen(cmd, stdout=PIPE, stderr=PIPE, pass_fds=self.pass_fds)
         # TODO for memcached do not use PIPE
         # proc = Popen(cmd)
         # set the timeout for validation
@@ -323,6 +519,32 @@ class WitcherCrashValidator:
 
         return oracle_full, oracle_skip
 
+    # load the oracles of tx_index in the fork server, as compared by
+    # compare_to_oracles
+    def load_fork_server_oracles(self, tx_index):
+        oracle_full, oracle_skip = self.get_oracles(tx_index)
+        if self.fork_server_oracles == (oracle_full, oracle_skip):
+            return
+        # without the oracles, the outputs are compared after the runs
+        self.fork_server.set_oracles(oracle_full, tx_index+1,
+                                     oracle_skip, tx_index)
+        self.fork_server_oracles = (oracle_full, oracle_skip)
+
+    # same as compare_to_oracles with the [full, skip] results of the
+    # comparison in the fork server child. When the child stops at the first
+    # line matching neither oracle, the mismatches are the lines.
+    def compare_streamed_to_oracles(self, oracle_res):
+        mismatch_res = []
+        for res in oracle_res:
+            if res == ORACLE_MATCH:
+                mismatch_res.append('match')
+            elif res == ORACLE_LENGTH:
+                mismatch_res.append('crash')
+            else:
+                mismatch_res.append('tx-' + str(res))
+        inconsistent = ORACLE_MATCH not in oracle_res
+        return inconsistent, ' '.join(mismatch_res)
+
     def compare_to_oracles(self,
                            crash_state_output,
                            oracle_full,
@@ -361,13 +583,13 @@ class WitcherCrashValidator:
                 crash_state_output_list.append(line)
 
         # TODO: if the file not exists, it means it crashed, we return False
-        if not os.path.isfile(oracle):
-            return False, 'crash'
-        oracle_list = []
-        with open(oracle, errors='ignore') as f:
-            for line in f:
-                oracle_list.append(line)
-        oracle_list = oracle_list[oracle_index:]
+        # the oracles are read once, they do not change
+        if oracle not in self.oracle_lines:
+            if not os.path.isfile(oracle):
+                return False, 'crash'
+            with open(oracle, errors='ignore') as f:
+                self.oracle_lines[oracle] = f.readlines()
+        oracle_list = self.oracle_lines[oracle][oracle_index:]
 
         #assert(len(crash_state_output_list) == len(oracle_list))
         # the length may be different because execution may crash due to
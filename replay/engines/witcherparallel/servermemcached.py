@@ -1,90 +1,128 @@
-from pymemcache.client.base import Client
-from subprocess import Popen, PIPE, TimeoutExpired
+from engines.witcherparallel.serverutils import get_socket_path
+from engines.witcherparallel.serverutils import start_server, stop_server
 import os
-import time
+import socket
+import threading
 
 MEMCACHED_DIR = os.environ['WITCHER_HOME'] + '/benchmark/memcached-pmem'
 MAIN_DIR = MEMCACHED_DIR + '/main'
 MAIN_EXE = MAIN_DIR + '/main.exe'
 
-PORT_BASE = 50000
+# seconds to wait for a reply before the server is considered hung
+REPLY_TIMEOUT = 30
+
+# replies of the set and delete requests, all output as True as the
+# pymemcache client returned them with noreply
+SET_DELETE_REPLIES = [b'STORED\r\n', b'NOT_STORED\r\n', b'DELETED\r\n',
+                      b'NOT_FOUND\r\n']
+
+# send all the requests of the ops at once, followed by a version request as a
+# sentinel, and read one reply per op; return the outputs of the ops, as the
+# pymemcache client returns them, up to the first op without a reply
+def run_memcached_ops(socket_path, op_list):
+    requests = []
+    outputs = []
+    for op in op_list:
+        strs = op.split(";")[:-1]
+        op_type = strs[0]
+        key = strs[1]
+        if op_type == 'i':
+            val = strs[2].encode()
+            requests.append(b'set %s 0 0 %d\r\n%s\r\n' % \
+                            (key.encode(), len(val), val))
+        elif op_type == 'd':
+            requests.append(b'delete %s\r\n' % key.encode())
+        elif op_type == 'g':
+            requests.append(b'get %s\r\n' % key.encode())
+        else:
+            # never come to here
+            assert(False)
+    requests.append(b'version\r\n')
+
+    client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    client.settimeout(REPLY_TIMEOUT)
+    # the requests are sent while the replies are read, so neither side
+    # blocks on a full socket buffer
+    sender = threading.Thread(target=send_requests,
+                              args=(client, b''.join(requests)))
+    try:
+        client.connect(socket_path)
+        sender.start()
+        replies = client.makefile('rb')
+        for op in op_list:
+            line = replies.readline()
+            if op.startswith('g;'):
+                # VALUE <key> <flags> <bytes>, the value and END, or only END
+                value = None
+                if line.startswith(b'VALUE '):
+                    length = int(line.split()[3])
+                    value = replies.read(length + 2)[:length]
+                    line = replies.readline()
+                if line != b'END\r\n':
+                    break
+                outputs.append(value)
+            elif line in SET_DELETE_REPLIES:
+                outputs.append(True)
+            else:
+                # the server died, or answered with an error
+                break
+        else:
+            # the sentinel reply, so the connection stays open until the server
+            # has answered every request
+            replies.readline()
+    except (OSError, ValueError, IndexError):
+        # the server died or hung
+        pass
+    finally:
+        # wake up the sender if it is still blocked on the server
+        try:
+            client.shutdown(socket.SHUT_RDWR)
+        except OSError:
+            pass
+        if sender.is_alive():
+            sender.join()
+        client.close()
+    return outputs
+
+def send_requests(client, requests):
+    try:
+        client.sendall(requests)
+    except OSError:
+        # the server died, the replies are cut
+        pass
 
 def run_memcached(pm_file, op_file, pm_size, op_index, skip_index, output_file, tx_id):
-    # start server
+    # start server on a unix socket of its own
+    socket_path = get_socket_path('memcached')
     if os.path.isfile(pm_file):
         # recover cmd
-        cmd = [MAIN_DIR + '/main.exe',
-               '-p ' + str(PORT_BASE+tx_id),
-               '-m 0 -o',
+        cmd = [MAIN_EXE,
+               '-s', socket_path,
+               '-m', '0', '-o',
                'pslab_file=' + pm_file + ',pslab_force,pslab_recover']
     else:
         # no recover cmd
-        cmd = [MAIN_DIR + '/main.exe',
-               '-p ' + str(PORT_BASE+tx_id),
-               '-m 0 -o',
+        cmd = [MAIN_EXE,
+               '-s', socket_path,
+               '-m', '0', '-o',
                'pslab_file=' + pm_file + ',pslab_size=' + pm_size + ',pslab_force']
 
-    proc = Popen(' '.join(cmd), shell=True)
-
-    time.sleep(1)
-
-    ## start client
-    try:
-        client = Client(('localhost', PORT_BASE+tx_id))
-    except:
-        client = None
+    proc, ready = start_server(cmd)
 
     output_list = []
 
-    if client != None:
+    if ready:
         op_list = open(op_file).read().split("\n")[:-1]
-        index = op_index
-        op_length = len(op_list)
-        while index < op_length:
-            if index == skip_index:
-                index += 1
-                continue
-
-            op = op_list[index]
-            strs = op.split(";")[:-1]
-            op_type = strs[0]
-            if op_type == 'i':
-                key = strs[1]
-                val = strs[2]
-                try:
-                    ret = client.set(key, val)
-                except:
-                    break
-                output_list.append(ret)
-            elif op_type == 'd':
-                key = strs[1]
-                try:
-                    ret = client.delete(key)
-                except:
-                    break
-                output_list.append(ret)
-            elif op_type == 'g':
-                key = strs[1]
-                try:
-                    ret = client.get(key)
-                except:
-                    break
-                output_list.append(ret)
-            else:
-                # never come to here
-                assert(False)
-
-            index += 1
-
-        client.close()
+        op_list = [op for index, op in enumerate(op_list) \
+                   if index >= op_index and index != skip_index]
+        output_list = run_memcached_ops(socket_path, op_list)
 
     # write output to the file
     with open(output_file, 'w') as f:
         for line in output_list:
             f.write('%s\n' % line)
 
-    proc.kill()
-    proc.communicate()
+    stop_server(proc, socket_path)
 
     return output_file, 0, None, False
 
@@ -1,7 +1,8 @@
+from engines.witcherparallel.serverutils import get_socket_path
+from engines.witcherparallel.serverutils import start_server, stop_server
+from subprocess import DEVNULL
 import redis
-from subprocess import Popen, PIPE, TimeoutExpired
 import os
-import time
 
 
 REDIS_DIR = os.environ['WITCHER_HOME'] + '/benchmark/redis-3.2-nvml'
@@ -9,68 +10,92 @@ MAIN_DIR = REDIS_DIR + '/main'
 LIB_DIR = REDIS_DIR + '/lib'
 MAIN_EXE = MAIN_DIR + '/main.exe'
 
-PORT_BASE = 50000
+# send the commands at once and read their replies one by one, as the
+# pipeline of the redis client returns them; return the outputs of the ops up
+# to the first op without a reply, so the ops done before the server died keep
+# their outputs
+def run_redis_commands(r, commands, op_types):
+    output_list = []
+    conn = r.connection_pool.get_connection('_')
+    try:
+        conn.send_packed_command(conn.pack_commands(commands))
+        replies = iter(commands)
+        for op_type in op_types:
+            if op_type == 'INIT':
+                output_list.append('')
+                continue
+            output_list.append(r.parse_response(conn, next(replies)[0]))
+    except redis.exceptions.RedisError:
+        # the server died, or answered with an error
+        conn.disconnect()
+    finally:
+        r.connection_pool.release(conn)
+    return output_list
 
 def run_redis(pm_file, op_file, pm_size, op_index, skip_index, output_file, tx_id):
     pm_size += 'mb'
-    # start server
-    cmd = [MAIN_DIR + '/main.exe',
+    # start server on a unix socket of its own
+    socket_path = get_socket_path('redis')
+    cmd = [MAIN_EXE,
            LIB_DIR + '/redis.conf',
            'pmfile',
            pm_file,
            pm_size,
-           '--port ' + str(PORT_BASE+tx_id)]
-
-    proc = Popen(' '.join(cmd), shell=True, stdout=PIPE, stderr=PIPE)
-    #proc = Popen(' '.join(cmd), shell=True)
+           '--port', '0',
+           '--unixsocket', socket_path]
 
-    time.sleep(1)
+    proc, ready = start_server(cmd, stdout=DEVNULL, stderr=DEVNULL)
 
-    # redis connection
-    r = redis.Redis(host='localhost', port=PORT_BASE+tx_id)
-    op_list = open(op_file).read().split("\n")[:-1]
     output_list = []
-    index = op_index
-    op_length = len(op_list)
-    while index < op_length:
-        if index == skip_index:
-            index += 1
-            continue
+    if ready:
+        # redis connection, all the ops are sent at once
+        r = redis.Redis(unix_socket_path=socket_path)
+        op_list = open(op_file).read().split("\n")[:-1]
+        commands = []
+        op_types = []
+        index = op_index
+        op_length = len(op_list)
+        while index < op_length:
+            if index == skip_index:
+                index += 1
+                continue
 
-        op = op_list[index]
-        strs = op.split(";")[:-1]
-        op_type = strs[0]
-        if op_type == 'i':
-            key = 'key:'+strs[1]
-            val = 'val:'+strs[2]
-            ret = r.set(key, val)
-            output_list.append(ret)
-        elif op_type == 'd':
-            key = 'key:'+strs[1]
-            ret = r.delete(key)
-            output_list.append(ret)
-        elif op_type == 'g':
-            key = 'key:'+strs[1]
-            ret = r.get(key)
-            output_list.append(ret)
-        elif op_type == 'INIT':
-            ret = ''
-            output_list.append(ret)
-        else:
-            # never come to here
-            assert(False)
-        index += 1
+            op = op_list[index]
+            strs = op.split(";")[:-1]
+            op_type = strs[0]
+            if op_type == 'i':
+                key = 'key:'+strs[1]
+                val = 'val:'+strs[2]
+                commands.append(('SET', key, val))
+            elif op_type == 'd':
+                key = 'key:'+strs[1]
+                commands.append(('DEL', key))
+            elif op_type == 'g':
+                key = 'key:'+strs[1]
+                commands.append(('GET', key))
+            elif op_type == 'INIT':
+                # no request, its output is added below
+                pass
+            else:
+                # never come to here
+                assert(False)
+            op_types.append(op_type)
+            index += 1
 
-    #r.shutdown(save=True)
-    r.shutdown(save=False)
+        output_list = run_redis_commands(r, commands, op_types)
+        try:
+            #r.shutdown(save=True)
+            r.shutdown(save=False)
+        except redis.exceptions.RedisError:
+            # the server died running the ops
+            pass
 
     # write output to the file
     with open(output_file, 'w') as f:
         for line in output_list:
             f.write('%s\n' % line)
 
-    #proc.kill()
-    proc.communicate()
+    stop_server(proc, socket_path)
 
     return output_file, 0, None, False
 
@@ -0,0 +1,38 @@
+from subprocess import Popen
+import itertools
+import os
+import select
+
+# how long a server may take to recover from a crash state before it is taken
+# as hung
+READY_TIMEOUT = 10
+
+_socket_ids = itertools.count()
+
+# a unix socket path unique to this process, so validators running at the same
+# time do not share a port
+def get_socket_path(name):
+    return '/tmp/witcher-%s-%d-%d.sock' % (name, os.getpid(), next(_socket_ids))
+
+# start the server and wait until it signals it is ready (see
+# witcher_server_ready in the server sources) instead of sleeping a fixed time;
+# return the process and whether it got ready
+def start_server(cmd, **kwargs):
+    ready_r, ready_w = os.pipe()
+    env = dict(os.environ)
+    env['WITCHER_READY_FD'] = str(ready_w)
+    proc = Popen(cmd, env=env, pass_fds=(ready_w,), **kwargs)
+    os.close(ready_w)
+
+    # the pipe reaches eof without ready if the server dies recovering
+    readable, _, _ = select.select([ready_r], [], [], READY_TIMEOUT)
+    ready = len(readable) > 0 and os.read(ready_r, 6) == b'ready\n'
+    os.close(ready_r)
+    return proc, ready
+
+def stop_server(proc, socket_path):
+    if proc.poll() == None:
+        proc.kill()
+    proc.communicate()
+    if os.path.exists(socket_path):
+        os.remove(socket_path)
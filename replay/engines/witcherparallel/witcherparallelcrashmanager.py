@@ -5,6 +5,8 @@ from mem.cachenumbers import get_cacheline_address
 from engines.witcher.binaryfile import BinaryFile
 from engines.witcher.pmdktracehandler import PMDKTraceHandler
 from engines.witcher.witchercache import WitcherCache
+from engines.witcher.nativecache import get_native_cache
+from engines.witcher.nativecache import NativeWitcherCache
 from engines.witcher.witchercrashvalidator import WitcherCrashValidator
 from engines.witcher.witchercrashmanager import CrashCandidates
 from engines.witcher.witchercrashmanager import WitcherCrashManager
@@ -35,20 +37,32 @@ class CrashCandidatesParallel(CrashCandidates):
         self.crash_candidates_per_tx = dict()
         self.crash_candidates_per_tx[self.tx_id] = self.crash_candidates
 
+# the trace and the belief database loaded by this process, by pickle path, so
+# the tasks run by a worker load them once
+_loaded_pickles = dict()
+
+def load_pickle(path):
+    if path not in _loaded_pickles:
+        _loaded_pickles[path] = pickle.load(open(path, 'rb'))
+    return _loaded_pickles[path]
+
+# validate the crash plans of a tx, only at its fences [fence_begin, fence_end)
+# (counted from the first fence of the tx) unless fence_end is -1. A manager
+# stopped at fence_end can resume up to a later fence (see resume), so the next
+# fences reuse its replay, its crash candidates and its dedup results.
 class WitcherParallelCrashManager(WitcherCrashManager):
-    def __init__(self, args, tx_id):
+    def __init__(self, args, tx_id, fence_begin=0, fence_end=-1):
         # initialize self fields for components
-        self.init_misc_0(args, tx_id)
+        self.init_misc_0(args, tx_id, fence_begin, fence_end)
         # initialize trace
         self.init_trace()
+        # initialize belief_database
+        self.init_belief_database()
 
         # TODO if too long, we just return
-        curr_range = self.trace.atomic_write_ops_tx_ranges[self.tx_id]
-        if (curr_range[1] - curr_range[0] > 90000):
+        if self.is_tx_too_long():
             return
 
-        # initialize belief_database
-        self.init_belief_database()
         # initialize crash candidates
         self.init_crash_candidates()
 
@@ -70,8 +84,7 @@ class WitcherParallelCrashManager(WitcherCrashManager):
 
     def run(self):
         # TODO if too long, we just return
-        curr_range = self.trace.atomic_write_ops_tx_ranges[self.tx_id]
-        if (curr_range[1] - curr_range[0] > 90000):
+        if self.is_tx_too_long():
             return
         # if there is no crash_candidates, we just return
         if len(self.crash_candidates.crash_candidates) == 0:
@@ -87,17 +100,61 @@ class WitcherParallelCrashManager(WitcherCrashManager):
         self.run_try_traget()
         # send results to the server
         self.epilogue()
+        if self.finished:
+            self.close()
+
+    # return True if the manager can validate the fences from fence_begin of
+    # tx_id, after the ones it has validated
+    def can_resume(self, tx_id, fence_begin):
+        return tx_id == self.tx_id and fence_begin == self.fence_end and \
+               not self.finished
+
+    # validate the fences up to fence_end, after the ones already validated
+    def resume(self, fence_end):
+        self.fence_end = fence_end
+        if not self.validating:
+            return
+        self.run_try_traget()
+        # the results so far, over the ones of the previous fences
+        self.epilogue()
+        if self.finished:
+            self.close()
+
+    def close(self):
+        if not self.validating:
+            return
+        self.validating = False
+        self.crash_validator.close()
+        if isinstance(self.cache, NativeWitcherCache):
+            self.cache.close()
+
+    # without the native belief database, the crash candidates of a long tx
+    # take too long to generate
+    def is_tx_too_long(self):
+        if self.belief_database.get_native() != None:
+            return False
+        curr_range = self.trace.atomic_write_ops_tx_ranges[self.tx_id]
+        return curr_range[1] - curr_range[0] > 90000
 
     # initialize self fields for components
-    def init_misc_0(self, args, tx_id):
+    def init_misc_0(self, args, tx_id, fence_begin, fence_end):
         self.tx_id = tx_id
+        self.fence_begin = fence_begin
+        self.fence_end = fence_end
+        # the tx is validated up to its end, or the tx is not validated
+        self.finished = False
+        # the cache and the crash validator are open
+        self.validating = False
         self.output_partent = args.output_dir
         self.server_name = args.server_name
 
     # initialize self fields for components
     def init_misc_1(self, args, tx_id):
-        # initialize output
+        # initialize output, a task validating part of the fences of the tx
+        # has its own
         self.output = args.output_dir + '/tx-' + str(tx_id)
+        if self.fence_begin != 0 or self.fence_end != -1:
+            self.output += '-fence-' + str(self.fence_begin)
         os.system('mkdir ' + self.output)
 
         # initialize for binary file
@@ -116,16 +173,20 @@ class WitcherParallelCrashManager(WitcherCrashManager):
         self.pmdk_create_layout = args.pmdk_create_layout
         self.validate_op_file = args.validate_op_file
         self.full_oracle_file = args.full_oracle_file
+        self.fork_server = args.fork_server
+        self.memfd_images = args.memfd_images
+        self.dedup = args.dedup
+        self.stream_oracles = args.stream_oracles
 
     # initialize trace
     def init_trace(self):
         trace_path = self.output_partent + '/' + PICKLE_TRACE
-        self.trace = pickle.load(open(trace_path, 'rb'))
+        self.trace = load_pickle(trace_path)
 
     # initialize belief database
     def init_belief_database(self):
         belief_database_path = self.output_partent + '/' + PICKLE_BELIEF
-        self.belief_database = pickle.load(open(belief_database_path, 'rb'))
+        self.belief_database = load_pickle(belief_database_path)
 
     # initialize crash candidates
     def init_crash_candidates(self):
@@ -138,7 +199,18 @@ class WitcherParallelCrashManager(WitcherCrashManager):
     def init_cache(self):
         self.binary_file = BinaryFile(self.replay_pm_file, \
                                       self.pmdk_mmap_base_addr)
-        self.cache = WitcherCache(self.binary_file)
+        # simulate the cache natively when the trace is binary
+        self.cache = get_native_cache(self.trace,
+                                      self.replay_pm_file,
+                                      self.pmdk_mmap_base_addr,
+                                      self.binary_file)
+        if self.cache == None:
+            self.cache = WitcherCache(self.binary_file)
+            # the python cache keeps the states in the stores, which a
+            # previous task of this process may have changed
+            for op in self.trace.atomic_write_ops:
+                if isinstance(op, Store):
+                    op.flushed = 0
 
     # initialize crash validate
     def init_crash_validator(self):
@@ -153,49 +225,69 @@ class WitcherParallelCrashManager(WitcherCrashManager):
                                                      self.output,
                                                      self.server_name,
                                                      self.tx_id)
+        if self.dedup:
+            self.crash_validator.enable_dedup()
+        if self.stream_oracles:
+            self.crash_validator.enable_stream_oracles()
+        if self.memfd_images and self.server_name == 'na':
+            self.crash_validator.enable_memfd_images(self.memfd_images == 2)
+        if self.fork_server and self.server_name == 'na':
+            self.crash_validator.enable_fork_server()
+        self.validating = True
 
     # replay from beginning to target store without crash
     def run_before_target(self):
         first_tx_start_id = self.trace.atomic_write_ops_tx_ranges[0][0]
         target_tx_range = self.trace.atomic_write_ops_tx_ranges[self.tx_id]
-        ops = self.trace.atomic_write_ops[0:target_tx_range[0]]
-        for op in ops:
-            # if it is fence
-            if self.cache.accept(op):
-                # if it is fence then write back all flushing stores
-                self.cache.write_back_all_flushing_stores()
-            # if it is TXEnd then write back all stores
-            if isinstance(op, TXEnd):
-                self.cache.write_back_all_stores()
-            # if it is the one right before the first TXStart
-            # then write back all stores
-            if op.id == first_tx_start_id - 1:
-                # write back at TXEnd
-                self.cache.write_back_all_stores()
+        self.cache.replay(self.trace.atomic_write_ops, 0, target_tx_range[0],
+                          first_tx_start_id)
+        # the next op and fence of the tx to replay
+        self.next_op = target_tx_range[0]
+        self.next_fence = 0
 
     # replay from target store
     # and try to find right places to crash and validate
     def run_try_traget(self):
         target_tx_range = self.trace.atomic_write_ops_tx_ranges[self.tx_id]
-        ops = self.trace.atomic_write_ops[target_tx_range[0]:target_tx_range[1]]
-        for op in ops:
-            if self.cache.accept(op):
+        ops = self.trace.atomic_write_ops
+        i = self.next_op
+        fence_count = self.next_fence
+        while fence_count != self.fence_end:
+            i = self.cache.accept_until_fence(ops, i, target_tx_range[1])
+            if i == target_tx_range[1]:
+                break
+            op = ops[i]
+            if fence_count >= self.fence_begin:
                 # try crash at fence
                 processed_candidates = \
-                                self.try_crash_candidates(self.tx_id, op.id, op)
-                # if it is fence then write back all flushing stores
-                self.cache.write_back_all_flushing_stores()
-                # bring back potential candidates
-                self.bring_back_potential_candidates(processed_candidates,\
-                                                     self.tx_id)
+                            self.try_crash_candidates(self.tx_id, op.id, op)
+            else:
+                # the fence is validated by another task, only process the
+                # candidates as it does
+                _, processed_candidates = \
+                            self.verify_crash_candidates(self.tx_id, op.id, op)
+            # if it is fence then write back all flushing stores
+            self.cache.write_back_all_flushing_stores()
+            # bring back potential candidates
+            self.bring_back_potential_candidates(processed_candidates,\
+                                                 self.tx_id)
+            i += 1
+            fence_count += 1
+        self.next_op = i
+        self.next_fence = fence_count
+        if fence_count == self.fence_end and i != target_tx_range[1]:
+            # stopped before the end of the tx, the next fences may resume
+            return
         # TODO: missing flushes
         # write back all stores at the end of TX
         self.cache.write_back_all_stores()
+        self.finished = True
 
     # pickle the result
     def epilogue(self):
         v = self.crash_validator
         res = [v.tested_crash_plans, v.reported_crash_plans, \
                v.reported_src_map, v.reported_core_dump_map, \
-               v.reported_priority, self.crash_candidates_snapshot]
+               v.reported_priority, self.crash_candidates_snapshot,
+               v.phase_times, v.dedup_stats]
         pickle.dump(res, open(self.output+'/'+PICKLE_VALIDATE_RES, 'wb'))
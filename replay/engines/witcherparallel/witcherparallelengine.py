@@ -1,9 +1,12 @@
 from mem.witchertrace import WitcherTrace
+from mem.memoryoperations import Fence
 from engines.witcher.witcherppdg import WitcherPPDGs
 from engines.witcher.witcherbeliefdatabase import WitcherBeliefDatabase
 from engines.witcherparallel.witcherparallelresprinter import WitcherParallelResPrinter
+import glob
 import os
 import pickle
+import subprocess
 from concurrent.futures import ProcessPoolExecutor, wait
 from engines.witcherutils.WitcherParallelUtils import getThreadPoolStatus,threadPoolDispatchTask,threadPoolWait
 import datetime
@@ -13,6 +16,16 @@ PICKLE_TRACE = 'trace.pickle'
 PICKLE_BELIEF= 'belief.pickle'
 PICKLE_VALIDATE_RES = 'validate_res.pickle'
 PICKLE_RES = 'res.pickle'
+SCHED_TASKS = 'sched-tasks.txt'
+SCHED_UTIL = 'sched-util.txt'
+
+# cost of replaying an op, relative to the cost of validating the crash
+# states of an op
+REPLAY_OP_COST = 0.001
+
+# the native validation scheduler is built with the giri tools
+VALIDATION_SCHEDULER = os.environ.get('WITCHER_HOME', '') + \
+                       '/giri/build-llvm9/valsched'
 
 class WitcherParallelEngine:
     def __init__(self, args):
@@ -43,30 +56,87 @@ class WitcherParallelEngine:
         args = self.output + '/' + PICKLE_ARGS
 
         t0 = datetime.datetime.now()
-        for tx_id in range(len(self.trace.atomic_write_ops_tx_ranges)):
-            cmd = self.exe_path + \
-                    '/witcher_parallel_unit.py' + \
-                    ' -args ' + args + \
-                    ' -tx ' + str(tx_id)
+        if not self.sched or not self.run_scheduler(args):
+            for tx_id in range(len(self.trace.atomic_write_ops_tx_ranges)):
+                cmd = self.exe_path + \
+                        '/witcher_parallel_unit.py' + \
+                        ' -args ' + args + \
+                        ' -tx ' + str(tx_id)
+                if self.useTPL:
+                    threadPoolDispatchTask(cmd)
+                else:
+                    futures.append(self.pool_executor.submit(os.system, cmd))
             if self.useTPL:
-                threadPoolDispatchTask(cmd)
+                threadPoolWait()
             else:
-                futures.append(self.pool_executor.submit(os.system, cmd))
-        if self.useTPL:
-            threadPoolWait()
-        else:
-            wait(futures)
+                wait(futures)
         t1 = datetime.datetime.now()
         self.overhead_f.write('validation: ' + str(t1-t0) + '\n')
 
         # print the result
         self.epilogue()
 
+    # run the validation of all the TXs with the native scheduler, split into
+    # tasks of at most fences_per_task fences; return False if the scheduler is
+    # not built
+    # A task replays the trace up to its first fence and generates the crash
+    # candidates of its tx, unless its worker has just run the previous task of
+    # the same tx and resumes from there (see witcher_parallel_unit.py), so
+    # the tasks of a tx are a group the scheduler keeps on one worker, in order.
+    def run_scheduler(self, args):
+        if not os.path.isfile(VALIDATION_SCHEDULER):
+            return False
+
+        tasks_path = self.output + '/' + SCHED_TASKS
+        with open(tasks_path, 'w') as tasks:
+            for tx_id, tx_range in \
+                    enumerate(self.trace.atomic_write_ops_tx_ranges):
+                ops = self.trace.atomic_write_ops[tx_range[0]:tx_range[1]]
+                fences = [i for i, op in enumerate(ops) if isinstance(op, Fence)]
+                num_fences = len(fences)
+                # the crash states of a tx grow with its ops
+                cost = len(ops) + 1
+                # the trace before the tx, and the crash candidates of the tx
+                prefix_ops = tx_range[0] + len(ops)
+                if self.fences_per_task == 0 or \
+                        num_fences <= self.fences_per_task:
+                    tasks.write('%f %f %d %d 0 -1\n' % \
+                                (cost, prefix_ops * REPLAY_OP_COST, tx_id,
+                                 tx_id))
+                    continue
+                for begin in range(0, num_fences, self.fences_per_task):
+                    end = min(begin + self.fences_per_task, num_fences)
+                    # and the ops of the tx before the first fence of the task
+                    replay_ops = prefix_ops + (fences[begin - 1] + 1 \
+                                               if begin > 0 else 0)
+                    tasks.write('%f %f %d %d %d %d\n' % \
+                                (cost * (end - begin) / num_fences,
+                                 replay_ops * REPLAY_OP_COST, tx_id,
+                                 tx_id, begin, end))
+
+        util_path = self.output + '/' + SCHED_UTIL
+        cmd = [VALIDATION_SCHEDULER,
+               '-j', str(os.cpu_count() - 1),
+               '-util', util_path,
+               tasks_path,
+               self.exe_path + '/witcher_parallel_unit.py',
+               '-args', args,
+               '-worker']
+        subprocess.call(cmd)
+
+        # per-core utilization
+        if os.path.isfile(util_path):
+            for line in open(util_path):
+                self.overhead_f.write('validation ' + line)
+        return True
+
     # initialize the output dir
     # initialize the witcher parallel path
     # pickle the args
     def init_misc(self, args):
         self.useTPL = args.useThreadPool
+        self.sched = args.sched
+        self.fences_per_task = args.fences_per_task
         self.output = args.output_dir
         os.system('mkdir ' + self.output)
 
@@ -97,6 +167,44 @@ class WitcherParallelEngine:
         self.pool_executor = ProcessPoolExecutor(max_workers=os.cpu_count()-1)
         #self.pool_executor = ProcessPoolExecutor(max_workers=32)
 
+    # load the validation result of a tx, merged over the tasks validating
+    # parts of its fences, None if there is no result
+    def load_validate_res(self, tx_id):
+        tx_output = self.output + '/tx-' + str(tx_id)
+        paths = [tx_output + '/' + PICKLE_VALIDATE_RES]
+        paths += sorted(glob.glob(tx_output + '-fence-*/' + \
+                                  PICKLE_VALIDATE_RES),
+                        key=lambda path: int(path.split('-fence-')[1] \
+                                                 .split('/')[0]))
+        v_res = None
+        for path in paths:
+            if not os.path.isfile(path):
+                continue
+            res = pickle.load(open(path, 'rb'))
+            if v_res == None:
+                v_res = res
+                continue
+            # tested and reported crash plans
+            v_res[0] += res[0]
+            v_res[1] += res[1]
+            # src and core dump maps
+            for i in [2, 3]:
+                for key, outputs in res[i].items():
+                    v_res[i].setdefault(key, []).extend(outputs)
+            # priority
+            for src_info, core_dumps in res[4].items():
+                priority = v_res[4].setdefault(src_info, dict())
+                for core_dump, outputs in core_dumps.items():
+                    priority.setdefault(core_dump, []).extend(outputs)
+            # the crash candidates are the ones of the whole tx in every
+            # task, so they are taken once
+            # phase times and dedup stats
+            for i in [6, 7]:
+                if len(res) > i and len(v_res) > i:
+                    for key, val in res[i].items():
+                        v_res[i][key] = v_res[i].get(key, 0) + val
+        return v_res
+
     # print the result
     def epilogue(self):
         crash_candidates_per_tx_list = []
@@ -105,14 +213,15 @@ class WitcherParallelEngine:
         reported_src_map_per_tx_list = []
         reported_core_dump_map_per_tx_list = []
         reported_priority_per_tx_list = []
+        phase_times = dict()
+        dedup_stats = dict()
 
         for tx_id in range(len(self.trace.atomic_write_ops_tx_ranges)):
-            path = self.output + '/tx-' + str(tx_id) + '/' + PICKLE_VALIDATE_RES
-            if not os.path.isfile(path):
+            v_res = self.load_validate_res(tx_id)
+            if v_res == None:
                 crash_candidates_per_tx_list.append([])
                 tested_crash_plans_per_tx_list.append([])
                 continue
-            v_res = pickle.load(open(path, 'rb'))
 
             tested_crash_plans = v_res[0]
             tested_crash_plans_per_tx_list.append(tested_crash_plans)
@@ -132,6 +241,23 @@ class WitcherParallelEngine:
             crash_candidates = v_res[5]
             crash_candidates_per_tx_list.append(crash_candidates)
 
+            if len(v_res) > 6:
+                for phase, seconds in v_res[6].items():
+                    phase_times[phase] = phase_times.get(phase, 0) + seconds
+            if len(v_res) > 7:
+                for stat, count in v_res[7].items():
+                    dedup_stats[stat] = dedup_stats.get(stat, 0) + count
+
+        # time spent in each validation phase, summed over all the TXs
+        for phase in sorted(phase_times):
+            self.overhead_f.write('validation ' + phase + ': ' + \
+                                  str(datetime.timedelta(
+                                      seconds=phase_times[phase])) + '\n')
+        # crash states validated and skipped as duplicates of another one
+        for stat in sorted(dedup_stats):
+            self.overhead_f.write('crash states ' + stat + ': ' + \
+                                  str(dedup_stats[stat]) + '\n')
+
         printer = self.res_printer
         printer.print_crash_candidates(crash_candidates_per_tx_list)
         printer.print_tested_crash_plans(tested_crash_plans_per_tx_list)
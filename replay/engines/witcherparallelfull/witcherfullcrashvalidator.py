@@ -35,12 +35,7 @@ class WitcherFullCrashValidator(WitcherCrashValidator):
                            str(fence_index) + '-' + \
                            str(crash_plan[0])
 
-        # TODO: should be optimized instead of using cp
-        # copy the current replay_pm_file
-        cmd = ['cp',
-               self.replay_pm_file,
-               crash_state_file]
-        os.system(' '.join(cmd))
+        self.copy_current_state(crash_state_file, (tx_index, fence_index))
 
         return crash_state_file
 
@@ -52,7 +47,8 @@ class WitcherFullCrashValidator(WitcherCrashValidator):
             return
 
         # init the binary file of the current pm
-        binary_file = BinaryFile(crash_state_file, self.mmap_addr)
+        binary_file = BinaryFile(self.get_pm_image(crash_state_file),
+                                 self.mmap_addr)
         # get all the stores should be persisted
         # (1) crash_plan itself
         # (2) all stores in the same cacheline happens before it
@@ -33,6 +33,7 @@ class WitcherParallelFullCrashManager:
         self.run_try_traget()
         ## send results to the server
         self.epilogue()
+        self.crash_validator.close()
 
     # initialize self fields for components
     def init_misc_0(self, args, tx_id):
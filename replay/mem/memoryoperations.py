@@ -121,11 +121,12 @@ class Store(BaseOperation, Rangeable):
         self.flushed = 0
 
         # Initialize the byte representation of value for writing to a file
+        # The binary trace reader already gives the value as bytes
         self.value = value
-        value_bytes = ""
-        for byte in value:
-            value_bytes = value_bytes + byte
-        self.value_bytes = bytes(bytearray.fromhex(value_bytes))
+        if isinstance(value, bytes):
+            self.value_bytes = value
+        else:
+            self.value_bytes = bytes(bytearray.fromhex("".join(value)))
 
         BaseOperation.__init__(self, op_id, tid, src_info)
 
@@ -8,18 +8,32 @@ from mem.memoryoperations import PMDKTXAdd
 from mem.memoryoperations import PMDKTXAlloc
 from mem.memoryoperations import PMDKCall
 from mem.cachenumbers import ATOMIC_WRITE_BYTES
+from mem.witchertracebin import is_witcher_trace_bin
+from mem.witchertracebin import extract_operations_bin
 from misc.witcherexceptions import NotSupportedOperationException
 from logging import getLogger
+import os
 
 class WitcherTrace:
     def __init__(self, arg_trace):
-        # unprocessed trace
-        self.trace = open(arg_trace).read().split("\n")
-        self.trace = self.trace[:-1]
-        # process the trace
         self.ops_tx_ranges = []
         self.atomic_write_ops_tx_ranges = []
-        self.ops, self.atomic_write_ops = self.extract_operations()
+        # the binary trace, also read by the native cache
+        self.trace_bin_file = None
+        if is_witcher_trace_bin(arg_trace):
+            # binary trace, the stores are already split
+            self.trace = []
+            self.trace_bin_file = os.path.abspath(arg_trace)
+            self.ops, self.atomic_write_ops = extract_operations_bin(
+                                            arg_trace,
+                                            self.ops_tx_ranges,
+                                            self.atomic_write_ops_tx_ranges)
+        else:
+            # unprocessed trace
+            self.trace = open(arg_trace).read().split("\n")
+            self.trace = self.trace[:-1]
+            # process the trace
+            self.ops, self.atomic_write_ops = self.extract_operations()
 
         getLogger().debug("ops: " + str(self.ops))
         getLogger().debug("ops_tx_ranges: " + str(self.ops_tx_ranges))
@@ -0,0 +1,126 @@
+from mem.memoryoperations import Store
+from mem.memoryoperations import Flush
+from mem.memoryoperations import Fence
+from mem.memoryoperations import TXStart
+from mem.memoryoperations import TXEnd
+from mem.memoryoperations import PMDKTXAdd
+from mem.memoryoperations import PMDKTXAlloc
+from mem.memoryoperations import PMDKCall
+from mem.cachenumbers import ATOMIC_WRITE_BYTES
+from logging import getLogger
+import mmap
+import struct
+
+# Binary PM trace written by WitcherPMTrace -pmtrace-bin-file, see
+# giri/include/Witcher/PMTraceBin.h for the layout
+PMTRACE_BIN_MAGIC = 0x544d5057
+PMTRACE_BIN_VERSION = 2
+HEADER = struct.Struct("<IIIIQQ")
+RECORD = struct.Struct("<B3xIQQII")
+
+# check the file is a binary PM trace
+def is_witcher_trace_bin(arg_trace):
+    with open(arg_trace, "rb") as f:
+        magic = f.read(4)
+    return len(magic) == 4 and \
+           struct.unpack("<I", magic)[0] == PMTRACE_BIN_MAGIC
+
+# Read the ops and the atomic write ops of a binary PM trace. The stores are
+# already split into ATOMIC_WRITE_BYTES chunks, so the ops are built as they
+# are read. The TX ranges are appended to ops_tx_ranges and
+# atomic_write_ops_tx_ranges.
+def extract_operations_bin(arg_trace, ops_tx_ranges, atomic_write_ops_tx_ranges):
+    with open(arg_trace, "rb") as f:
+        buf = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+    magic, version, atomic_write_bytes, num_strs, num_records, strtab_offset = \
+        HEADER.unpack_from(buf, 0)
+    assert(magic == PMTRACE_BIN_MAGIC)
+    assert(version == PMTRACE_BIN_VERSION)
+    assert(atomic_write_bytes == ATOMIC_WRITE_BYTES)
+
+    # string table: source locations and PMDK function names
+    strs = []
+    offset = strtab_offset
+    for _ in range(num_strs):
+        length, = struct.unpack_from("<I", buf, offset)
+        offset += 4
+        strs.append(buf[offset:offset+length].decode())
+        offset += length
+
+    ops = []
+    atomic_write_ops = []
+    op_curr_tx_start_index = -1
+    atomic_write_op_curr_tx_start_index = -1
+    value = b""
+    offset = HEADER.size
+    for _ in range(num_records):
+        op_type, src, tid, address, size, aux = RECORD.unpack_from(buf, offset)
+        offset += RECORD.size
+        op_type = chr(op_type)
+        src_info = strs[src]
+        op_curr_index = len(ops)
+        atomic_write_op_curr_index = len(atomic_write_ops)
+
+        if op_type == "S":
+            value = buf[offset:offset+size]
+            offset += (size + 7) & ~7
+            ops.append(Store(address, size, value, op_curr_index, tid,
+                             src_info))
+        elif op_type == "W":
+            atomic_write_ops.append(Store(address, size, value[aux:aux+size],
+                                          atomic_write_op_curr_index, tid,
+                                          src_info))
+        elif op_type == "H":
+            ops.append(Flush(address, op_curr_index, tid, src_info))
+            atomic_write_ops.append(Flush(address, atomic_write_op_curr_index,
+                                          tid, src_info))
+        elif op_type == "F":
+            ops.append(Fence(op_curr_index, tid, src_info))
+            atomic_write_ops.append(Fence(atomic_write_op_curr_index, tid,
+                                          src_info))
+        elif op_type == "B":
+            ops.append(TXStart(op_curr_index, tid, src_info))
+            atomic_write_ops.append(TXStart(atomic_write_op_curr_index, tid,
+                                            src_info))
+
+            assert(op_curr_tx_start_index == -1)
+            op_curr_tx_start_index = op_curr_index
+            assert(atomic_write_op_curr_tx_start_index == -1)
+            atomic_write_op_curr_tx_start_index = atomic_write_op_curr_index
+        elif op_type == "E":
+            ops.append(TXEnd(op_curr_index, tid, src_info))
+            atomic_write_ops.append(TXEnd(atomic_write_op_curr_index, tid,
+                                          src_info))
+
+            assert(op_curr_tx_start_index != -1)
+            ops_tx_ranges.append([op_curr_tx_start_index, op_curr_index])
+            op_curr_tx_start_index = -1
+            assert(atomic_write_op_curr_tx_start_index != -1)
+            atomic_write_ops_tx_ranges.append([
+                                        atomic_write_op_curr_tx_start_index,
+                                        atomic_write_op_curr_index])
+            atomic_write_op_curr_tx_start_index = -1
+        elif op_type == "A":
+            ops.append(PMDKTXAlloc(address, size, op_curr_index, tid, src_info))
+            atomic_write_ops.append(PMDKTXAlloc(address, size,
+                                                atomic_write_op_curr_index,
+                                                tid, src_info))
+        elif op_type == "T":
+            ops.append(PMDKTXAdd(address, size, op_curr_index, tid, src_info))
+            atomic_write_ops.append(PMDKTXAdd(address, size,
+                                              atomic_write_op_curr_index,
+                                              tid, src_info))
+        elif op_type == "C" or op_type == "R":
+            note = "start" if op_type == "C" else "end"
+            ops.append(PMDKCall(strs[aux], op_curr_index, tid, src_info, note))
+            atomic_write_ops.append(PMDKCall(strs[aux],
+                                             atomic_write_op_curr_index,
+                                             tid, src_info, note))
+        else:
+            assert False, "Unknown binary PM trace record: " + op_type
+
+    buf.close()
+    getLogger().debug("binary trace: %d records, %d ops, %d atomic write ops",
+                      num_records, len(ops), len(atomic_write_ops))
+    return ops, atomic_write_ops
@@ -63,8 +63,43 @@ def main():
                         required=True,
                         help="na, redis, memcached")
 
+    parser.add_argument("-forkserver", "--fork-server",
+                        default="0",
+                        help="validate crash states in a fork server")
+
+    parser.add_argument("-dedup", "--dedup",
+                        default="1",
+                        help="validate crash plans with the same crash " \
+                             "image once")
+
+    parser.add_argument("-streamoracle", "--stream-oracles",
+                        default="1",
+                        help="compare the outputs with the oracles while " \
+                             "the fork server children run")
+
+    parser.add_argument("-sched", "--sched",
+                        default="1",
+                        help="validate with the native scheduler, one " \
+                             "worker per core")
+
+    parser.add_argument("-fencespertask", "--fences-per-task",
+                        default="8",
+                        help="fences of a tx validated by a scheduler " \
+                             "task, 0 for the whole tx")
+
+    parser.add_argument("-memfd", "--memfd-images",
+                        default="0",
+                        help="crash images in a memfd: 0 files, 1 memfd, " \
+                             "2 memfd backed by hugepages")
+
     args = parser.parse_args()
     args.useThreadPool = int(args.useThreadPool)
+    args.fork_server = int(args.fork_server)
+    args.memfd_images = int(args.memfd_images)
+    args.dedup = int(args.dedup)
+    args.stream_oracles = int(args.stream_oracles)
+    args.sched = int(args.sched)
+    args.fences_per_task = int(args.fences_per_task)
     if args.useThreadPool:
         startWitcherThreadPool();
         poolStatus = getThreadPoolStatus()
@@ -1,9 +1,51 @@
 #!/usr/bin/python3
 
 import argparse
+import os
 import pickle
+import sys
+import traceback
 from engines.witcherparallel.witcherparallelcrashmanager import WitcherParallelCrashManager
 
+# run the tasks sent by the validation scheduler (giri/tools/ValidationScheduler)
+# on stdin, one per line: "tx_id fence_begin fence_end", and answer each one
+# with "done" or "failed". A task following the previous one in the same tx
+# resumes its crash manager instead of replaying the trace again.
+def run_worker(args_from_pickle):
+    # the answers go to the scheduler, anything else printed goes to stderr
+    response = os.fdopen(os.dup(sys.stdout.fileno()), 'w')
+    os.dup2(sys.stderr.fileno(), sys.stdout.fileno())
+
+    manager = None
+    for line in sys.stdin:
+        if line.strip() == '':
+            continue
+        tx_id, fence_begin, fence_end = [int(x) for x in line.split()]
+        try:
+            if manager != None and manager.can_resume(tx_id, fence_begin):
+                manager.resume(fence_end)
+            else:
+                if manager != None:
+                    manager.close()
+                    manager = None
+                manager = WitcherParallelCrashManager(args_from_pickle, tx_id,
+                                                      fence_begin, fence_end)
+                manager.run()
+            response.write('done\n')
+        except Exception:
+            traceback.print_exc()
+            response.write('failed\n')
+            # a failed manager is not resumed
+            if manager != None:
+                try:
+                    manager.close()
+                except Exception:
+                    traceback.print_exc()
+                manager = None
+        response.flush()
+    if manager != None:
+        manager.close()
+
 def main():
     parser = argparse.ArgumentParser(description="Witcher Parallel Unit")
 
@@ -12,11 +54,18 @@ def main():
                         help="args pickle path")
 
     parser.add_argument("-tx", "--tx-id",
-                        required=True,
                         help="withcer tx id")
 
+    parser.add_argument("-worker", "--worker",
+                        action="store_true",
+                        help="run the tasks of the validation scheduler")
+
     args = parser.parse_args()
     args_from_pickle = pickle.load(open(args.args_pickle_path, 'rb'))
+    if args.worker:
+        run_worker(args_from_pickle)
+        return
+
     tx_id = int(args.tx_id)
 
     witcher_parallel_crash_manager = \
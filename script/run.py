@@ -14,9 +14,7 @@ def run(app_name, path):
     os.chdir(path)
     os.system('make clean')
     os.system('make main.trace >/dev/null 2>/dev/null')
-    os.system('make main.trace.split >/dev/null')
-    os.system('make main.trace.split.bb >/dev/null')
-    os.system('make main.pmtrace >/dev/null 2>/dev/null')
+    os.system('make tracepost >/dev/null 2>/dev/null')
 
     t0 = datetime.datetime.now()
     os.system('make main.ppdg >/dev/null 2>/dev/null')
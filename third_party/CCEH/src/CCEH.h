@@ -15,6 +15,11 @@ constexpr size_t kSegmentSize = (1 << kSegmentBits) * 16 * 4;
 constexpr size_t kNumPairPerCacheLine = 4;
 constexpr size_t kNumCacheLine = 4;
 
+#include "src/probe.h"
+#ifdef CCEH_SIMD_PROBE
+static_assert(kNumPairPerCacheLine == 4, "MatchKeys compares 4 pairs");
+#endif
+
 struct Segment {
   static const size_t kNumSlot = kSegmentSize/sizeof(Pair);
 
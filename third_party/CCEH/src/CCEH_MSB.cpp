@@ -91,9 +91,17 @@ int Segment::Insert(Key_t& key, Value_t value, size_t loc, size_t key_hash) {
 }
 
 void Segment::Insert4split(Key_t& key, Value_t value, size_t loc) {
+#ifdef CCEH_SIMD_PROBE
+  for (unsigned i = 0; i < kNumCacheLine; ++i) {
+    auto line = (loc + i*kNumPairPerCacheLine) % kNumSlot;
+    auto match = MatchKeys(&_[line], INVALID);
+    if (match) {
+      auto slot = line + __builtin_ctz(match);
+#else
   for (unsigned i = 0; i < kNumPairPerCacheLine * kNumCacheLine; ++i) {
     auto slot = (loc+i) % kNumSlot;
     if (_[slot].key == INVALID) {
+#endif
       _[slot].key = key;
       _[slot].value = value;
       return;
@@ -377,9 +385,17 @@ Value_t CCEH::Get(Key_t& key) {
   }
 #endif
 
+#ifdef CCEH_SIMD_PROBE
+  for (unsigned i = 0; i < kNumCacheLine; ++i) {
+    auto line = (y + i*kNumPairPerCacheLine) % Segment::kNumSlot;
+    auto match = MatchKeys(&dir_->_[line], key);
+    if (match) {
+      auto slot = line + __builtin_ctz(match);
+#else
   for (unsigned i = 0; i < kNumPairPerCacheLine * kNumCacheLine; ++i) {
     auto slot = (y+i) % Segment::kNumSlot;
     if (dir_->_[slot].key == key) {
+#endif
 #ifdef INPLACE
       sema = dir->_[x]->sema;
       while (!CAS(&dir->_[x]->sema, &sema, sema-1)) {
@@ -0,0 +1,41 @@
+#ifndef CCEH_PROBE_H_
+#define CCEH_PROBE_H_
+
+#include "util/pair.h"
+
+// Vector probing of the pairs of a cache line: the keys of the
+// kNumPairPerCacheLine pairs are compared with a key in one AVX2 (or two
+// SSE4.1) compares instead of one at a time. CCEH_SIMD_PROBE is defined when
+// the target has either, unless CCEH_SCALAR_PROBE is; without it the
+// lookups keep their scalar loops.
+#if !defined(CCEH_SCALAR_PROBE) && (defined(__AVX2__) || defined(__SSE4_1__))
+#define CCEH_SIMD_PROBE
+#include <immintrin.h>
+#endif
+
+#ifdef CCEH_SIMD_PROBE
+// Bit i is set if the key of pairs[i] is key, for the 4 pairs of a cache line
+inline unsigned MatchKeys(const Pair* pairs, Key_t key) {
+#ifdef __AVX2__
+  // k0 v0 k1 v1 and k2 v2 k3 v3: the keys are the even lanes
+  __m256i k = _mm256_set1_epi64x(key);
+  __m256i lo = _mm256_loadu_si256((const __m256i*)pairs);
+  __m256i hi = _mm256_loadu_si256((const __m256i*)(pairs + 2));
+  unsigned mlo = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(lo, k)));
+  unsigned mhi = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(hi, k)));
+  return (mlo & 1) | ((mlo >> 1) & 2) | ((mhi & 1) << 2) | ((mhi << 1) & 8);
+#else
+  // k0 k1 and k2 k3
+  __m128i k = _mm_set1_epi64x(key);
+  __m128i k01 = _mm_unpacklo_epi64(_mm_loadu_si128((const __m128i*)pairs),
+                                   _mm_loadu_si128((const __m128i*)(pairs + 1)));
+  __m128i k23 = _mm_unpacklo_epi64(_mm_loadu_si128((const __m128i*)(pairs + 2)),
+                                   _mm_loadu_si128((const __m128i*)(pairs + 3)));
+  unsigned m01 = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(k01, k)));
+  unsigned m23 = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(k23, k)));
+  return m01 | (m23 << 2);
+#endif
+}
+#endif
+
+#endif  // CCEH_PROBE_H_
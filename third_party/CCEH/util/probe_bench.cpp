@@ -0,0 +1,113 @@
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "util/pair.h"
+#include "util/hash.h"
+#include "util/timer.h"
+#include "src/probe.h"
+
+using namespace std;
+
+// The probing of CCEH::Get over segments in DRAM, so the scalar and the
+// vector probing are compared without the rest of the hash table
+constexpr size_t kSegmentBits = 8;
+constexpr size_t kMask = (1 << kSegmentBits)-1;
+constexpr size_t kNumPairPerCacheLine = 4;
+constexpr size_t kNumCacheLine = 4;
+constexpr size_t kNumSlot = (1 << kSegmentBits) * kNumPairPerCacheLine;
+
+static Value_t GetScalar(Pair* segment, Key_t key, size_t y) {
+  for (unsigned i = 0; i < kNumPairPerCacheLine * kNumCacheLine; ++i) {
+    auto slot = (y+i) % kNumSlot;
+    if (segment[slot].key == key) {
+      return segment[slot].value;
+    }
+  }
+  return NONE;
+}
+
+#ifdef CCEH_SIMD_PROBE
+static Value_t GetSIMD(Pair* segment, Key_t key, size_t y) {
+  for (unsigned i = 0; i < kNumCacheLine; ++i) {
+    auto line = (y + i*kNumPairPerCacheLine) % kNumSlot;
+    auto match = MatchKeys(&segment[line], key);
+    if (match) {
+      return segment[line + __builtin_ctz(match)].value;
+    }
+  }
+  return NONE;
+}
+#endif
+
+template <class Get>
+static void Run(const char* name, vector<Pair*>& segments,
+                vector<Key_t>& lookups, Get get) {
+  Timer timer;
+  size_t found = 0;
+  timer.Start();
+  for (auto key : lookups) {
+    auto key_hash = h(&key, sizeof(key));
+    auto segment = segments[(key_hash >> kSegmentBits) % segments.size()];
+    found += get(segment, key, (key_hash & kMask) * kNumPairPerCacheLine) != NONE;
+  }
+  timer.Stop();
+  cout << name << ": " << lookups.size() / timer.GetSeconds() / 1000000
+       << " Mops/s, " << found << " found" << endl;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 4) {
+    cerr << "Usage: " << argv[0] << " [# of keys] [# of lookups] [miss %]" << endl;
+    return 1;
+  }
+  const size_t numKeys = atol(argv[1]);
+  const size_t numLookups = atol(argv[2]);
+  const unsigned missPercent = atoi(argv[3]);
+
+  // about 3/4 of the slots filled, as before a segment splits
+  const size_t numSegments = numKeys / (kNumSlot * 3 / 4) + 1;
+  vector<Pair*> segments(numSegments);
+  for (auto& segment : segments) {
+    segment = new Pair[kNumSlot];
+  }
+
+  mt19937_64 rand(1);
+  vector<Key_t> keys;
+  keys.reserve(numKeys);
+  while (keys.size() < numKeys) {
+    Key_t key = rand() % (INVALID - 2);
+    auto key_hash = h(&key, sizeof(key));
+    auto segment = segments[(key_hash >> kSegmentBits) % numSegments];
+    auto y = (key_hash & kMask) * kNumPairPerCacheLine;
+    for (unsigned i = 0; i < kNumPairPerCacheLine * kNumCacheLine; ++i) {
+      auto slot = (y+i) % kNumSlot;
+      if (segment[slot].key == INVALID) {
+        segment[slot].key = key;
+        segment[slot].value = (Value_t)&segment[slot];
+        keys.push_back(key);
+        break;
+      }
+    }
+  }
+
+  vector<Key_t> lookups(numLookups);
+  for (auto& key : lookups) {
+    if (rand() % 100 < missPercent) {
+      key = rand() % (INVALID - 2);
+    } else {
+      key = keys[rand() % numKeys];
+    }
+  }
+
+  cout << "# of keys: " << numKeys << ", # of segments: " << numSegments
+       << ", # of lookups: " << numLookups << ", miss: " << missPercent << "%"
+       << endl;
+  Run("scalar", segments, lookups, GetScalar);
+#ifdef CCEH_SIMD_PROBE
+  Run("simd", segments, lookups, GetSIMD);
+#else
+  cout << "simd: not built with AVX2 or SSE4.1" << endl;
+#endif
+  return 0;
+}
@@ -88,6 +88,20 @@ void witcher_tx_end()
 	  //do nothing
 }
 
+/* Tell the validator the server is ready: it recovered from the pslab and
+ * listens. The validator passes a pipe in WITCHER_READY_FD, so it does not
+ * have to guess how long the server takes to start. */
+void witcher_server_ready()
+{
+	const char *ready_fd = getenv("WITCHER_READY_FD");
+	if (ready_fd == NULL)
+		return;
+	int fd = atoi(ready_fd);
+	if (write(fd, "ready\n", 6) != 6)
+		perror("witcher_server_ready");
+	close(fd);
+}
+
 /*
  * forward declarations
  */
@@ -7990,6 +8004,8 @@ fprintf(stderr, "pslab_size=%ld", pslab_size);
     /* Initialize the uriencode lookup table. */
     uriencode_init();
 
+    witcher_server_ready();
+
     /* enter the event loop */
     if (event_base_loop(main_base, 0) != 0) {
         retval = EXIT_FAILURE;
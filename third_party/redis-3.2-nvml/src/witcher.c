@@ -1,3 +1,7 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
 void witcher_tx_begin() {
   // do nothing
 }
@@ -5,3 +9,18 @@ void witcher_tx_begin() {
 void witcher_tx_end() {
   // do nothing
 }
+
+// Tell the validator the server is ready: it recovered from the PM file and
+// listens. The validator passes a pipe in WITCHER_READY_FD, so it does not
+// have to guess how long the server takes to start.
+void witcher_server_ready() {
+  const char *ready_fd = getenv("WITCHER_READY_FD");
+  if (ready_fd == NULL) {
+    return;
+  }
+  int fd = atoi(ready_fd);
+  if (write(fd, "ready\n", 6) != 6) {
+    perror("witcher_server_ready");
+  }
+  close(fd);
+}
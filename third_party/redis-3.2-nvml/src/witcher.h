@@ -1,2 +1,3 @@
 void witcher_tx_begin();
 void witcher_tx_end();
+void witcher_server_ready();